@@ -4,94 +4,135 @@
 #include <common/Try.hpp>
 #include <common/types.hpp>
 
+// a bit per allocation, with a second level summary holding a bit per Reg of allocations (set when that Reg is completely full)
+// this lets us skip a whole Reg of full Regs in a single compare, so claims and releases stay O(1) amortised even over large masks
 struct AllocationMask {
+	static_assert(sizeof(Reg)<=sizeof(unsigned long long), "AllocationMask expects Reg to fit within __builtin_ctzll");
+
+	static inline const UPtr regBits = 8*sizeof(Reg);
+
 	/**/ AllocationMask(Reg *data, UPtr _count):
 		data(data),
 		count(
 			_count
-			// round down to fit within 8 bits and Reg size
-			/8*8
-			/(8*sizeof(Reg))*(8*sizeof(Reg))
-		)
+			// round down to fit within Reg size
+			/regBits*regBits
+		),
+		summary(data+count/regBits),
+		summaryCount((count/regBits+regBits-1)/regBits)
 	{
-		debug::assert(count%8==0);
 		debug::assert((UPtr)data%sizeof(Reg)==0);
-		memset(data, 0, (count+7)/8);
+		memset(data, 0, count/8);
+		memset(summary, 0, summaryCount*sizeof(Reg));
+
+		// mark the summary bits past the end as full, so they're never picked
+		if(const auto usedBits = count/regBits%regBits){
+			summary[summaryCount-1] = ~(Reg)0<<usedBits;
+		}
 	}
 
 	static auto size_required(UPtr count) -> UPtr {
-		return count/8 /8*8 /sizeof(Reg)*sizeof(Reg);
+		const auto regCount = count/regBits;
+		return (regCount+(regCount+regBits-1)/regBits)*sizeof(Reg);
 	}
 
 	auto claim() -> Try<UPtr> {
-		if(earliestFree>=count) return Failure{"No allocation pages remain"}; // none available
-
-		// // are we at the end of the list? just return that
-		// if(earliestFree==afterLastTaken){
-		// 	((U8*)data)[earliestFree/8] |= 1<<(earliestFree%8);
-		// 	afterLastTaken++;
-		// 	return {earliestFree++};
-		// }
-
-		// be fast and allocate sequentially first, if we've not reached the end
-		if(afterLastTaken<count){
-			((U8*)data)[afterLastTaken/8] |= 1<<(afterLastTaken%8);
-			return {afterLastTaken++};
-		}
+		for(;earliestFree<summaryCount; earliestFree++){
+			if(summary[earliestFree]==~(Reg)0) continue;
 
-		/// ..otherwise, begin a search..
+			const auto regIndex = earliestFree*regBits+first_unset(summary[earliestFree]);
+			const auto bit = first_unset(data[regIndex]);
+			set_bits(regIndex, (Reg)1<<bit);
+			return {regIndex*regBits+bit};
+		}
 
-		// search 1 byte at a time until we're Reg aligned
-		for(;earliestFree<count&&earliestFree%(8*sizeof(Reg)); earliestFree+=8){
-			if(((U8*)data)[earliestFree/8]==0xff) continue;
+		return Failure{"No allocation pages remain"};
+	}
 
-			auto bit = __builtin_ctz(~((U8*)data)[earliestFree/8]); // (__builtin_ctz gets us the first set bit, so we feed it the ~ inverse to find the first unset)
-			((U8*)data)[earliestFree/8] |= 1<<bit;
-			earliestFree = ((earliestFree&~0xff)|bit)+1;
-			afterLastTaken = max(afterLastTaken, earliestFree);
-			return {earliestFree-1};
-		}
+	// claim `claimCount` consecutive allocations, returning the first
+	auto claim_contiguous(UPtr claimCount) -> Try<UPtr> {
+		if(claimCount<1) return Failure{"No allocations requested"};
+		if(claimCount==1) return claim();
 
-		// search Reg bytes at a time, aborting early if a match is found
-		for(;earliestFree+8*sizeof(Reg)<=count; earliestFree+=8*sizeof(Reg)){
-			if(data[earliestFree/8/sizeof(Reg)]!=~0u) break;
-		}
+		UPtr runStart = 0;
+		UPtr runLength = 0;
 
-		// search 1 byte at a time
-		for(;earliestFree<count; earliestFree+=8){
-			if(((U8*)data)[earliestFree/8]==0xff) continue;
+		for(auto summaryIndex=earliestFree; summaryIndex<summaryCount; summaryIndex++){
+			// a whole summary's worth of full regs breaks any run
+			if(summary[summaryIndex]==~(Reg)0){
+				runLength = 0;
+				continue;
+			}
 
-			auto bit = __builtin_ctz(~((U8*)data)[earliestFree/8]); // (__builtin_ctz gets us the first set bit, so we feed it the ~ inverse to find the first unset)
-			((U8*)data)[earliestFree/8] |= 1<<bit;
-			earliestFree = ((earliestFree&~0xff)|bit)+1;
-			afterLastTaken = max(afterLastTaken, earliestFree);
-			return {earliestFree-1};
+			const auto regEnd = min((summaryIndex+1)*regBits, count/regBits);
+			for(auto regIndex=summaryIndex*regBits; regIndex<regEnd; regIndex++){
+				const auto reg = data[regIndex];
+
+				if(reg==~(Reg)0){
+					runLength = 0;
+					continue;
+				}
+
+				if(reg==0&&(runLength>0||claimCount>=regBits)){
+					// the whole reg extends (or starts) the run
+					if(!runLength) runStart = regIndex*regBits;
+					runLength += regBits;
+
+				}else{
+					for(auto bit=0u; bit<regBits; bit++){
+						if(reg&(Reg)1<<bit){
+							runLength = 0;
+							continue;
+						}
+
+						if(!runLength) runStart = regIndex*regBits+bit;
+						if(++runLength>=claimCount) break;
+					}
+				}
+
+				if(runLength>=claimCount){
+					set_range(runStart, claimCount);
+					return {runStart};
+				}
+			}
 		}
 
-		//nothing found
-		afterLastTaken = earliestFree; // both now equal to count
-		return Failure{"No allocation pages remain"};
+		return Failure{"No contiguous allocation pages remain"};
 	}
 
 	void release(UPtr index) {
-		((U8*)data)[index/8] &= ~(1<<index);
+		const auto regIndex = index/regBits;
+		data[regIndex] &= ~((Reg)1<<index%regBits);
+		summary[regIndex/regBits] &= ~((Reg)1<<regIndex%regBits);
 
-		earliestFree = min(index, earliestFree);
+		earliestFree = min(regIndex/regBits, earliestFree);
+	}
 
-		// have we just removed the last taken position?
-		if(index==afterLastTaken-1){
-			afterLastTaken--;
+	Reg *data;
+	UPtr count; // size in bits
+	Reg *summary; // a bit per Reg of `data`, set if it's full
+	UPtr summaryCount; // size in Regs
+	UPtr earliestFree = 0; // there are guarenteed to be no unset summary bits before this summary Reg
 
-			//continue rolling back one bit at a time until we're at the last free bit again
-			//TODO: optimise this to byte and Reg steps when doing big rollbacks
-			while(afterLastTaken>earliestFree && ((U8*)data)[(afterLastTaken-1)/8] & 1<<((afterLastTaken-1)%8) == 0){
-				afterLastTaken--;
-			}
+protected:
+	static auto first_unset(Reg value) -> U32 {
+		return __builtin_ctzll(~(unsigned long long)value); // (__builtin_ctz gets us the first set bit, so we feed it the ~ inverse to find the first unset)
+	}
+
+	void set_bits(UPtr regIndex, Reg bits) {
+		data[regIndex] |= bits;
+		if(data[regIndex]==~(Reg)0){
+			summary[regIndex/regBits] |= (Reg)1<<regIndex%regBits;
 		}
 	}
 
-	Reg *data;
-	UPtr count; // size in bits
-	UPtr earliestFree = 0; // there are guarenteed to be no unset bits before this position
-	UPtr afterLastTaken = 0; // there are guarenteed to be no set bits from this position onwards
+	void set_range(UPtr index, UPtr length) {
+		while(length>0){
+			const auto bit = index%regBits;
+			const auto bits = min(length, regBits-bit);
+			set_bits(index/regBits, (bits==regBits?~(Reg)0:((Reg)1<<bits)-1)<<bit);
+			index += bits;
+			length -= bits;
+		}
+	}
 };
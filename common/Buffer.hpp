@@ -6,3 +6,9 @@ struct Buffer {
 	U8 *data;
 	U64 size;
 };
+
+// a read-only view of memory owned elsewhere
+struct ConstBuffer {
+	const U8 *data;
+	U64 size;
+};
@@ -11,15 +11,34 @@
 #include <new>
 
 //These must always be aligned correctly in memory
+//Each block is boundary tagged - it records the size of the block physically before it, so that it can be found and merged with in O(1) when freed
 struct MemoryPoolBlock:LListItem<MemoryPoolBlock> {
 	static const size_t headerSize;
 
 	/**/ MemoryPoolBlock(size_t size):
+		prevSize(0),
+		_tag(0),
+		isAvailable(false),
+		isFirst(true),
+		isLast(true),
 		size(size - headerSize)
 	{}
 
-	size_t size;
+	size_t prevSize; // size of the block physically before this (if not `isFirst`)
+	size_t _tag:1; // always 0 on pool blocks. This shares the word directly before `_data`, so owners (such as PagedPool) can set this on their own allocation headers to tell them apart
+	size_t isAvailable:1; // is this block free and in one of the `availableBins`?
+	size_t isFirst:1; // is this the first block in its contiguous region?
+	size_t isLast:1; // is this the last block in its contiguous region?
+	size_t size:sizeof(size_t)*8-4;
 	U8 _data; //since we're offsetting by `size_t`, we'll assume this shares `size_t_` alignment and is thus always at a valid alignment
+
+	auto get_next_physical() -> MemoryPoolBlock* {
+		return isLast?nullptr:(MemoryPoolBlock*)(&_data+size);
+	}
+
+	auto get_prev_physical() -> MemoryPoolBlock* {
+		return isFirst?nullptr:(MemoryPoolBlock*)((U8*)this-prevSize-headerSize);
+	}
 };
 
 inline const size_t MemoryPoolBlock::headerSize = offsetof(MemoryPoolBlock, MemoryPoolBlock::_data);
@@ -29,19 +48,26 @@ inline const size_t MemoryPoolBlock::headerSize = offsetof(MemoryPoolBlock, Memo
 template <unsigned alignment>
 struct MemoryPool {
 	/**/ MemoryPool(void *address, size_t size):
-		available(size),
+		available(0),
 		used(0)
 	{
 		if(address){
 			auto block = new ((MemoryPoolBlock*)address) MemoryPoolBlock(size);
-			availableBlocks.push_back(*block);
+			claim_block(*block);
 		}
 	}
 
 	size_t available;
 	size_t used;
-	bool needsCompacting = false;
-	LList<MemoryPoolBlock> availableBlocks;
+
+	// available blocks are binned by size class (the highest set bit of their size), with a bit set for each bin that isn't empty. Freeing is then a push onto a bin, and any block in a higher bin than a request's is large enough for it
+	static const unsigned binCount = sizeof(size_t)*8;
+	LList<MemoryPoolBlock> availableBins[binCount];
+	size_t binsInUse = 0;
+
+	static auto get_bin(size_t size) -> unsigned {
+		return sizeof(unsigned long long)*8-1-__builtin_clzll(size|1);
+	}
 
 	void* malloc(size_t size) {
 		#ifdef MEMORY_CHECKS
@@ -52,215 +78,58 @@ struct MemoryPool {
 
 		//TODO:align properly. This only aligns the chunk position, not the data inside it
 
-		unsigned requiredSize = align(size, alignment);
-
-		auto isLarge = requiredSize>=memory::pageSize; //TODO:mark is large if it's higher than the median size (do this with a guessed term that adapts on each search when more than half blocks are searched)
-
-		if(!isLarge){ //search forwards
-			for(auto block=availableBlocks.head;block;block=block->next){
-				if(block->size>=requiredSize){
-					block = availableBlocks.pop(*block);
-					available -= block->size; //we subtract the whole block first, as if we reclaim the tail that will add back onto available
+		const size_t requiredSize = align(size, alignment);
+		const auto bin = get_bin(requiredSize);
 
-					const unsigned remainingSize = block->size-requiredSize;
-					if(remainingSize>MemoryPoolBlock::headerSize&&remainingSize>=alignment){
-						block->size = requiredSize;
-
-						#pragma GCC diagnostic push
-						#pragma GCC diagnostic ignored "-Wplacement-new"
-							auto remainingSlot = new (&block->_data+requiredSize) MemoryPoolBlock(remainingSize);
-						#pragma GCC diagnostic pop
-						claim_block(*remainingSlot);
-					}
-
-					used += block->size; //we add just the used final block size, in case the tail gets chopped off
-					return &block->_data;
-				}
-			}
-
-		}else{ //search backwards
-			for(auto block=availableBlocks.tail;block;block=block->prev){
-				if(block->size>=requiredSize&&(!block->prev||block->prev&&block->prev->size<requiredSize)){
-					block = availableBlocks.pop(*block);
-					available -= block->size; //we subtract the whole block first, as if we reclaim the tail that will add back onto available
-
-					const unsigned remainingSize = block->size-requiredSize;
-					if(remainingSize>MemoryPoolBlock::headerSize&&remainingSize>=alignment){
-						block->size = requiredSize;
-
-						#pragma GCC diagnostic push
-						#pragma GCC diagnostic ignored "-Wplacement-new"
-							auto remainingSlot = new (&block->_data+requiredSize) MemoryPoolBlock(remainingSize);
-						#pragma GCC diagnostic pop
-						claim_block(*remainingSlot);
-					}
-
-					used += block->size; //we add just the used final block size, in case the tail gets chopped off
-					return &block->_data;
-				}
+		// blocks in the request's own bin may or may not be large enough
+		for(auto block=availableBins[bin].head;block;block=block->next){
+			if(block->size>=requiredSize){
+				return claim_from_block(*block, requiredSize);
 			}
 		}
 
-		if(needsCompacting&&available>=requiredSize){
-			// if we can't find a chunk this big although we have space, it might be compacting memory will help
-			// give it one final try if we can compact
-			if(compact()){
-				return malloc(size);
-			}
-		}
+		// but those in any higher bin always are
+		const auto higherBins = binsInUse&~(((size_t)2<<bin)-1);
+		if(!higherBins) return nullptr;
 
-		return nullptr;
+		return claim_from_block(*availableBins[__builtin_ctzll(higherBins)].head, requiredSize);
 	}
 
 	template <typename Type>
 	auto malloc_fixed_size() -> FixedSizeAllocation<Type>* {
-		const auto size = align(sizeof(FixedSizeAllocation<Type>), alignment);
-
-		#ifdef MEMORY_CHECKS
-			logging::Section section("malloc ", size);
-
-			memory::debug();
-		#endif
-
-		auto isLarge = size>=memory::pageSize; //TODO:mark is large if it's higher than the median size (do this with a guessed term that adapts on each search when more than half blocks are searched)
-
-		if(!isLarge){ //search forwards
-			for(auto block=availableBlocks.head;block;block=block->next){
-				const auto usableBlockSize = MemoryPoolBlock::headerSize + block->size;
-
-				// exact size OR big enough to house a block for the remaining area
-				if(usableBlockSize==size||usableBlockSize>=size+MemoryPoolBlock::headerSize+alignment){
-					const auto oldBlockSize = block->size;
-
-					auto data = (FixedSizeAllocation<Type>*)availableBlocks.pop(*block);
-					available -= oldBlockSize; //we subtract the whole block first, as if we reclaim the tail that will add back onto available
-
-					if(usableBlockSize>size){
-						const unsigned remainingSize = usableBlockSize-size-MemoryPoolBlock::headerSize;
-
-						#pragma GCC diagnostic push
-						#pragma GCC diagnostic ignored "-Wplacement-new"
-							auto remainingSlot = new ((U8*)&data+size) MemoryPoolBlock(remainingSize);
-						#pragma GCC diagnostic pop
-						claim_block(*remainingSlot);
-					}
-
-					used += oldBlockSize;
-					return data;
-				}
-			}
-
-		}else{ //search backwards
-			MemoryPoolBlock *lastValid = nullptr;
-
-			for(auto block=availableBlocks.tail;block;block=block->prev){
-				const auto usableBlockSize = MemoryPoolBlock::headerSize + block->size;
-
-				if(usableBlockSize==size||usableBlockSize>=size+MemoryPoolBlock::headerSize+alignment) {
-					lastValid = block;
-					continue;
-				}
-
-				if(usableBlockSize<size) break;
-			}
-
-			if(lastValid){
-				const auto oldBlockSize = lastValid->size;
-				const auto usableBlockSize = MemoryPoolBlock::headerSize + oldBlockSize;
-
-				auto data = (FixedSizeAllocation<Type>*)availableBlocks.pop(*lastValid);
-				available -= oldBlockSize; //we subtract the whole block first, as if we reclaim the tail that will add back onto available
-
-				if(usableBlockSize>size){
-					const unsigned remainingSize = usableBlockSize-size-MemoryPoolBlock::headerSize;
-
-					#pragma GCC diagnostic push
-					#pragma GCC diagnostic ignored "-Wplacement-new"
-						auto remainingSlot = new ((U8*)&data+size) MemoryPoolBlock(remainingSize);
-					#pragma GCC diagnostic pop
-					claim_block(*remainingSlot);
-				}
-
-				used += oldBlockSize; //we add just the used final block size, in case the tail gets chopped off
-				return data;
-			}
-		}
-
-		if(needsCompacting&&available>=size){
-			// if we can't find a chunk this big although we have space, it might be compacting memory will help
-			// give it one final try if we can compact
-			if(compact()){
-				return malloc(size);
-			}
-		}
-
-		return nullptr;
+		// blocks always need their header now, for their neighbours to be able to find them when merging, so these are just regular allocations
+		return (FixedSizeAllocation<Type>*)malloc(sizeof(FixedSizeAllocation<Type>));
 	}
 
+	// return a newly available block to the pool, merging it with any available physical neighbours
 	void claim_block(MemoryPoolBlock &reclaim){
 		#ifdef MEMORY_CHECKS
 			logging::Section section("claim block ", &reclaim, " of size ", reclaim.size);
 			memory::debug();
 		#endif
 
-		debug::assert(!availableBlocks.contains(reclaim));
+		debug::assert(!reclaim.isAvailable);
 
-		available += reclaim.size;
+		auto block = &reclaim;
 
-		auto isLarge = reclaim.size>=memory::pageSize; //TODO:compare to adaptive median size
-
-		if(!availableBlocks.head){
-			availableBlocks.push_back(reclaim);
-
-		}else{
-
-			if(!isLarge){ //search forwards
-				MemoryPoolBlock *block;
-				for(block=availableBlocks.head; block; block=block->next){
-					if(block->size>=reclaim.size){
-						#ifdef MEMORY_CHECKS
-							logging::print_info("insert_before ", &reclaim);
-						#endif
-						availableBlocks.insert_before(*block, reclaim);
-						goto inserted;
-					}
-				}
-
-				availableBlocks.push_back(reclaim);
-
-			}else{
-				for(auto block=availableBlocks.tail; block; block=block->prev){
-					if(block->size<=reclaim.size){
-						#ifdef MEMORY_CHECKS
-							logging::print_info("insert_after ", &reclaim);
-						#endif
-						availableBlocks.insert_after(*block, reclaim);
-						goto inserted;
-					}
-				}
-
-				availableBlocks.push_front(reclaim);
-			}
+		if(auto next = block->get_next_physical(); next&&next->isAvailable){
+			unlink_block(*next);
+			block->size += MemoryPoolBlock::headerSize + next->size;
+			block->isLast = next->isLast;
 		}
 
-		inserted:
-		;
+		if(auto prev = block->get_prev_physical(); prev&&prev->isAvailable){
+			unlink_block(*prev);
+			prev->size += MemoryPoolBlock::headerSize + block->size;
+			prev->isLast = block->isLast;
+			block = prev;
+		}
 
-		#ifdef MEMORY_CHECKS
-			{
-				bool found = false;
-				for(auto block=availableBlocks.head; block; block=block->next){
-					if(block==&reclaim){
-						found = true;
-					}
-				}
-
-				if(!found){
-					logging::print_error("Error: NOT FOUND");
-					memory::debug();
-				}
-			}
-		#endif
+		if(auto next = block->get_next_physical()){
+			next->prevSize = block->size;
+		}
+
+		link_block(*block);
 	}
 
 	MemoryPoolBlock* get_block(void *address){
@@ -269,59 +138,68 @@ struct MemoryPool {
 
 	void free(void *address){
 		auto block = get_block(address);
-		const auto size = block->size;
+		used -= block->size;
 		claim_block(*block);
-		used -= size;
-		needsCompacting = true;
 	}
 
 	template <typename Type>
 	void free(FixedSizeAllocation<Type> *allocation){
-		auto block = (MemoryPoolBlock*)allocation;
-		block->size = sizeof(FixedSizeAllocation<Type>)-MemoryPoolBlock::headerSize;
-		const auto size = block->size;
-		claim_block(*block);
-		used -= size;
-		needsCompacting = true;
+		free((void*)allocation);
 	}
 
-	bool compact() {
-		//TODO: write something faster
-
-		{ // brute search and merge adjacent memory blocks
-			for(auto block=availableBlocks.head;block;block=block->next){
-				searchForNext:
-				for(auto other=availableBlocks.head;other;other=other->next){
-					if(other==block) continue;
-					if((U8*)other==&block->_data+block->size){
-						block->size += offsetof(MemoryPoolBlock, MemoryPoolBlock::_data) + other->size;
-						availableBlocks.pop(*other);
-						goto searchForNext;
-					}
-				}
-			}
-		}
+protected:
+	// claim the front `requiredSize` of an available block, returning the remainder to the pool
+	auto claim_from_block(MemoryPoolBlock &block, size_t requiredSize) -> void* {
+		unlink_block(block);
+
+		const size_t remainingSize = block.size-requiredSize;
+		if(remainingSize>MemoryPoolBlock::headerSize&&remainingSize-MemoryPoolBlock::headerSize>=alignment){
+			#pragma GCC diagnostic push
+			#pragma GCC diagnostic ignored "-Wplacement-new"
+				auto &remainingSlot = *new (&block._data+requiredSize) MemoryPoolBlock(remainingSize);
+			#pragma GCC diagnostic pop
 
-		{ // sort blocks by size
-			LList<MemoryPoolBlock> sortedBlocks;
-			while(auto block = availableBlocks.pop_front()){
-				for(auto other=sortedBlocks.head;other;other=other->next){
-					if(other->size>=block->size){
-						sortedBlocks.insert_before(*other, *block);
-						goto sortedBlockInserted;
-					}
-				}
+			remainingSlot.prevSize = requiredSize;
+			remainingSlot.isFirst = false;
+			remainingSlot.isLast = block.isLast;
 
-				sortedBlocks.push_back(*block);
+			block.size = requiredSize;
+			block.isLast = false;
 
-				sortedBlockInserted:;
+			if(auto next = remainingSlot.get_next_physical()){
+				next->prevSize = remainingSlot.size;
 			}
 
-			availableBlocks = sortedBlocks;
+			// the neighbours of an available block are never available (they'd have been merged), so this can't need merging
+			link_block(remainingSlot);
 		}
 
-		needsCompacting = false;
+		used += block.size;
+		return &block._data;
+	}
+
+	// add to the bin for its size class
+	void link_block(MemoryPoolBlock &reclaim){
+		#ifdef MEMORY_CHECKS
+			logging::Section section("link block ", &reclaim, " of size ", reclaim.size);
+		#endif
+
+		reclaim.isAvailable = true;
+		available += reclaim.size;
+
+		const auto bin = get_bin(reclaim.size);
+		availableBins[bin].push_front(reclaim);
+		binsInUse |= (size_t)1<<bin;
+	}
+
+	void unlink_block(MemoryPoolBlock &block){
+		const auto bin = get_bin(block.size);
+		availableBins[bin].pop(block);
+		if(!availableBins[bin].head){
+			binsInUse &= ~((size_t)1<<bin);
+		}
 
-		return false; //return if successful
+		block.isAvailable = false;
+		available -= block.size;
 	}
 };
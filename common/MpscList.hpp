@@ -0,0 +1,31 @@
+#pragma once
+
+#include <common/common.hpp>
+
+#include <atomic>
+
+// multi-producer single-consumer intrusive list
+// producers push lock-free, and the consumer takes everything at once. Items are linked through their own `next` member, so this never allocates (and so is safe to use from within allocators)
+
+template <typename Type>
+struct MpscList: NonCopyable<MpscList<Type>> {
+	std::atomic<Type*> head{nullptr};
+
+	void push(Type &item) {
+		auto oldHead = head.load(std::memory_order_relaxed);
+		do{
+			item.next = oldHead;
+		}while(!head.compare_exchange_weak(oldHead, &item, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	// take all items (most recently pushed first), leaving the list empty
+	auto take_all() -> Type* {
+		if(!head.load(std::memory_order_relaxed)) return nullptr;
+
+		return head.exchange(nullptr, std::memory_order_acquire);
+	}
+
+	auto is_empty() -> bool {
+		return !head.load(std::memory_order_relaxed);
+	}
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <common/common.hpp>
+
+#include <atomic>
+
+// single-owner, multi-thief lock-free deque (Chase-Lev), of a fixed power of 2 capacity so that it never allocates
+// the owner pushes and pops at the bottom, while any other processor may steal from the top
+
+template <typename Type, U32 capacity>
+struct WorkStealingDeque: NonCopyable<WorkStealingDeque<Type, capacity>> {
+	static_assert(capacity&&!(capacity&(capacity-1)), "capacity must be a power of 2");
+
+	std::atomic<I64> top{0};
+	std::atomic<I64> bottom{0};
+	std::atomic<Type*> items[capacity];
+
+	// owner only. Returns false if full
+	auto push(Type &item) -> bool {
+		const auto b = bottom.load(std::memory_order_relaxed);
+		const auto t = top.load(std::memory_order_acquire);
+		if(b-t>=(I64)capacity) return false;
+
+		items[b&(capacity-1)].store(&item, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b+1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// owner only
+	auto pop() -> Type* {
+		const auto b = bottom.load(std::memory_order_relaxed)-1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto t = top.load(std::memory_order_relaxed);
+
+		if(t>b){ // already empty
+			bottom.store(b+1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		auto item = items[b&(capacity-1)].load(std::memory_order_relaxed);
+
+		if(t==b){ // the last item, so we're racing any thieves for it
+			if(!top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed)){
+				item = nullptr;
+			}
+			bottom.store(b+1, std::memory_order_relaxed);
+		}
+
+		return item;
+	}
+
+	// any processor. May fail (returning nullptr) if it lost a race, even if items remain
+	auto steal() -> Type* {
+		auto t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const auto b = bottom.load(std::memory_order_acquire);
+		if(t>=b) return nullptr;
+
+		auto item = items[t&(capacity-1)].load(std::memory_order_relaxed);
+		if(!top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+
+		return item;
+	}
+
+	auto get_size() -> U32 {
+		const auto size = bottom.load(std::memory_order_relaxed)-top.load(std::memory_order_relaxed);
+		return size>0?size:0;
+	}
+};
@@ -3,42 +3,92 @@
 #include "File.hpp"
 
 namespace fileStash {
-	File Directory::get_file(const C8 *name) {
-		const auto nameLength = strlen(name);
+	namespace {
+		// names in the index are ordered bytewise, with shorter names before longer ones they start with
+		I32 compare_name(const C8 *a, U64 aLength, const C8 *b, U64 bLength) {
+			const auto length = aLength<bLength?aLength:bLength;
 
-		BufferReader reader(this->reader.buffer);
+			if(auto result = memcmp(a, b, length)) return result;
+
+			return aLength<bLength?-1:aLength>bLength?+1:0;
+		}
+	}
+
+	void Directory::reset() {
 		reader.set_position(position);
 
+		_is_eof = false;
+		indexCount = 0;
+
 		if(reader.read_u32()!=('D'<<16|'I'<<8|'R')){
-			return File(reader.buffer, reader.buffer.size);
+			_is_eof = true;
+			return;
 		}
 
-		while(true){
-			auto entryLength = reader.read_u8();
-			if(!entryLength) break;
+		const auto entriesPosition = reader.get_position();
 
-			auto entryName = &reader.buffer.data[reader.get_position()];
+		// an index is given by a first entry with the single character name "\0" (which can't otherwise be looked up)
+		if(reader.read_u8()!=1||reader.read_u8()!=0){
+			reader.set_position(entriesPosition);
+			return;
+		}
 
-			reader.skip(entryLength);
+		const auto target = reader.read_u64();
+		const auto afterIndexEntry = reader.get_position();
 
-			const auto target = reader.read_u64();
+		reader.set_position(target);
+		if(reader.read_u32()==('I'<<16|'D'<<8|'X')){
+			indexCount = reader.read_u32();
+			indexPosition = reader.get_position();
 
-			if(entryLength==nameLength&&!memcmp(name, entryName, nameLength)){
-				return File(reader.buffer, target);
+			if(indexPosition+(U64)indexCount*4>reader.buffer.size){
+				indexCount = 0;
 			}
 		}
 
-		return File(reader.buffer, reader.buffer.size);
+		reader.set_position(afterIndexEntry);
 	}
 
-	Directory Directory::get_directory(const C8 *name) {
+	U64 Directory::find_target(const C8 *name) {
 		const auto nameLength = strlen(name);
 
 		BufferReader reader(this->reader.buffer);
+
+		if(indexCount>0){
+			// binary search through the offsets of the entries, sorted by name
+			U32 low = 0;
+			U32 high = indexCount;
+
+			while(low<high){
+				const auto middle = low+(high-low)/2;
+
+				reader.set_position(indexPosition+(U64)middle*4);
+				reader.set_position(position+reader.read_u32());
+
+				const auto entryLength = reader.read_u8();
+				if(reader.get_position()+entryLength+8>reader.buffer.size) break;
+
+				const auto entryName = (const C8*)&reader.buffer.data[reader.get_position()];
+				reader.skip(entryLength);
+
+				const auto result = compare_name(name, nameLength, entryName, entryLength);
+
+				if(result==0) return reader.read_u64();
+
+				if(result<0){
+					high = middle;
+				}else{
+					low = middle+1;
+				}
+			}
+
+			return reader.buffer.size;
+		}
+
 		reader.set_position(position);
 
 		if(reader.read_u32()!=('D'<<16|'I'<<8|'R')){
-			return Directory(reader.buffer, reader.buffer.size);
+			return reader.buffer.size;
 		}
 
 		while(true){
@@ -52,10 +102,18 @@ namespace fileStash {
 			const auto target = reader.read_u64();
 
 			if(entryLength==nameLength&&!memcmp(name, entryName, nameLength)){
-				return Directory(reader.buffer, target);
+				return target;
 			}
 		}
 
-		return Directory(reader.buffer, reader.buffer.size);
+		return reader.buffer.size;
+	}
+
+	File Directory::get_file(const C8 *name) {
+		return File(reader.buffer, find_target(name));
+	}
+
+	Directory Directory::get_directory(const C8 *name) {
+		return Directory(reader.buffer, find_target(name));
 	}
 }
@@ -28,6 +28,12 @@ namespace fileStash {
 		U64 position;
 		bool _is_eof = true;
 
+		// optional index of the entries' offsets (relative to position), sorted by name
+		U64 indexPosition = 0;
+		U32 indexCount = 0;
+
+		U64 find_target(const C8 *name); // returns the buffer size if not found
+
 		Directory(Buffer &buffer, U64 position):
 			reader(buffer),
 			position(position)
@@ -39,16 +45,7 @@ namespace fileStash {
 
 		bool is_eof() { return _is_eof; }
 
-		void reset() {
-			reader.set_position(position);
-
-			_is_eof = false;
-
-			if(reader.read_u32()!=('D'<<16|'I'<<8|'R')){
-				_is_eof = true;
-				return;
-			}
-		}
+		void reset();
 
 		DirectoryEntry read() {
 			DirectoryEntry entry;
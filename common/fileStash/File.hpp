@@ -9,24 +9,38 @@ namespace fileStash {
 		friend Directory;
 
 		U64 position;
-		U64 _size;
+		U64 _size = 0;
+		const U8 *data = nullptr;
 		bool _is_eof = true;
 
 		File(Buffer &buffer, U64 position):
 			position(position)
 		{
+			// (the tag and size, at least)
+			if(position>buffer.size||buffer.size-position<12) return;
+
 			BufferReader reader(buffer);
+			reader.set_position(position);
+
+			if(reader.read_u32()!=('F'<<24|'I'<<16|'L'<<8|'E')) return;
+
+			_size = reader.read_u64();
 
-			if(reader.read_u32()!=('F'<<24|'I'<<16|'L'<<8|'E')){
+			// (an entry running off the end of the stash is treated as missing)
+			if(_size>buffer.size-reader.get_position()){
 				_size = 0;
 				return;
 			}
 
-			_size = reader.read_u64();
+			data = &buffer.data[reader.get_position()];
 		}
 
 		public:
 
-		bool size() { return _size; }
+		bool exists() const { return data; }
+		U64 size() const { return _size; }
+
+		// the contents, in place within the stash (so not to be used beyond the stash's lifetime)
+		ConstBuffer view() const { return ConstBuffer{data, _size}; }
 	};
 }
@@ -1,6 +1,7 @@
 #include "Buffer.hpp"
 
 #include "Font.hpp"
+#include "GlyphCache.hpp"
 
 #include <common/maths/Fixed.hpp>
 
@@ -40,7 +41,7 @@ namespace graphics2d {
 						continue;
 					}
 	
-					const auto xAdvancement = character->advance*(I32)fontSettings.font.size*scale + fontSettings.charSpacing;
+					const auto xAdvancement = (character->advance+fontSettings.font.get_kerning(*character, c[1]))*(I32)fontSettings.font.size*scale + fontSettings.charSpacing;
 
 					if(c!=text && x+xAdvancement>=right){
 						//TODO: proper wordwrapping
@@ -55,30 +56,8 @@ namespace graphics2d {
 					if(character->atlasWidth&&character->atlasHeight){
 						auto x1 = x+character->offsetX*(I32)fontSettings.size;
 						auto y1 = y-character->offsetY*(I32)fontSettings.size;
-	
-						auto x2 = x1 + scale*(I32)character->atlasWidth;
-						auto y2 = y1 + scale*(I32)character->atlasHeight;
-	
-						auto displayX1 = x1.round_down();
-						auto displayY1 = y1.round_down();
-						auto displayX2 = x2.round_up();
-						auto displayY2 = y2.round_up();
-	
-						auto skipLeft = 0;
-						auto skipTop = 0;
-						auto skipRight = 0;
-						auto skipBottom = 0;
-	
-						if(scale<=FixedI32::divide(1, 2)){
-							skipLeft   = ((x1-displayX1) / scale).round();
-							skipTop    = ((y1-displayY1) / scale).round();
-							skipRight  = ((displayX2-x2) / scale).round();
-							skipBottom = ((displayY2-y2) / scale).round();
-						}
-	
-						draw_msdf(displayX1, displayY1, displayX2-displayX1, displayY2-displayY1, fontSettings.font.atlas, (I32)character->atlasX-skipLeft, (I32)character->atlasY-skipTop, character->atlasWidth+skipLeft+skipRight, character->atlasHeight+skipTop+skipBottom, colour, skipLeft, skipTop, skipRight, skipBottom);
-	
-						updatedArea = updatedArea.include({displayX1, displayY1, displayX2, displayY2});
+
+						updatedArea = updatedArea.include(glyphCache.draw(*this, fontSettings.font, fontSettings.size, *character, x1, y1, colour));
 					}
 
 					x += xAdvancement;
@@ -140,7 +119,7 @@ namespace graphics2d {
 						continue;
 					}
 
-					const auto xAdvancement = character->advance*(I32)fontSettings.font.size*scale + fontSettings.charSpacing;
+					const auto xAdvancement = (character->advance+fontSettings.font.get_kerning(*character, c[1]))*(I32)fontSettings.font.size*scale + fontSettings.charSpacing;
 
 					if(c!=text && x+xAdvancement>=right){
 						//TODO: proper wordwrapping
@@ -55,6 +55,12 @@ namespace graphics2d {
 		void set_rgba8(U32 x, U32 y, U32 colour, U32 length = 1);
 		void set_bgra8(U32 x, U32 y, U32 colour, U32 length = 1);
 
+		// blend `count` pixels of `source` (in the same format and order as the destination) over `dest`
+		template <BufferFormat format, BufferFormatOrder order>
+		static void blend_span(U8 *dest, const U8 *source, U32 count, U8 opacity=255);
+		void blend_span(U32 x, U32 y, const U8 *source, U32 count, U8 opacity=255);
+		void blend_span(U32 x, U32 y, U32 colour, U32 count, U8 opacity=255);
+
 		auto get(I32 x, I32 y) -> U32;
 		auto get(U32 x, U32 y) -> U32;
 		auto get_grey8(U32 x, U32 y) -> U32;
@@ -77,6 +83,9 @@ namespace graphics2d {
 		void draw_line_blended(U32 x, U32 y, U32 x2, U32 y2, U32 colour);
 		void draw_line_aa(U32 x, U32 y, U32 x2, U32 y2, U32 colour);
 		void draw_msdf(I32 x, I32 y, U32 width, U32 height, Buffer &source, I32 source_x, I32 source_y, U32 source_width, U32 source_height, U32 colour, U32 skipSourceLeft=0, U32 skipSourceTop=0, U32 skipSourceRight=0, U32 skipSourceBottom=0);
+		// calls `callback(x, y, alpha)` for each covered pixel of the msdf within the from/to range (relative to the top left)
+		template <typename Callback>
+		static void rasterise_msdf(I32 fromX, I32 fromY, I32 toX, I32 toY, U32 width, U32 height, Buffer &source, I32 source_x, I32 source_y, U32 source_width, U32 source_height, U32 skipSourceLeft, U32 skipSourceTop, U32 skipSourceRight, U32 skipSourceBottom, Callback callback);
 
 		struct FontSettings {
 			Font &font;
@@ -101,6 +110,8 @@ namespace graphics2d {
 		void draw_4slice(I32 x, I32 y, U32 width, U32 height, Buffer &image);
 
 		void scroll(I32 x, I32 y);
+		// copy an area of this buffer to another position within it (clipped to the buffer). The two may overlap
+		void copy_rect(Rect source, I32 x, I32 y);
 
 		auto cropped(U32 left, U32 top, U32 right, U32 bottom) -> Buffer;
 		auto region(U32 x, U32 y, U32 width, U32 height) -> Buffer;
@@ -3,6 +3,7 @@
 #include "Buffer.hpp"
 
 #include <common/graphics2d.hpp>
+#include <common/graphics2d/blendSpan.hpp>
 #include <common/maths.hpp>
 
 namespace graphics2d {
@@ -80,6 +81,66 @@ namespace graphics2d {
 		}
 	}
 
+	template <BufferFormat format, BufferFormatOrder order>
+	inline void Buffer::blend_span(U8 *dest, const U8 *source, U32 count, U8 opacity) {
+		if constexpr(format==BufferFormat::rgba8){
+			blendSpan::blend<order==BufferFormatOrder::argb?0:3>(dest, source, count, opacity);
+
+		}else{
+			// no transparency is stored in these formats, so the source is always opaque
+			memcpy(dest, source, count*bufferFormat::size[(U8)format]);
+		}
+	}
+
+	inline void Buffer::blend_span(U32 x, U32 y, const U8 *source, U32 count, U8 opacity) {
+		if((U32)x>=width||(U32)y>=height) return;
+
+		count = maths::min(count, width-x);
+		auto dest = &address[y*stride+x*bufferFormat::size[(U8)format]];
+
+		switch((int)format<<1|(int)order){
+			case (int)BufferFormat::grey8 <<1|(int)BufferFormatOrder::argb: return blend_span<BufferFormat::grey8 , BufferFormatOrder::argb>(dest, source, count, opacity);
+			case (int)BufferFormat::grey8 <<1|(int)BufferFormatOrder::bgra: return blend_span<BufferFormat::grey8 , BufferFormatOrder::bgra>(dest, source, count, opacity);
+			case (int)BufferFormat::rgb565<<1|(int)BufferFormatOrder::argb: return blend_span<BufferFormat::rgb565, BufferFormatOrder::argb>(dest, source, count, opacity);
+			case (int)BufferFormat::rgb565<<1|(int)BufferFormatOrder::bgra: return blend_span<BufferFormat::rgb565, BufferFormatOrder::bgra>(dest, source, count, opacity);
+			case (int)BufferFormat::rgb8  <<1|(int)BufferFormatOrder::argb: return blend_span<BufferFormat::rgb8  , BufferFormatOrder::argb>(dest, source, count, opacity);
+			case (int)BufferFormat::rgb8  <<1|(int)BufferFormatOrder::bgra: return blend_span<BufferFormat::rgb8  , BufferFormatOrder::bgra>(dest, source, count, opacity);
+			case (int)BufferFormat::rgba8 <<1|(int)BufferFormatOrder::argb: return blend_span<BufferFormat::rgba8 , BufferFormatOrder::argb>(dest, source, count, opacity);
+			case (int)BufferFormat::rgba8 <<1|(int)BufferFormatOrder::bgra: return blend_span<BufferFormat::rgba8 , BufferFormatOrder::bgra>(dest, source, count, opacity);
+		}
+	}
+
+	inline void Buffer::blend_span(U32 x, U32 y, U32 colour, U32 count, U8 opacity) {
+		if((U32)x>=width||(U32)y>=height) return;
+
+		count = maths::min(count, width-x);
+
+		if(format!=BufferFormat::rgba8){
+			if(colour>>24<128){
+				set(x, y, colour, count);
+			}
+			return;
+		}
+
+		// lay the colour out as pixels (matching set_blended()), and blend from a run of them at a time
+		const U8 pixel[4] = {
+			(U8)(order==BufferFormatOrder::argb?colour>>24:colour>> 0),
+			(U8)(order==BufferFormatOrder::argb?colour>>16:colour>> 8),
+			(U8)(order==BufferFormatOrder::argb?colour>> 8:colour>>16),
+			(U8)(order==BufferFormatOrder::argb?colour>> 0:colour>>24)
+		};
+
+		const U32 runLength = 64;
+		U8 run[runLength*4];
+		for(auto i=0u;i<maths::min(count, runLength);i++){
+			memcpy(&run[i*4], pixel, 4);
+		}
+
+		for(auto offset=0u;offset<count;offset+=runLength){
+			blend_span(x+offset, y, run, maths::min(count-offset, runLength), opacity);
+		}
+	}
+
 	inline void Buffer::set_grey8(U32 x, U32 y, U32 colour, U32 length) {
 		if((U32)x>=width||(U32)y>=height) return;
 
@@ -396,9 +457,7 @@ namespace graphics2d {
 			right = min<I32>(startX+right, (I32)this->width)-(I32)startX;
 
 			if(left<right){
-				for(auto x=(U32)left;x<(U32)right;x++){
-					set_blended(startX+x, startY+y, colour);
-				}
+				blend_span(startX+left, startY+y, colour, right-left);
 			}
 		}
 	}
@@ -710,6 +769,17 @@ namespace graphics2d {
 	}
 
 	inline void Buffer::draw_msdf(I32 startX, I32 startY, U32 width, U32 height, Buffer &source, I32 source_x, I32 source_y, U32 source_width, U32 source_height, U32 colour, U32 skipSourceLeft, U32 skipSourceTop, U32 skipSourceRight, U32 skipSourceBottom) {
+		rasterise_msdf(
+			max((I32)0, -startX), max((I32)0, -startY), min((I32)width, (I32)this->width-startX), min((I32)height, (I32)this->height-startY),
+			width, height, source, source_x, source_y, source_width, source_height, skipSourceLeft, skipSourceTop, skipSourceRight, skipSourceBottom,
+			[&](I32 x, I32 y, U8 alpha) {
+				set_blended(startX+x, startY+y, premultiply_colour((colour&0xffffff)|((255-alpha)*(255-(colour>>24))/255)<<24));
+			}
+		);
+	}
+
+	template <typename Callback>
+	inline void Buffer::rasterise_msdf(I32 fromX, I32 fromY, I32 toX, I32 toY, U32 width, U32 height, Buffer &source, I32 source_x, I32 source_y, U32 source_width, U32 source_height, U32 skipSourceLeft, U32 skipSourceTop, U32 skipSourceRight, U32 skipSourceBottom, Callback callback) {
 		if(width<1||height<1) return;
 
 		//minify by sampling multiple times (looks best when <= halfsize)
@@ -726,7 +796,7 @@ namespace graphics2d {
 			// const auto samplesX = (source_width+source_width*1/6)/width;
 			// const auto samplesY = (source_height+source_height*1/6)/height;
 
-			for(I32 y=0; y<(I32)height&&startY+y<(I32)this->height; y++) for(I32 x=0; x<(I32)width&&startX+x<(I32)this->width; x++) {
+			for(I32 y=fromY; y<toY; y++) for(I32 x=fromX; x<toX; x++) {
 				I32 sX = source_x+x*source_width/width;
 				I32 sY = source_y+y*source_height/height;
 
@@ -762,7 +832,7 @@ namespace graphics2d {
 
 				if(alpha<1) continue;
 
-				set_blended(startX+x, startY+y, premultiply_colour((colour&0xffffff)|((255-alpha)*(255-(colour>>24))/255)<<24));
+				callback(x, y, alpha);
 			}
 
 		//bilinear filter the msdf (looks best at half size and up, although blurs some letters slightly)
@@ -775,7 +845,7 @@ namespace graphics2d {
 			source_x *= 256;
 			source_y *= 256;
 
-			for(I32 y=max((I32)0,-startY); y<(I32)height&&startY+y<(I32)this->height; y++) for(I32 x=max((I32)0,-startX); x<(I32)width&&startX+x<(I32)this->width; x++) {
+			for(I32 y=fromY; y<toY; y++) for(I32 x=fromX; x<toX; x++) {
 				I32 sX = source_x+(x*256)*source_width/width;
 				I32 sY = source_y+(y*256)*source_height/height;
 
@@ -801,7 +871,7 @@ namespace graphics2d {
 
 				if(alpha<1) continue;
 
-				set_blended(startX+x, startY+y, premultiply_colour((colour&0xffffff)|((255-alpha)*(255-(colour>>24))/255)<<24));
+				callback(x, y, alpha);
 			}
 		}
 	}
@@ -902,9 +972,25 @@ namespace graphics2d {
 	inline void Buffer::draw_buffer_blended(I32 destX, I32 destY, U32 sourceX, U32 sourceY, U32 width, U32 height, Buffer &image, U8 opacity) {
 		if(destX>=(I32)this->width||destY>=(I32)this->height||destX+width<=0||destY+height<=0) return;
 
-		for(U32 y=maths::max((I32)0, -destX); y<maths::min(maths::min(height, image.height-sourceX), height-destX); y++){
-			for(U32 x=maths::max((I32)0, -destX); x<maths::min(maths::min(width, image.width-sourceX), width-destX); x++){
-				set_blended(destX+x, destY+y, image.get(sourceX+x, sourceY+y), opacity);
+		const U32 startX = maths::max((I32)0, -destX);
+		const U32 startY = maths::max((I32)0, -destY);
+		const U32 endX = maths::min(maths::min(width, image.width-sourceX), (U32)((I32)this->width-destX));
+		const U32 endY = maths::min(maths::min(height, image.height-sourceY), (U32)((I32)this->height-destY));
+		if(startX>=endX) return;
+
+		// whole rows can be blended at once when the formats match, otherwise we need to convert each pixel
+		if(image.format==format&&image.order==order){
+			const auto bpp = bufferFormat::size[(U8)format];
+
+			for(U32 y=startY; y<endY; y++){
+				blend_span(destX+startX, destY+y, &image.address[(sourceY+y)*image.stride+(sourceX+startX)*bpp], endX-startX, opacity);
+			}
+
+		}else{
+			for(U32 y=startY; y<endY; y++){
+				for(U32 x=startX; x<endX; x++){
+					set_blended(destX+x, destY+y, image.get(sourceX+x, sourceY+y), opacity);
+				}
 			}
 		}
 	}
@@ -990,6 +1076,47 @@ namespace graphics2d {
 		}
 	}
 
+	inline void Buffer::copy_rect(Rect source, I32 x, I32 y) {
+		const auto offsetX = x-source.x1;
+		const auto offsetY = y-source.y1;
+		if(!offsetX&&!offsetY) return;
+
+		// clip so that both the source and destination lie within the buffer
+		const Rect bounds = {0, 0, (I32)width, (I32)height};
+		source = source.intersect(bounds).intersect(bounds.offset(-offsetX, -offsetY));
+		if(source.width()<1||source.height()<1) return;
+
+		const auto bpp = bufferFormat::size[(U8)format];
+		const auto rowSize = (U32)source.width()*bpp;
+
+		auto copy_row = [&](I32 row) {
+			auto dest = &address[(row+offsetY)*stride+(source.x1+offsetX)*bpp];
+			auto from = &address[row*stride+source.x1*bpp];
+
+			if(offsetY){
+				memcpy(dest, from, rowSize);
+
+			}else{
+				#ifdef HAS_UNALIGNED_ACCESS
+					memmove(dest, from, rowSize);
+				#else
+					if(offsetX>0){
+						memcpy_backwards_aligned(dest, from, rowSize);
+					}else{
+						memcpy_forwards_aligned(dest, from, rowSize);
+					}
+				#endif
+			}
+		};
+
+		// walk rows away from the destination, so overlapping rows are read before they're overwritten
+		if(offsetY>0){
+			for(auto row=source.y2-1;row>=source.y1;row--) copy_row(row);
+		}else{
+			for(auto row=source.y1;row<source.y2;row++) copy_row(row);
+		}
+	}
+
 	inline U32 blend_rgb(U32 a, U32 b, float phase) {
 		return
 			 (U32)(((a&0xff0000)>>16)*(1-phase) + ((b&0xff0000)>>16)*(0+phase))<<16
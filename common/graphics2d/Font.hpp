@@ -17,6 +17,15 @@ namespace graphics2d {
 		U32 atlasY;
 		U32 atlasWidth;
 		U32 atlasHeight;
+
+		// the kerning pairs starting with this character, within `Font::kernings`
+		U16 kerningIndex = 0;
+		U16 kerningCount = 0;
+	};
+
+	struct FontKerning {
+		U32 nextCode;
+		maths::Fixed<I16,256> advance; // added to the advance of the first character, when followed by `nextCode`
 	};
 
 	struct Font {
@@ -33,15 +42,53 @@ namespace graphics2d {
 		U32 characterCount;
 		FontCharacter *characters; //must be stored in ascending code order
 
+		static inline const U32 directIndexSize = 256;
+		U16 *directIndex = nullptr; // index+1 into `characters` for each code below `directIndexSize` (0 if missing)
+		FontKerning *kernings = nullptr; // sorted by `nextCode` within each character's range
+
 		FontCharacter* get_character(U32 code){
-			//TODO:optimise: don't loop through EVERY character. Use a fixed size array or estimated starting position and intelligent search dir
-			for(U32 i=0;i<characterCount;i++){
-				auto &character = characters[i];
-				if(character.code>code) break;
+			if(code<directIndexSize&&directIndex){
+				const auto index = directIndex[code];
+				return index?&characters[index-1]:nullptr;
+			}
+
+			U32 start = 0;
+			U32 end = characterCount;
+			while(start<end){
+				const auto middle = (start+end)/2;
+				auto &character = characters[middle];
+
 				if(character.code==code) return &character;
+
+				if(character.code<code){
+					start = middle+1;
+				}else{
+					end = middle;
+				}
 			}
 
 			return nullptr;
 		}
+
+		auto get_kerning(FontCharacter &character, U32 nextCode) -> maths::Fixed<I16,256> {
+			if(!kernings) return maths::Fixed<I16,256>::fraction(0);
+
+			U32 start = character.kerningIndex;
+			U32 end = character.kerningIndex+character.kerningCount;
+			while(start<end){
+				const auto middle = (start+end)/2;
+				auto &kerning = kernings[middle];
+
+				if(kerning.nextCode==nextCode) return kerning.advance;
+
+				if(kerning.nextCode<nextCode){
+					start = middle+1;
+				}else{
+					end = middle;
+				}
+			}
+
+			return maths::Fixed<I16,256>::fraction(0);
+		}
 	};
 }
\ No newline at end of file
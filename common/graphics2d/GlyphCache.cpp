@@ -0,0 +1,232 @@
+#include "GlyphCache.hpp"
+
+#include <common/graphics2d.hpp>
+
+namespace graphics2d {
+	GlyphCache glyphCache;
+
+	auto GlyphCache::draw(Buffer &buffer, Font &font, U32 size, FontCharacter &character, FixedI32 x1, FixedI32 y1, U32 colour) -> Rect {
+		// snap to the nearest subpixel step below, so nearby positions can share the same mask
+		const U8 subpixelX = (x1.value&255)*subpixelSteps/256;
+		const U8 subpixelY = (y1.value&255)*subpixelSteps/256;
+		x1 = FixedI32::fraction((x1.value&~255)+subpixelX*256/subpixelSteps);
+		y1 = FixedI32::fraction((y1.value&~255)+subpixelY*256/subpixelSteps);
+
+		const auto scale = FixedI32::divide(size, font.size);
+
+		const auto x2 = x1 + scale*(I32)character.atlasWidth;
+		const auto y2 = y1 + scale*(I32)character.atlasHeight;
+
+		const auto displayX1 = x1.round_down();
+		const auto displayY1 = y1.round_down();
+		const auto displayX2 = x2.round_up();
+		const auto displayY2 = y2.round_up();
+
+		const Rect area = {displayX1, displayY1, displayX2, displayY2};
+		const U32 width = displayX2-displayX1;
+		const U32 height = displayY2-displayY1;
+
+		auto skipLeft = 0;
+		auto skipTop = 0;
+		auto skipRight = 0;
+		auto skipBottom = 0;
+
+		if(scale<=FixedI32::divide(1, 2)){
+			skipLeft   = ((x1-displayX1) / scale).round();
+			skipTop    = ((y1-displayY1) / scale).round();
+			skipRight  = ((displayX2-x2) / scale).round();
+			skipBottom = ((displayY2-y2) / scale).round();
+		}
+
+		const auto sourceX = (I32)character.atlasX-skipLeft;
+		const auto sourceY = (I32)character.atlasY-skipTop;
+		const auto sourceWidth = character.atlasWidth+skipLeft+skipRight;
+		const auto sourceHeight = character.atlasHeight+skipTop+skipBottom;
+
+		if(width<1||height<1) return area;
+
+		if(width>maxGlyphSize||height>maxGlyphSize){
+			buffer.draw_msdf(displayX1, displayY1, width, height, font.atlas, sourceX, sourceY, sourceWidth, sourceHeight, colour, skipLeft, skipTop, skipRight, skipBottom);
+			return area;
+		}
+
+		Lock_Guard guard(lock);
+
+		if(!isInitialised&&!_init()){
+			buffer.draw_msdf(displayX1, displayY1, width, height, font.atlas, sourceX, sourceY, sourceWidth, sourceHeight, colour, skipLeft, skipTop, skipRight, skipBottom);
+			return area;
+		}
+
+		const Key key = {&font, size, character.code, subpixelX, subpixelY};
+
+		auto entry = _find(key);
+		if(entry){
+			hits++;
+
+			usedEntries.pop(*entry);
+			usedEntries.push_front(*entry);
+
+		}else{
+			misses++;
+
+			entry = _add(key, width, height);
+			if(!entry){
+				buffer.draw_msdf(displayX1, displayY1, width, height, font.atlas, sourceX, sourceY, sourceWidth, sourceHeight, colour, skipLeft, skipTop, skipRight, skipBottom);
+				return area;
+			}
+
+			for(auto y=0u;y<height;y++){
+				memset(&atlas[(entry->y+y)*atlasWidth+entry->x], 0, width);
+			}
+
+			Buffer::rasterise_msdf(
+				0, 0, width, height,
+				width, height, font.atlas, sourceX, sourceY, sourceWidth, sourceHeight, skipLeft, skipTop, skipRight, skipBottom,
+				[&](I32 x, I32 y, U8 alpha) {
+					atlas[(entry->y+y)*atlasWidth+entry->x+x] = alpha;
+				}
+			);
+		}
+
+		// blit the mask, clipped to the buffer
+		const auto fromX = max((I32)0, -displayX1);
+		const auto fromY = max((I32)0, -displayY1);
+		const auto toX = min((I32)width, (I32)buffer.width-displayX1);
+		const auto toY = min((I32)height, (I32)buffer.height-displayY1);
+
+		for(auto y=fromY;y<toY;y++){
+			const auto row = &atlas[(entry->y+y)*atlasWidth+entry->x];
+
+			for(auto x=fromX;x<toX;x++){
+				const auto alpha = row[x];
+				if(alpha<1) continue;
+
+				buffer.set_blended(displayX1+x, displayY1+y, premultiply_colour((colour&0xffffff)|((255-alpha)*(255-(colour>>24))/255)<<24));
+			}
+		}
+
+		return area;
+	}
+
+	auto GlyphCache::_init() -> bool {
+		atlas = new U8[atlasWidth*atlasHeight];
+		if(!atlas) return false;
+
+		for(auto &entry:entries){
+			freeEntries.push_back(entry);
+		}
+
+		isInitialised = true;
+		return true;
+	}
+
+	auto GlyphCache::_find(const Key &key) -> Entry* {
+		for(auto entry=buckets[_get_bucket(key)];entry;entry=entry->nextInBucket){
+			if(entry->key==key) return entry;
+		}
+
+		return nullptr;
+	}
+
+	auto GlyphCache::_add(const Key &key, U32 width, U32 height) -> Entry* {
+		while(!freeEntries.head){
+			_evict(*usedEntries.tail);
+		}
+
+		auto &entry = *freeEntries.pop_front();
+
+		// make room by evicting the least recently used, until there's enough
+		// once everything is evicted all shelves are freed, so anything within maxGlyphSize will then fit
+		while(!_allocate(entry, width, height)){
+			if(!usedEntries.tail){
+				freeEntries.push_front(entry);
+				return nullptr;
+			}
+
+			_evict(*usedEntries.tail);
+		}
+
+		entry.key = key;
+
+		auto &bucket = buckets[_get_bucket(key)];
+		entry.nextInBucket = bucket;
+		bucket = &entry;
+
+		usedEntries.push_front(entry);
+
+		return &entry;
+	}
+
+	auto GlyphCache::_allocate(Entry &entry, U32 width, U32 height) -> bool {
+		const U16 shelfHeight = (height+3)&~3;
+
+		auto place = [&](U32 index) {
+			auto &shelf = shelves[index];
+
+			entry.shelf = index;
+			entry.x = shelf.cursor;
+			entry.y = shelf.y;
+			entry.width = width;
+			entry.height = height;
+
+			shelf.cursor += width;
+			shelf.entryCount++;
+		};
+
+		for(auto i=0u;i<shelfCount;i++){
+			auto &shelf = shelves[i];
+
+			// empty shelves can take anything that fits, otherwise stick to a similar height so that short glyphs don't waste tall shelves
+			if(shelf.entryCount?shelf.height!=shelfHeight:shelf.height<height) continue;
+			if(shelf.cursor+width>atlasWidth) continue;
+
+			place(i);
+			return true;
+		}
+
+		if(shelfCount<maxShelves){
+			const U16 y = shelfCount?shelves[shelfCount-1].y+shelves[shelfCount-1].height:0;
+
+			if(y+shelfHeight<=atlasHeight){
+				shelves[shelfCount++] = {y, shelfHeight, 0, 0};
+				place(shelfCount-1);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void GlyphCache::_evict(Entry &entry) {
+		for(auto link=&buckets[_get_bucket(entry.key)];*link;link=&(*link)->nextInBucket){
+			if(*link==&entry){
+				*link = entry.nextInBucket;
+				break;
+			}
+		}
+
+		usedEntries.pop(entry);
+		freeEntries.push_front(entry);
+
+		auto &shelf = shelves[entry.shelf];
+		shelf.entryCount--;
+
+		if(!shelf.entryCount){
+			shelf.cursor = 0;
+
+		}else if(entry.x+entry.width==shelf.cursor){
+			shelf.cursor = entry.x;
+		}
+
+		// release empty shelves from the bottom, so their space can be reused by any height
+		while(shelfCount&&!shelves[shelfCount-1].entryCount){
+			shelfCount--;
+		}
+
+		evictions++;
+	}
+
+	auto GlyphCache::_get_bucket(const Key &key) -> U32 {
+		return ((UPtr)key.font/16*31 + key.size*131 + key.code*7 + key.subpixelX*3 + key.subpixelY*5)%bucketCount;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include "Font.hpp"
+
+#include <common/LList.hpp>
+#include <common/maths/Fixed.hpp>
+
+#include <kernel/Lock.hpp>
+
+namespace graphics2d {
+	// pre-rasterised msdf glyphs, as alpha masks packed into a shared atlas
+	// glyphs are keyed on their font, size and subpixel offset (snapped to a quarter pixel), so that redrawing the same text is just a mask blit
+	// the atlas is packed in shelves of similar height, with the least recently used glyphs evicted once it's full
+	struct GlyphCache {
+		static inline const U32 atlasWidth = 512;
+		static inline const U32 atlasHeight = 512;
+		static inline const U32 maxEntries = 512;
+		static inline const U32 maxShelves = 64;
+		static inline const U32 bucketCount = 256;
+		static inline const U32 subpixelSteps = 4;
+		static inline const U32 maxGlyphSize = 64; // anything larger is drawn directly, rather than crowding out the atlas
+
+		struct Key {
+			Font *font;
+			U32 size;
+			U32 code;
+			U8 subpixelX, subpixelY;
+
+			bool operator==(const Key &other) const { return font==other.font&&size==other.size&&code==other.code&&subpixelX==other.subpixelX&&subpixelY==other.subpixelY; }
+		};
+
+		struct Entry: LListItem<Entry> {
+			Key key = {};
+			Entry *nextInBucket = nullptr;
+			U16 shelf = 0;
+			U16 x = 0, y = 0; // position within the atlas
+			U16 width = 0, height = 0;
+		};
+
+		struct Shelf {
+			U16 y;
+			U16 height;
+			U16 cursor; // the next free x
+			U16 entryCount;
+		};
+
+		// draw a glyph with its top left (before rounding) at x1, y1, returning the area drawn to
+		auto draw(Buffer &buffer, Font &font, U32 size, FontCharacter &character, FixedI32 x1, FixedI32 y1, U32 colour) -> Rect;
+
+		U64 hits = 0;
+		U64 misses = 0;
+		U64 evictions = 0;
+
+	protected:
+		Lock<LockType::flat> lock{"GlyphCache"};
+
+		U8 *atlas = nullptr;
+		bool isInitialised = false;
+
+		Entry entries[maxEntries];
+		LList<Entry> freeEntries;
+		LList<Entry> usedEntries; // most recently used first
+		Entry *buckets[bucketCount] = {};
+
+		Shelf shelves[maxShelves] = {};
+		U32 shelfCount = 0;
+
+		auto _init() -> bool;
+		auto _find(const Key &key) -> Entry*;
+		auto _add(const Key &key, U32 width, U32 height) -> Entry*;
+		auto _allocate(Entry &entry, U32 width, U32 height) -> bool;
+		void _evict(Entry &entry);
+		static auto _get_bucket(const Key &key) -> U32;
+	};
+
+	extern GlyphCache glyphCache;
+}
@@ -0,0 +1,199 @@
+#include "TextLayout.hpp"
+
+#include "GlyphCache.hpp"
+
+#include <common/maths/Fixed.hpp>
+
+namespace graphics2d {
+	void TextLayout::set_text(const char *set) {
+		if(text==set) return;
+
+		text = set;
+		isDirty = true;
+	}
+
+	void TextLayout::set_width(U32 set) {
+		if(width==set) return;
+
+		// if nothing was wrapped, and everything still fits, the layout won't change
+		if(isWrapped||FixedI32::whole((I32)min(set, ((1u<<31)-1)/256)).value<=maxRight){
+			isDirty = true;
+		}
+
+		width = set;
+	}
+
+	void TextLayout::set_cursor(I32 set) {
+		if(cursorX==set) return;
+
+		cursorX = set;
+		isDirty = true;
+	}
+
+	void TextLayout::set_font_settings(Buffer::FontSettings set) {
+		if(font==&set.font&&size==set.size&&lineSpacing==set.lineSpacing&&charSpacing==set.charSpacing&&maxLines==set.maxLines) return;
+
+		font = &set.font;
+		size = set.size;
+		lineSpacing = set.lineSpacing;
+		charSpacing = set.charSpacing;
+		maxLines = set.maxLines;
+		isDirty = true;
+	}
+
+	auto TextLayout::measure() -> DrawTextResult {
+		if(isDirty) _layout();
+
+		return result;
+	}
+
+	auto TextLayout::draw(Buffer &buffer, I32 x, I32 y, U32 colour) -> DrawTextResult {
+		if(isDirty) _layout();
+
+		Rect updatedArea = {x+cursorX, y, x+cursorX, y};
+
+		for(auto &glyph:glyphs){
+			updatedArea = updatedArea.include(glyphCache.draw(buffer, *font, size, *glyph.character, FixedI32::fraction(glyph.x+x*256), FixedI32::fraction(glyph.y+y*256), colour));
+		}
+
+		return {
+			x+result.x, y+result.y,
+			result.capHeight,
+			result.lineHeight,
+			result.rect.offset(x, y),
+			updatedArea,
+			result.lines,
+			result.clipped
+		};
+	}
+
+	void TextLayout::_layout() {
+		isDirty = false;
+		isWrapped = false;
+		maxRight = 0;
+		glyphs.clear();
+
+		if(!font){
+			result = {};
+			return;
+		}
+
+		auto x = FixedI32::whole(cursorX);
+		auto y = FixedI32::whole(0);
+
+		const auto right = FixedI32::whole((I32)min(width, ((1u<<31)-1)/256));
+		const auto scale = FixedI32::divide(size, font->size);
+
+		auto lines = 1u;
+		auto clipped = false;
+
+		const auto lineHeight = (I32)(font->lineHeight * size + 0.5);
+		const auto capHeight = (I32)(font->capHeight * size + 0.5);
+		const auto lineAdvance = lineHeight+lineSpacing;
+
+		auto blockWidth = cursorX;
+
+		// the last place the current line could be broken at (after a space), if any
+		auto canBreak = false;
+		auto breakX = x; // where the line would end
+		auto wordX = x; // where the word after it starts
+		auto wordGlyph = 0u;
+
+		for(const char *c=text;*c;c++){
+			if(*c=='\n'){
+				blockWidth = max(blockWidth, x.round());
+
+				if(++lines>maxLines){
+					clipped = true;
+					break;
+				}
+
+				x = FixedI32::whole(0);
+				y += lineAdvance;
+				canBreak = false;
+				continue;
+			}
+
+			auto character = font->get_character(*c);
+			if(!character) continue;
+
+			const auto xAdvancement = (character->advance+font->get_kerning(*character, c[1]))*(I32)font->size*scale + charSpacing;
+
+			if(c!=text && x+xAdvancement>=right){
+				isWrapped = true;
+
+				if(++lines>maxLines){
+					clipped = true;
+					break;
+				}
+
+				if(*c==' '){
+					// break on the space itself, dropping it
+					blockWidth = max(blockWidth, x.round());
+					x = FixedI32::whole(0);
+					y += lineAdvance;
+					canBreak = false;
+					continue;
+
+				}else if(canBreak){
+					// move the word so far down to the start of the next line
+					blockWidth = max(blockWidth, breakX.round());
+
+					for(auto i=wordGlyph;i<glyphs.length;i++){
+						glyphs[i].x -= wordX.value;
+						glyphs[i].y += lineAdvance*256;
+					}
+
+					x -= wordX;
+
+				}else{
+					// no space to break at, so break within the word
+					blockWidth = max(blockWidth, x.round());
+					x = FixedI32::whole(0);
+				}
+
+				y += lineAdvance;
+				canBreak = false;
+
+			}else{
+				maxRight = max(maxRight, (x+xAdvancement).value);
+			}
+
+			if(character->atlasWidth&&character->atlasHeight){
+				glyphs.push_back(character, (x+character->offsetX*(I32)size).value, (y-character->offsetY*(I32)size).value);
+			}
+
+			if(*c==' '){
+				canBreak = true;
+				breakX = x;
+				wordX = x+xAdvancement;
+				wordGlyph = glyphs.length;
+			}
+
+			x += xAdvancement;
+		}
+
+		blockWidth = max(blockWidth, x.round());
+
+		Rect updatedArea = {cursorX, 0, cursorX, 0};
+
+		for(auto &glyph:glyphs){
+			const auto x1 = FixedI32::fraction(glyph.x);
+			const auto y1 = FixedI32::fraction(glyph.y);
+			const auto x2 = x1 + scale*(I32)glyph.character->atlasWidth;
+			const auto y2 = y1 + scale*(I32)glyph.character->atlasHeight;
+
+			updatedArea = updatedArea.include({x1.round_down(), y1.round_down(), x2.round_up(), y2.round_up()});
+		}
+
+		result = {
+			x.round_up(), y.round_up(),
+			capHeight,
+			lineHeight,
+			{0, 0, blockWidth, y.round()+capHeight},
+			updatedArea,
+			lines,
+			clipped
+		};
+	}
+}
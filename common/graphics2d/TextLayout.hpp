@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include "Font.hpp"
+
+#include <common/PodArray.hpp>
+
+namespace graphics2d {
+	// text shaped once into positioned glyphs (wrapping lines at word boundaries), which can then be measured and drawn any number of times
+	// it's only shaped again once the text, width, cursor or font settings change
+	// the text isn't copied, so call invalidate() if it's changed in place
+	struct TextLayout {
+		struct Glyph {
+			FontCharacter *character;
+			I32 x, y; // top left, in 1/256ths of a pixel, relative to the start position
+		};
+
+		void set_text(const char *text);
+		void set_width(U32 width);
+		void set_cursor(I32 cursorX); // where the first line starts, relative to the start position
+		void set_font_settings(Buffer::FontSettings fontSettings);
+		void invalidate() { isDirty = true; }
+
+		// metrics relative to the start position (as with Buffer::measure_text())
+		auto measure() -> DrawTextResult;
+		// draw with the start position (and first baseline) at x, y (as with Buffer::draw_text())
+		auto draw(Buffer &buffer, I32 x, I32 y, U32 colour) -> DrawTextResult;
+
+	protected:
+		const char *text = "";
+		U32 width = ~0u;
+		I32 cursorX = 0;
+
+		Font *font = nullptr;
+		U32 size = 14;
+		I32 lineSpacing = 0;
+		I32 charSpacing = 0;
+		U32 maxLines = ~0u;
+
+		bool isDirty = true;
+		bool isWrapped = false; // was any line broken to fit the width?
+		I32 maxRight = 0; // the furthest any character reached when checked against the width, in 1/256ths. If nothing wrapped, any width beyond this lays out the same
+
+		PodArray<Glyph> glyphs;
+		DrawTextResult result = {};
+
+		void _layout();
+	};
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <common/types.hpp>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+	#include <arm_neon.h>
+#endif
+
+// blend kernels for runs of 32bit pixels, with the source over the destination (as in `Buffer::set_blended()`)
+// pixels hold 3 colour bytes (premultiplied in the source) and a transparency byte (0 being opaque) at `alphaByte`
+// each kernel gives the same result as the scalar one, so they can be swapped freely
+namespace graphics2d {
+	namespace blendSpan {
+		template <U32 alphaByte>
+		inline void blend_scalar(U8 *dest, const U8 *source, U32 count, U8 opacity) {
+			static_assert(alphaByte<4);
+
+			for(;count--;dest+=4,source+=4){
+				const U32 trans = 255-(255-source[alphaByte])*opacity/255;
+
+				for(auto i=0u;i<4;i++){
+					dest[i] = i==alphaByte
+						? dest[i]*trans/255
+						: source[i]*opacity/255 + dest[i]*trans/255
+					;
+				}
+			}
+		}
+
+		#if defined(__SSE2__)
+			template <U32 alphaByte>
+			inline void blend_sse2(U8 *dest, const U8 *source, U32 count, U8 opacity) {
+				static_assert(alphaByte<4);
+
+				constexpr int alphaShuffle = _MM_SHUFFLE(alphaByte, alphaByte, alphaByte, alphaByte);
+
+				const auto zero = _mm_setzero_si128();
+				const auto one = _mm_set1_epi16(1);
+				const auto full = _mm_set1_epi16(255);
+				const auto opacityWide = _mm_set1_epi16(opacity);
+				// set on the colour channels of both pixels, and clear on their alpha
+				const auto colourMask = _mm_set_epi16(
+					alphaByte==3?0:-1, alphaByte==2?0:-1, alphaByte==1?0:-1, alphaByte==0?0:-1,
+					alphaByte==3?0:-1, alphaByte==2?0:-1, alphaByte==1?0:-1, alphaByte==0?0:-1
+				);
+
+				// x/255, rounded down, for x up to 255*255
+				const auto div255 = [&](__m128i x) {
+					return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, one), _mm_srli_epi16(x, 8)), 8);
+				};
+
+				// blends 2 pixels, widened to 16bits per channel
+				const auto blend = [&](__m128i source, __m128i dest) {
+					const auto alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(source, alphaShuffle), alphaShuffle);
+					const auto trans = _mm_sub_epi16(full, div255(_mm_mullo_epi16(_mm_sub_epi16(full, alpha), opacityWide)));
+
+					return _mm_add_epi16(
+						_mm_and_si128(div255(_mm_mullo_epi16(source, opacityWide)), colourMask),
+						div255(_mm_mullo_epi16(dest, trans))
+					);
+				};
+
+				for(;count>=4;count-=4,dest+=16,source+=16){
+					const auto sourcePixels = _mm_loadu_si128((const __m128i*)source);
+					const auto destPixels = _mm_loadu_si128((const __m128i*)dest);
+
+					_mm_storeu_si128((__m128i*)dest, _mm_packus_epi16(
+						blend(_mm_unpacklo_epi8(sourcePixels, zero), _mm_unpacklo_epi8(destPixels, zero)),
+						blend(_mm_unpackhi_epi8(sourcePixels, zero), _mm_unpackhi_epi8(destPixels, zero))
+					));
+				}
+
+				blend_scalar<alphaByte>(dest, source, count, opacity);
+			}
+		#endif
+
+		#if defined(__ARM_NEON)
+			template <U32 alphaByte>
+			inline void blend_neon(U8 *dest, const U8 *source, U32 count, U8 opacity) {
+				static_assert(alphaByte<4);
+
+				const auto one = vdupq_n_u16(1);
+				const auto full = vdup_n_u8(255);
+				const auto opacityNarrow = vdup_n_u8(opacity);
+
+				// x/255, rounded down, for x up to 255*255
+				const auto div255 = [&](uint16x8_t x) {
+					return vshrn_n_u16(vaddq_u16(vaddq_u16(x, one), vshrq_n_u16(x, 8)), 8);
+				};
+
+				// 8 pixels at a time, deinterleaved so each channel sits in its own register
+				for(;count>=8;count-=8,dest+=32,source+=32){
+					const auto sourcePixels = vld4_u8(source);
+					auto destPixels = vld4_u8(dest);
+
+					const auto trans = vsub_u8(full, div255(vmull_u8(vsub_u8(full, sourcePixels.val[alphaByte]), opacityNarrow)));
+
+					for(auto i=0u;i<4;i++){
+						destPixels.val[i] = i==alphaByte
+							? div255(vmull_u8(destPixels.val[i], trans))
+							: vqadd_u8(div255(vmull_u8(sourcePixels.val[i], opacityNarrow)), div255(vmull_u8(destPixels.val[i], trans)))
+						;
+					}
+
+					vst4_u8(dest, destPixels);
+				}
+
+				blend_scalar<alphaByte>(dest, source, count, opacity);
+			}
+		#endif
+
+		// the fastest kernel available for this build
+		template <U32 alphaByte>
+		inline void blend(U8 *dest, const U8 *source, U32 count, U8 opacity) {
+			#if defined(__SSE2__)
+				blend_sse2<alphaByte>(dest, source, count, opacity);
+			#elif defined(__ARM_NEON)
+				blend_neon<alphaByte>(dest, source, count, opacity);
+			#else
+				blend_scalar<alphaByte>(dest, source, count, opacity);
+			#endif
+		}
+	}
+}
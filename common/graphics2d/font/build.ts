@@ -25,20 +25,27 @@ for await(const dirEntry of Deno.readDir('.')){
 				`				"\\x${values.join('\\x')}"\n`
 				;
 			}
+			// characters must be in ascending code order, with their kerning pairs grouped by first character and sorted by the next
+			const glyphs = [...msdfJson.glyphs].sort((a:any, b:any) => a.unicode-b.unicode);
+			const kernings = [...(msdfJson.kerning||[])].sort((a:any, b:any) => a.unicode1-b.unicode1||a.unicode2-b.unicode2);
+
 			cppSource +=
 				`			;\n`+
-				`			FontCharacter characters[${msdfJson.glyphs.length}] = {\n`
+				`			FontCharacter characters[${glyphs.length}] = {\n`
 			;
 
 			let capHeight:null|number = null;
 
-			for(const glyph of msdfJson.glyphs){
+			for(const glyph of glyphs){
 				if(capHeight===null && (glyph.unicode=='M'.charCodeAt(0)||glyph.unicode=='W'.charCodeAt(0)||glyph.unicode=='X'.charCodeAt(0))){
 					capHeight = glyph.planeBounds.top;
 				}
 
+				const kerningIndex = kernings.findIndex((kerning:any) => kerning.unicode1==glyph.unicode);
+				const kerningCount = kernings.filter((kerning:any) => kerning.unicode1==glyph.unicode).length;
+
 				cppSource +=
-				`				{${glyph.unicode}, FixedI16::fraction(${Math.round(glyph.advance*256)}), FixedI16::fraction(${glyph.planeBounds?Math.round(glyph.planeBounds.left*256):0}), FixedI16::fraction(${glyph.planeBounds?Math.round(glyph.planeBounds.top*256):0}), ${glyph.atlasBounds?Math.round(glyph.atlasBounds.left-0.5):0}, ${glyph.atlasBounds?Math.round(msdfJson.atlas.height-glyph.atlasBounds.top-0.5):0}, ${glyph.atlasBounds?Math.ceil(glyph.atlasBounds.right-glyph.atlasBounds.left):0}, ${glyph.atlasBounds?Math.ceil(glyph.atlasBounds.top-glyph.atlasBounds.bottom):0}},\n`
+				`				{${glyph.unicode}, FixedI16::fraction(${Math.round(glyph.advance*256)}), FixedI16::fraction(${glyph.planeBounds?Math.round(glyph.planeBounds.left*256):0}), FixedI16::fraction(${glyph.planeBounds?Math.round(glyph.planeBounds.top*256):0}), ${glyph.atlasBounds?Math.round(glyph.atlasBounds.left-0.5):0}, ${glyph.atlasBounds?Math.round(msdfJson.atlas.height-glyph.atlasBounds.top-0.5):0}, ${glyph.atlasBounds?Math.ceil(glyph.atlasBounds.right-glyph.atlasBounds.left):0}, ${glyph.atlasBounds?Math.ceil(glyph.atlasBounds.top-glyph.atlasBounds.bottom):0}, ${Math.max(0, kerningIndex)}, ${kerningCount}},\n`
 				;
 			}
 
@@ -46,6 +53,20 @@ for await(const dirEntry of Deno.readDir('.')){
 				capHeight = 0.8;
 			}
 
+			cppSource +=
+				`			};\n`+
+				`			U16 directIndex[256] = {\n`+
+				`				${Array.from({length:256}, (_, code) => glyphs.findIndex((glyph:any) => glyph.unicode==code)+1).join(', ')}\n`+
+				`			};\n`+
+				`			FontKerning kernings[${Math.max(1, kernings.length)}] = {\n`
+			;
+
+			for(const kerning of kernings){
+				cppSource +=
+				`				{${kerning.unicode2}, FixedI16::fraction(${Math.round(kerning.advance*256)})},\n`
+				;
+			}
+
 			cppSource +=
 				`			};\n`+
 				`		}\n`+
@@ -60,7 +81,9 @@ for await(const dirEntry of Deno.readDir('.')){
 				`			${msdfJson.metrics.underlineY},\n`+
 				`			${msdfJson.metrics.underlineThickness},\n`+
 				`			sizeof(characters)/sizeof(characters[0]),\n`+
-				`			characters\n`+
+				`			characters,\n`+
+				`			directIndex,\n`+
+				`			kernings\n`+
 				`		};\n`+
 				`	}\n`+
 				`}\n`
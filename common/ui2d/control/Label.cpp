@@ -9,16 +9,12 @@ namespace ui2d {
 
 			gui.buffer.draw_rect(rect, gui.theme->get_window_background_colour());
 
-			auto fontSettings = graphics2d::Buffer::FontSettings{
-				.font = *graphics2d::font::default_sans,
-				.size = fontSize
-			};
-
-			const auto ascender = (U32)(fontSettings.font.ascender * fontSize + 0.5);
+			const auto ascender = (U32)(graphics2d::font::default_sans->ascender * fontSize + 0.5);
 
 			auto colour = this->colour.get_or(0x333333); //TODO: get default theme text colour
 
-			gui.buffer.draw_text(fontSettings, text, rect.x1, rect.y1+ascender, rect.width(), colour);
+			_update_layout(rect.width());
+			textLayout.draw(gui.buffer, rect.x1, rect.y1+ascender, colour);
 
 			if(flush){
 				gui.update_area(rect);
@@ -26,9 +22,8 @@ namespace ui2d {
 		}
 
 		void Label::set_text(const char *set) {
-			if(text==set) return;
-
 			text = set;
+			textLayout.invalidate(); // the text isn't copied, so may have changed in the same buffer
 		}
 
 		void Label::set_fontSize(U32 set) {
@@ -44,12 +39,9 @@ namespace ui2d {
 		}
 
 		auto Label::get_min_size() -> IVec2 {
-			auto fontSettings = graphics2d::Buffer::FontSettings{
-				.font = *graphics2d::font::default_sans,
-				.size = fontSize
-			};
+			_update_layout(~0u);
 
-			const auto size = gui.buffer.measure_text(fontSettings, text);
+			const auto size = textLayout.measure();
 			return {size.rect.width(), size.rect.height()-size.capHeight+size.lineHeight};
 
 			// auto lineHeight = (U32)(fontSettings.font.lineHeight*fontSize+0.5);
@@ -59,5 +51,14 @@ namespace ui2d {
 		auto Label::get_max_size() -> IVec2 {
 			return {0x7fff'ffff, get_min_size().y};
 		}
+
+		void Label::_update_layout(U32 width) {
+			textLayout.set_font_settings({
+				.font = *graphics2d::font::default_sans,
+				.size = fontSize
+			});
+			textLayout.set_text(text);
+			textLayout.set_width(width);
+		}
 	}
 }
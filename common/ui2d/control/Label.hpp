@@ -2,12 +2,9 @@
 
 #include "../Control.hpp"
 
+#include <common/graphics2d/TextLayout.hpp>
 #include <common/Optional.hpp>
 
-namespace graphics2d {
-	struct Buffer;
-}
-
 namespace ui2d {
 	namespace control {
 		struct Label: Control {
@@ -22,7 +19,7 @@ namespace ui2d {
 			U32 fontSize = 14;
 			Optional<U32> colour;
 
-			void set_text(const char*);
+			void set_text(const char*); // (call again after changing the text in place)
 			void set_fontSize(U32);
 			void set_colour(U32);
 
@@ -30,6 +27,11 @@ namespace ui2d {
 			auto get_max_size() -> IVec2 override;
 
 			void redraw(bool flush = true) override;
+
+		protected:
+			graphics2d::TextLayout textLayout;
+
+			void _update_layout(U32 width);
 		};
 	}
 }
@@ -4,169 +4,529 @@
 
 namespace driver {
 	auto CpuScheduler::_on_start() -> Try<> {
-		timer = TRY_RESULT(driver::Timer::find_and_claim_timer([](void *_scheduler) {
+		const auto id = processor::get_active_id();
+		if(id>=processor::maxCount) return Failure{"Processor id out of range"};
+
+		return init_processor(processors[id]);
+	}
+
+	auto CpuScheduler::start_processor() -> Try<> {
+		const auto id = processor::get_active_id();
+		if(id>=processor::maxCount) return Failure{"Processor id out of range"};
+
+		auto &cpu = processors[id];
+		if(cpu.scheduler) return Failure{"Processor already started"};
+
+		return init_processor(cpu);
+	}
+
+	auto CpuScheduler::init_processor(Processor &cpu) -> Try<> {
+		cpu.timer = TRY_RESULT(driver::Timer::find_and_claim_timer([](void *_scheduler) {
 			auto &scheduler = *(CpuScheduler*)_scheduler;
 			scheduler.api.fail_driver("Timer dropped");
 		}, this));
 
-		kernelThread = &kernelProcess.create_kernel_thread([](){});
-
-		currentThread = kernelThread;
+		cpu.id = &cpu-processors;
+		cpu.kernelThread = &kernelProcess.create_kernel_thread([](){});
+		cpu.currentThread = cpu.kernelThread;
+		cpu.currentThread->_schedulerIsRunning = true;
+		cpu.scheduler = this;
 
 		return {};
 	}
 
-	void CpuScheduler::add_thread(Thread &thread) {
-		switch(thread.state){
-			case Thread::State::active:
-				totalActivePriority += thread.priority * thread.process.priority;
-				activeThreads.push_back(thread);
-			break;
-			case Thread::State::paused:
-				pausedThreads.push_back(thread);
+	void CpuScheduler::RunQueue::push_back(Thread &thread) {
+		bands[thread._schedulerBand].push_back(thread);
+		bandsInUse |= 1<<thread._schedulerBand;
+		size++;
+	}
+
+	void CpuScheduler::RunQueue::pop(Thread &thread) {
+		auto &band = bands[thread._schedulerBand];
+		band.pop(thread);
+		if(!band.head){
+			bandsInUse &= ~(1<<thread._schedulerBand);
+		}
+		size--;
+	}
+
+	// the first that's free to run here (skipping any still running elsewhere, other than the current)
+	auto CpuScheduler::RunQueue::get_next(Thread *current) -> Thread* {
+		for(auto bandsLeft = bandsInUse; bandsLeft; bandsLeft &= bandsLeft-1){
+			for(auto thread = bands[__builtin_ctz(bandsLeft)].head; thread; thread = (Thread*)thread->next){
+				if(thread==current||!thread->_schedulerIsRunning) return thread;
+			}
+		}
+
+		return nullptr;
+	}
+
+	// the last of the lowest priority
+	auto CpuScheduler::RunQueue::get_last() -> Thread* {
+		if(!bandsInUse) return nullptr;
+
+		return bands[31-__builtin_clz(bandsInUse)].tail;
+	}
+
+	// higher priorities get lower (earlier) bands. Each band covers a doubling of priority, so threads only differing slightly still share a band and round-robin
+	auto CpuScheduler::get_priority_band(U32 priority) -> U8 {
+		if(!priority) return priorityBandCount-1;
+
+		return priorityBandCount-1-(31-__builtin_clz(priority));
+	}
+
+	auto CpuScheduler::get_queue(Thread::State state) -> Queue {
+		switch(state){
+			case Thread::State::active: return Queue::active;
+			case Thread::State::sleeping: return Queue::sleeping;
+			case Thread::State::paused: return Queue::paused;
+			case Thread::State::terminated: return Queue::terminated;
+		}
+
+		return Queue::none;
+	}
+
+	auto CpuScheduler::get_processor() -> Processor* {
+		const auto id = processor::get_active_id();
+		if(id>=processor::maxCount||!processors[id].scheduler) return nullptr;
+
+		return &processors[id];
+	}
+
+	void CpuScheduler::enqueue_active(Processor &cpu, Thread &thread) {
+		thread._schedulerQueue = (U8)Queue::active;
+		thread._schedulerProcessor = cpu.id;
+		thread._schedulerPriority = thread.priority * thread.process.priority;
+		thread._schedulerBand = get_priority_band(thread._schedulerPriority);
+
+		cpu.totalActivePriority += thread._schedulerPriority;
+		cpu.activeThreads.push_back(thread);
+		cpu.load++;
+	}
+
+	void CpuScheduler::dequeue_active(Processor &cpu, Thread &thread) {
+		cpu.totalActivePriority -= thread._schedulerPriority;
+		cpu.activeThreads.pop(thread);
+		cpu.load--;
+
+		thread._schedulerQueue = (U8)Queue::none;
+	}
+
+	void CpuScheduler::enqueue_inactive(Thread &thread, Queue queue) {
+		Lock_Guard guard(lock);
+
+		switch(queue){
+			case Queue::none:
+			case Queue::active:
+			case Queue::stealable:
 			break;
-			case Thread::State::sleeping:
+			case Queue::sleeping:
 				sleepingThreads.push_back(thread);
 			break;
-			case Thread::State::terminated:
+			case Queue::paused:
+				pausedThreads.push_back(thread);
+			break;
+			case Queue::terminated:
 				terminatedThreads.push_back(thread);
 			break;
 		}
+
+		thread._schedulerQueue = (U8)queue;
 	}
 
-	void CpuScheduler::remove_thread(Thread &thread) {
-		if(terminatedThreads.contains(thread)){
-			terminatedThreads.pop(thread);
+	void CpuScheduler::dequeue_inactive(Thread &thread) {
+		Lock_Guard guard(lock);
+
+		switch((Queue)thread._schedulerQueue.load()){
+			case Queue::none:
+			case Queue::active:
+			case Queue::stealable:
+			break;
+			case Queue::sleeping:
+				sleepingThreads.pop(thread);
+			break;
+			case Queue::paused:
+				pausedThreads.pop(thread);
+			break;
+			case Queue::terminated:
+				terminatedThreads.pop(thread);
+			break;
+		}
+
+		thread._schedulerQueue = (U8)Queue::none;
+	}
+
+	// queue an unqueued thread wherever its state says it belongs
+	void CpuScheduler::place(Processor &cpu, Thread &thread) {
+		if(thread._schedulerRemoved.exchange(false)){
+			// removed while queued on us, so it no longer belongs anywhere
+			thread._schedulerQueue = (U8)Queue::none;
+			return;
+		}
+
+		if(thread.state==Thread::State::active){
+			enqueue_active(cpu, thread);
+		}else{
+			enqueue_inactive(thread, get_queue(thread.state));
+		}
+	}
+
+	// move a thread out of our active queue, into whichever its state now says (for when it was changed from another processor)
+	void CpuScheduler::settle(Processor &cpu, Thread &thread) {
+		dequeue_active(cpu, thread);
+		place(cpu, thread);
+	}
 
-		}else if(activeThreads.contains(thread)){
-			totalActivePriority -= thread.priority * thread.process.priority;
-			activeThreads.pop(thread);
+	// move a thread into an inactive queue (or out of all of them, for Queue::none)
+	// if it's queued on another processor, or offered up to be stolen, whichever processor next comes across it settles it instead. Its state already says where a paused, sleeping or terminated thread belongs, but a removal has to be marked
+	void CpuScheduler::deactivate(Thread &thread, Queue queue) {
+		switch((Queue)thread._schedulerQueue.load()){
+			case Queue::none:
+			break;
+			case Queue::active: {
+				auto cpu = get_processor();
+				if(!cpu||thread._schedulerProcessor!=cpu->id){
+					if(queue==Queue::none){
+						thread._schedulerRemoved = true;
+					}
+
+					// make sure the owner notices soon, rather than leaving it running until its time slice ends
+					kick(processors[thread._schedulerProcessor]);
+					return;
+				}
+				dequeue_active(*cpu, thread);
+			} break;
+			case Queue::stealable:
+				if(queue==Queue::none){
+					thread._schedulerRemoved = true;
+				}
+				return; // whoever takes it (or takes it back) will settle it
+			case Queue::sleeping:
+			case Queue::paused:
+			case Queue::terminated:
+				dequeue_inactive(thread);
+			break;
+		}
 
-		}else if(sleepingThreads.contains(thread)){
-			sleepingThreads.pop(thread);
+		enqueue_inactive(thread, queue);
+	}
 
-		}else if(pausedThreads.contains(thread)){
-			pausedThreads.pop(thread);
+	void CpuScheduler::activate(Thread &thread) {
+		switch((Queue)thread._schedulerQueue.load()){
+			case Queue::none:
+			break;
+			case Queue::active:
+			case Queue::stealable:
+				return; // still queued, so will be run as normal now that it's active again
+			case Queue::sleeping:
+			case Queue::paused:
+			case Queue::terminated:
+				dequeue_inactive(thread);
+			break;
 		}
+
+		auto cpu = get_processor();
+		debug::assert(cpu);
+		enqueue_active(*cpu, thread);
+		wake(*cpu);
+	}
+
+	// make sure a processor that's stopped its time slices notices it has something new to run
+	void CpuScheduler::wake(Processor &cpu) {
+		if(cpu.isTicking) return;
+
+		// if idle, switch as soon as we're out of whatever made it runnable (often a timer callback). Otherwise whatever's running alone gets a slice first
+		set_time_slice(cpu, cpu.isIdle?0:averageInterval);
+	}
+
+	// have another processor reschedule as soon as it can
+	void CpuScheduler::kick(Processor &cpu) {
+		if(!cpu.scheduler) return;
+
+		cpu.isYieldPending = true;
+		cpu.timer.set(0, _on_yield_timeout, &cpu);
+	}
+
+	void CpuScheduler::set_time_slice(Processor &cpu, U32 usecs) {
+		cpu.timer.set(usecs, _on_yield_timeout, &cpu);
+		cpu.isTicking = true;
+	}
+
+	void CpuScheduler::stop_time_slice(Processor &cpu) {
+		cpu.timer.stop();
+		cpu.isTicking = false;
+	}
+
+	// if any processor is idle, offer up our lowest priority waiting thread for it to steal
+	void CpuScheduler::offer(Processor &cpu, Thread *except1, Thread *except2) {
+		if(!idleCount.load(std::memory_order_relaxed)||cpu.activeThreads.size<2) return;
+
+		auto thread = cpu.activeThreads.get_last();
+		if(!thread||thread==except1||thread==except2) return;
+
+		dequeue_active(cpu, *thread);
+		thread->_schedulerQueue = (U8)Queue::stealable;
+
+		if(!cpu.stealableThreads.push(*thread)){
+			enqueue_active(cpu, *thread);
+			return;
+		}
+
+		cpu.load++;
+
+		// idle processors aren't ticking, so kick one into looking
+		for(auto &other:processors){
+			if(&other==&cpu||!other.scheduler||!other.isIdle.load(std::memory_order_relaxed)) continue;
+
+			kick(other);
+			break;
+		}
+	}
+
+	// take a thread offered by the busiest other processor
+	auto CpuScheduler::steal(Processor &cpu) -> bool {
+		Processor *busiest = nullptr;
+		U32 busiestLoad = 0;
+
+		for(auto &other:processors){
+			if(&other==&cpu||!other.scheduler||!other.stealableThreads.get_size()) continue;
+
+			const auto load = other.load.load(std::memory_order_relaxed);
+			if(load>busiestLoad){
+				busiest = &other;
+				busiestLoad = load;
+			}
+		}
+
+		if(!busiest) return false;
+
+		auto thread = busiest->stealableThreads.steal();
+		if(!thread) return false;
+
+		busiest->load--;
+		place(cpu, *thread);
+
+		return true;
+	}
+
+	void CpuScheduler::add_thread(Thread &thread) {
+		// if removed while still queued elsewhere, and not yet dropped, just keep it
+		if(thread._schedulerRemoved.exchange(false)) return;
+
+		auto cpu = get_processor();
+		debug::assert(cpu);
+
+		place(*cpu, thread);
+
+		if(thread.state==Thread::State::active){
+			wake(*cpu);
+		}
+	}
+
+	void CpuScheduler::remove_thread(Thread &thread) {
+		deactivate(thread, Queue::none);
 	}
 
 	auto CpuScheduler::get_current_thread() -> Thread* {
-		return currentThread;
+		auto cpu = get_processor();
+		return cpu?cpu->currentThread:nullptr;
 	}
 
 	void CpuScheduler::yield() {
-		timer.stop();
+		auto cpu = get_processor();
+		if(!cpu) return;
+
+		stop_time_slice(*cpu);
 
-		_yield();
+		_yield(*cpu);
 	}
 
 	// yield() without a timer clear (not needed when called direct _from_ a timeout)
-	void CpuScheduler::_yield() {
-		if(currentThread&&currentThread!=kernelThread){
-			switch(currentThread->state){
-				case Thread::State::active:
-					activeThreads.pop(*currentThread);
-					activeThreads.push_back(*currentThread);
-				break;
-				case Thread::State::sleeping:
-				case Thread::State::paused:
-				case Thread::State::terminated:
-				break;
+	void CpuScheduler::_yield(Processor &cpu, bool timedOut) {
+		// if we last switched to a thread starting fresh, it came straight from its entrypoint rather than back through here
+		finish_switch(cpu);
+
+		cpu.isYieldPending = false;
+
+		auto oldThread = cpu.currentThread;
+
+		// (if woken and queued on another processor before we switched away, that processor settles it instead)
+		if(oldThread&&oldThread!=cpu.kernelThread&&(Queue)oldThread->_schedulerQueue.load()==Queue::active&&oldThread->_schedulerProcessor==cpu.id){
+			if(oldThread->state!=Thread::State::active||oldThread->_schedulerRemoved){
+				settle(cpu, *oldThread);
+
+			}else{
+				// move to the back of its band, dropping a band if it used its whole time slice (so busy threads can't starve those below)
+				cpu.activeThreads.pop(*oldThread);
+				if(timedOut&&oldThread->_schedulerBand<priorityBandCount-1){
+					oldThread->_schedulerBand++;
+				}
+				cpu.activeThreads.push_back(*oldThread);
 			}
 		}
 
-		auto oldThread = currentThread;
-		currentThread = activeThreads.head;
+		// take back anything we offered that no one took
+		while(auto thread = cpu.stealableThreads.pop()){
+			cpu.load--;
+			place(cpu, *thread);
+		}
+
+		Thread *nextThread;
+		while(true){
+			nextThread = cpu.activeThreads.get_next(oldThread);
+
+			// skip any changed (or removed) from other processors while they were queued here
+			if(nextThread&&(nextThread->state!=Thread::State::active||nextThread->_schedulerRemoved)){
+				settle(cpu, *nextThread);
+				continue;
+			}
+
+			if(!nextThread&&steal(cpu)) continue;
 
-		if(currentThread==oldThread) {
-			timer.set(maxInterval, _on_yield_timeout, this);
+			break;
+		}
+
+		if(nextThread){
+			offer(cpu, oldThread, nextThread);
+		}
+
+		cpu.currentThread = nextThread;
+
+		if(cpu.currentThread==oldThread) {
+			// with nothing else queued there's nothing to slice time between, so run tickless until something else wakes
+			if(cpu.activeThreads.size>1){
+				set_time_slice(cpu, maxInterval);
+			}else{
+				stop_time_slice(cpu);
+			}
 			return;
 		}
 
-		if(currentThread){
-			const auto threadPriority = currentThread->priority * currentThread->process.priority;
+		if(cpu.currentThread){
+			if(cpu.isIdle){
+				cpu.isIdle = false;
+				idleCount--;
+			}
+
+			const auto threadPriority = cpu.currentThread->_schedulerPriority;
 
 			// set to the average timeout interval, scaled by the ratio of this thread's priority vs all other queued priorities
-			const auto maxTime = maths::clamp(averageInterval * activeThreads.size * threadPriority / totalActivePriority, minInterval, maxInterval);
+			const auto maxTime = maths::clamp(averageInterval * cpu.activeThreads.size * threadPriority / cpu.totalActivePriority, minInterval, maxInterval);
+
+			set_time_slice(cpu, maxTime);
 
-			timer.set(maxTime, _on_yield_timeout, this);
+			cpu.currentThread->_schedulerIsRunning = true;
+			cpu.previousThread = oldThread;
 
-			Thread::swap_state(*oldThread, *currentThread);
+			Thread::swap_state(*oldThread, *cpu.currentThread);
+
+			// we may have been resumed on a different processor than we left
+			finish_switch(*get_processor());
 
 		}else{
-			currentThread = kernelThread;
+			cpu.currentThread = cpu.kernelThread;
+
+			if(!cpu.isIdle){
+				cpu.isIdle = true;
+				idleCount++;
+			}
+
+			// tickless while idle - we're woken when a thread becomes runnable here, or another processor offers one up. The only interrupts left are the timer's own scheduled callbacks (such as sleep wakeups)
+			// (unless all that's queued is still being switched away from elsewhere, so check back soon)
+			if(cpu.activeThreads.size){
+				set_time_slice(cpu, minInterval);
+			}else{
+				stop_time_slice(cpu);
+			}
 
-			timer.set(maxInterval, _on_yield_timeout, this);
+			if(oldThread==cpu.currentThread) return;
 
-			Thread::swap_state(*oldThread, *currentThread);
+			cpu.currentThread->_schedulerIsRunning = true;
+			cpu.previousThread = oldThread;
+
+			Thread::swap_state(*oldThread, *cpu.currentThread);
+
+			finish_switch(*get_processor());
 		}
 	}
 
-	void CpuScheduler::_on_yield_timeout(void *_scheduler) {
-		auto &scheduler = *(CpuScheduler*)_scheduler;
+	// the thread we last switched away from has had its state saved, so is now free to be run by any processor
+	void CpuScheduler::finish_switch(Processor &cpu) {
+		if(!cpu.previousThread) return;
 
-		scheduler._yield();
+		cpu.previousThread->_schedulerIsRunning = false;
+		cpu.previousThread = nullptr;
+	}
+
+	void CpuScheduler::_on_yield_timeout(void *_processor) {
+		auto &owner = *(Processor*)_processor;
+		owner.isTicking = false;
+
+		// timers aren't per-processor, so the interrupt may have landed on another. We can only switch threads on the one we're on, so leave the owner to yield at its next chance (its next yield(), or any timer interrupt it does take)
+		auto cpu = owner.scheduler->get_processor();
+		if(cpu!=&owner){
+			owner.isYieldPending = true;
+			if(!cpu||!cpu->isYieldPending) return;
+		}
+
+		cpu->scheduler->_yield(*cpu, true);
 	}
 
 	void CpuScheduler::_on_thread_sleep(Thread &thread, U32 usecs) {
-		activeThreads.pop(thread);
-		sleepingThreads.push_back(thread);
+		deactivate(thread, Queue::sleeping);
 
-		// putting a thread to sleep ALWAYS sets the pending time id, which means this callback is always valid if the thread is still sleeping and has this id
-		thread._pending_timer_id = timer.timer->schedule(usecs, [](void *_thread, U32 timerId){
-			auto &thread = *(Thread*)_thread;
+		auto cpu = get_processor();
+		debug::assert(cpu);
 
-			if(thread.state!=Thread::State::sleeping) return;
-			if(timerId!=thread._pending_timer_id) return;
+		// the wakeup is cancelled if the thread is resumed or terminated some other way first, so this is only ever called while still sleeping
+		// (if it fires on another processor before we've switched away, that processor won't run it until we have - see `Thread::_schedulerIsRunning`)
+		thread._pending_timer_processor = cpu->id;
+		thread._pending_timer_id = cpu->timer.timer->schedule(usecs, [](void *_thread, U32){
+			auto &thread = *(Thread*)_thread;
 
+			thread._pending_timer_id = 0;
 			thread.resume();
 		}, &thread);
 	}
 
+	void CpuScheduler::cancel_wakeup(Thread &thread) {
+		if(!thread._pending_timer_id) return;
+
+		// on whichever timer it was scheduled on, which needn't be ours
+		processors[thread._pending_timer_processor].timer.timer->cancel(thread._pending_timer_id);
+
+		thread._pending_timer_id = 0;
+	}
+
 	void CpuScheduler::_on_thread_paused(Thread &thread) {
-		activeThreads.pop(thread);
-		pausedThreads.push_back(thread);
+		deactivate(thread, Queue::paused);
 	}
 
 	void CpuScheduler::_on_thread_paused_resumed(Thread &thread) {
-		pausedThreads.pop(thread);
-		activeThreads.push_back(thread);
+		activate(thread);
 	}
 
 	void CpuScheduler::_on_thread_sleeping_resumed(Thread &thread) {
-		sleepingThreads.pop(thread);
-		activeThreads.push_back(thread);
+		cancel_wakeup(thread);
+		activate(thread);
 	}
 
 	void CpuScheduler::_on_thread_terminated(Thread &thread) {
-		if(&thread==currentThread){
-			//TODO
-		}
-		
-		switch(currentThread->state){
-			case Thread::State::active:
-				activeThreads.pop(thread);
-			break;
-			case Thread::State::sleeping:
-				sleepingThreads.pop(thread);
-			break;
-			case Thread::State::paused:
-				pausedThreads.pop(thread);
-			break;
-			case Thread::State::terminated:				
-				terminatedThreads.pop(thread);
-			break;
-		}
+		cancel_wakeup(thread);
+		deactivate(thread, Queue::terminated);
 
-		terminatedThreads.push_back(thread);
+		// if terminating ourselves, switch away as soon as we're out of here, rather than running on to the end of our time slice
+		if(&thread==get_current_thread()){
+			set_time_slice(*get_processor(), 0);
+		}
 	}
 
 	void CpuScheduler::_on_thread_priorities_changed(Thread &thread) {
-		totalActivePriority = 0;
+		auto cpu = get_processor();
+		if(!cpu||(Queue)thread._schedulerQueue.load()!=Queue::active||thread._schedulerProcessor!=cpu->id) return; // otherwise picked up whenever it's next queued
 
-		for(auto thread=activeThreads.head; thread; thread=thread->next){
-			auto priority = thread->priority * thread->process.priority;
-			totalActivePriority += priority;
-		}
+		// requeue, to pick up the new priority and band
+		dequeue_active(*cpu, thread);
+		enqueue_active(*cpu, thread);
 	}
 }
@@ -3,10 +3,15 @@
 #include <drivers/Scheduler.hpp>
 #include <drivers/Timer.hpp>
 
+#include <kernel/Lock.hpp>
 #include <kernel/Process.hpp>
+#include <kernel/processor.hpp>
 #include <kernel/Thread.hpp>
 
 #include <common/LList.hpp>
+#include <common/WorkStealingDeque.hpp>
+
+#include <atomic>
 
 namespace driver {
 	struct CpuScheduler: Scheduler {
@@ -22,6 +27,7 @@ namespace driver {
 		void remove_thread(Thread&) override;
 		auto get_current_thread() -> Thread* override;
 		void yield() override;
+		auto start_processor() -> Try<> override;
 
 		void _on_thread_sleep(Thread&, U32 usecs) override;
 		void _on_thread_paused(Thread&) override;
@@ -32,9 +38,7 @@ namespace driver {
 
 	protected:
 
-		driver::Timer::ClaimedTimer timer;
 		Process kernelProcess{"Kernel"};
-		Thread *kernelThread;
 		// Process idleProcess{"Idle Process"};
 		// Thread *idleThread;
 
@@ -43,17 +47,83 @@ namespace driver {
 		U32 averageInterval =  30'000;
 		U32 maxInterval     = 100'000;
 
-		U32 totalActivePriority = 0;
-
-		Thread *currentThread = nullptr;
-
-		LList<Thread> activeThreads;
+		static inline const U32 priorityBandCount = 32;
+
+		// active threads, in a list per priority band (0 being the highest) with a bit set for each band that isn't empty, so the next can always be found in O(1)
+		struct RunQueue {
+			LList<Thread> bands[priorityBandCount];
+			U32 bandsInUse = 0;
+			U32 size = 0;
+
+			void push_back(Thread&);
+			void pop(Thread&);
+			auto get_next(Thread *current) -> Thread*;
+			auto get_last() -> Thread*;
+		};
+
+		// which queue a thread is on (recorded in `Thread::_schedulerQueue`)
+		enum struct Queue: U8 {
+			none,
+			active, // in `Processor::activeThreads` of `Thread::_schedulerProcessor`
+			stealable, // in `Processor::stealableThreads` of `Thread::_schedulerProcessor`
+			sleeping,
+			paused,
+			terminated
+		};
+
+		// everything a single processor schedules with. Only that processor touches its `activeThreads` (with interrupts disabled), so it needs no lock
+		struct Processor {
+			CpuScheduler *scheduler = nullptr;
+			U32 id = 0;
+			driver::Timer::ClaimedTimer timer;
+			Thread *kernelThread = nullptr; // what we run when there's nothing else (the context the processor entered the scheduler with)
+			Thread *currentThread = nullptr;
+			Thread *previousThread = nullptr; // what we last switched away from, until we know its state has been saved
+			std::atomic<bool> isIdle{false};
+			bool isTicking = false; // is the timer set for a time slice? With nothing else to switch to we leave it stopped, and let whatever makes a thread runnable set it again
+			std::atomic<bool> isYieldPending{false}; // our timer went off while another processor had the interrupt, so yield at our next chance
+
+			RunQueue activeThreads;
+			U32 totalActivePriority = 0;
+
+			WorkStealingDeque<Thread, 16> stealableThreads; // threads offered up for idle processors to take
+			std::atomic<U32> load{0}; // active and stealable threads, for other processors to judge who's busiest
+		};
+
+		Processor processors[processor::maxCount];
+		std::atomic<U32> idleCount{0};
+
+		// threads not currently runnable, shared between all processors
+		Lock<LockType::ticket> lock{"cpuSched"};
 		LList<Thread> sleepingThreads;
 		LList<Thread> pausedThreads;
 		LList<Thread> terminatedThreads;
 
-		void _yield();
-
-		static void _on_yield_timeout(void *_scheduler);
+		auto get_processor() -> Processor*;
+		auto init_processor(Processor&) -> Try<>;
+
+		void enqueue_active(Processor&, Thread&);
+		void dequeue_active(Processor&, Thread&);
+		void enqueue_inactive(Thread&, Queue);
+		void dequeue_inactive(Thread&);
+		void place(Processor&, Thread&);
+		void settle(Processor&, Thread&);
+		void activate(Thread&);
+		void deactivate(Thread&, Queue);
+		void wake(Processor&);
+		void kick(Processor&);
+		void set_time_slice(Processor&, U32 usecs);
+		void stop_time_slice(Processor&);
+		void offer(Processor&, Thread *except1, Thread *except2);
+		auto steal(Processor&) -> bool;
+		void cancel_wakeup(Thread&);
+		void finish_switch(Processor&);
+
+		static auto get_priority_band(U32 priority) -> U8;
+		static auto get_queue(Thread::State) -> Queue;
+
+		void _yield(Processor&, bool timedOut = false);
+
+		static void _on_yield_timeout(void *_processor);
 	};
 }
@@ -1,13 +1,17 @@
 #include "DisplayManager.hpp"
 
 #include <drivers/Graphics.hpp>
+#include <drivers/Scheduler.hpp>
 
 #include <kernel/drivers.hpp>
 #include <kernel/Lock.hpp>
 #include <kernel/logging.hpp>
 #include <kernel/memory.hpp>
 #include <kernel/mmio.hpp>
+#include <kernel/Process.hpp>
+#include <kernel/time.hpp>
 
+#include <common/PodArray.hpp>
 #include <common/stdlib.hpp>
 
 // #define BACKGROUND_GRID
@@ -15,11 +19,22 @@
 
 namespace driver {
 	namespace {
+		const U32 maxDamageRects = 32;
+		const I32 flushRows = 64; // damage is composited this many rows at a time, releasing the lock between each, so callers marking damage are never held up for long
+
 		struct Framebuffer {
 			driver::Graphics *driver;
 			U32 driverFramebuffer;
 			graphics2d::Buffer *buffer;
 			graphics2d::Rect area;
+
+			// areas (in screen coords) waiting to be composited. These never overlap, so each pixel is written at most once per flush
+			graphics2d::Rect damage[maxDamageRects];
+			U32 damageCount = 0;
+
+			// areas (in screen coords) composited to the back buffer, waiting to be presented
+			graphics2d::Rect drawn[maxDamageRects];
+			U32 drawnCount = 0;
 		};
 
 		graphics2d::Rect totalArea;
@@ -41,10 +56,35 @@ namespace driver {
 		Lock<LockType::recursive> lock;
 		Lock<LockType::flat> displaysLock;
 
+		// which display is on top along each part of each row of the screen (`totalArea`), so compositing can go span by span rather than searching the displays per pixel
+		// rows are only rebuilt when displays within them move, resize, show, hide or are restacked
+		struct Span {
+			I32 x1, x2;
+			DisplayManager::Display *display; // the topmost, or nullptr for the background
+			bool isTransparent; // if so this part of the display is blended with what's below
+		};
+
+		struct SpanRow {
+			PodArray<Span> spans;
+			bool isDirty = true;
+		};
+
+		SpanRow *spanRows = nullptr;
+
+		DisplayManager::FrameStats frameStats;
+		U64 frameRamBytes = 0; // written so far this frame
+		U64 frameVramBytes = 0;
+		U32 spanRowCount = 0;
+
+		driver::Scheduler *scheduler = nullptr;
+		Thread *compositorThread = nullptr; // if not present, damage is composited immediately instead
+
 		void _set_background_colour(U32 colour);
 
 		auto _create_view(Thread *thread, DisplayManager::DisplayLayer layer, U32 width, U32 height, U8 scale=1) -> DisplayManager::Display*;
 		void _move_display_to(DisplayManager::Display&, I32 x, I32 y, bool update);
+		auto _get_opaque_area(DisplayManager::Display&) -> graphics2d::Rect;
+		auto _copy_moved_display(DisplayManager::Display&, graphics2d::Rect oldRect, graphics2d::Rect area) -> bool;
 		void _move_and_resize_display_to(DisplayManager::Display&, graphics2d::Rect area);
 		void _resize_display_to(DisplayManager::Display&, U32 width, U32 height);
 		void _place_above(DisplayManager::Display&, DisplayManager::Display &other);
@@ -54,18 +94,35 @@ namespace driver {
 		auto _is_display_top(DisplayManager::Display&) -> bool;
 		void _show_display(DisplayManager::Display&, bool update);
 		void _hide_display(DisplayManager::Display&);
-		auto _find_display_section_in_row(I32 &x, I32 y, I32 x2, bool &isTransparent, DisplayManager::Display *current = nullptr) -> DisplayManager::Display*;
+		void _set_span(PodArray<Span>&, I32 x1, I32 x2, DisplayManager::Display*, bool isTransparent);
+		void _build_span_row(I32 y, PodArray<Span>&);
+		void _invalidate_spans(I32 y1, I32 y2);
+		void _invalidate_display_spans(DisplayManager::Display&);
+		auto _get_span_row(I32 y) -> PodArray<Span>&;
+		void _resize_span_map();
+		void _draw_background_span(Framebuffer&, I32 x1, I32 x2, I32 y);
+		void _draw_display_span(Framebuffer&, DisplayManager::Display&, I32 x1, I32 x2, I32 y);
+		void _draw_blended_span(Framebuffer&, DisplayManager::Display&, I32 x1, I32 x2, I32 y);
+		void _blend_display_span(Framebuffer&, DisplayManager::Display&, I32 x1, I32 x2, I32 y);
+		void _upscale_span(U32 scale, U32 bpp, U8 *target, const U8 *source, U32 x, U32 count);
+		auto _is_solid_across(DisplayManager::Display&, I32 x1, I32 x2, I32 y) -> bool;
 		void _update_framebuffer_positions();
 		void _update_background();
-		void _update_background_area(graphics2d::Rect);
-		void _update_area(graphics2d::Rect, DisplayManager::Display *below = nullptr);
-		void _update_area_transparency(graphics2d::Rect);
-		void _update_area_solid(graphics2d::Rect, DisplayManager::Display *below = nullptr);
-		void _update_display_solid(DisplayManager::Display&);
-		void _update_display_area_solid(DisplayManager::Display&, graphics2d::Rect);
-		auto _sample_at(Framebuffer &framebuffer, I32 x, I32 y, DisplayManager::Display *topDisplay) -> U32;
-		auto _calculate_blending_at(Framebuffer&, I32 x, I32 y, DisplayManager::Display *topDisplay) -> U32;
+		void _update_area(graphics2d::Rect);
+		auto _is_drawn_above(PodArray<Span>&, U32 &index, DisplayManager::Display*, I32 x1, I32 x2) -> bool;
+		void _count_written(Framebuffer&, graphics2d::Rect);
 		auto _get_screen_buffer(U32 framebuffer, graphics2d::Rect) -> Optional<graphics2d::Buffer>;
+		void _damage(graphics2d::Rect);
+		void _add_damage(Framebuffer&, graphics2d::Rect);
+		void _add_damage_excluding(Framebuffer&, graphics2d::Rect, graphics2d::Rect exclude);
+		void _request_flush();
+		void _add_area(graphics2d::Rect *areas, U32 &count, graphics2d::Rect);
+		auto _add_area_from(graphics2d::Rect *areas, U32 &count, graphics2d::Rect, U32 start) -> bool;
+		auto _has_damage() -> bool;
+		auto _flush_damage_slice() -> bool;
+		void _flush_damage();
+		void _present();
+		void _run_compositor();
 
 		void _set_background_colour(U32 colour) {
 			if(windowBackgroundColour==colour) return;
@@ -142,326 +199,318 @@ namespace driver {
 			auto _sample_background_strip_at(U32 y) -> U32;
 		#endif
 
-		template <graphics2d::BufferFormatOrder order>
-		union __attribute__((packed)) PackedPixel;
+		// set a run of a row's spans (which always cover the whole row, in order) to a display, splitting any it partially covers
+		void _set_span(PodArray<Span> &spans, I32 x1, I32 x2, DisplayManager::Display *display, bool isTransparent) {
+			x1 = max(x1, totalArea.x1);
+			x2 = min(x2, totalArea.x2);
+			if(x2<=x1) return;
 
-		template <>
-		union __attribute__((packed)) PackedPixel<graphics2d::BufferFormatOrder::bgra> {
-			struct __attribute__((packed)) {
-				U8 b;
-				U8 g;
-				U8 r;
-				U8 a;
-			};
-			U32 value;
-		};
+			auto first = 0u;
+			while(spans[first].x2<=x1) first++;
 
-		template <>
-		union __attribute__((packed)) PackedPixel<graphics2d::BufferFormatOrder::argb> {
-			struct __attribute__((packed)) {
-				U8 a;
-				U8 r;
-				U8 g;
-				U8 b;
-			};
-			U32 value;
-		};
+			if(spans[first].x1<x1){
+				spans.insert(first+1, spans[first]);
+				spans[first].x2 = x1;
+				spans[++first].x1 = x1;
+			}
 
-		template <graphics2d::BufferFormatOrder formatOrder>
-		auto __sample_at(I32 x, I32 y, DisplayManager::Display *display) -> PackedPixel<formatOrder>;
+			auto last = first;
+			while(spans[last].x2<x2) last++;
 
-		auto _sample_at(Framebuffer &framebuffer, I32 x, I32 y, DisplayManager::Display *topDisplay) -> U32 {
-			switch(framebuffer.buffer->order){
-				case graphics2d::BufferFormatOrder::argb:
-					return __sample_at<graphics2d::BufferFormatOrder::argb>(x, y, topDisplay).value;
-				break;
-				case graphics2d::BufferFormatOrder::bgra:
-				default:
-					return __sample_at<graphics2d::BufferFormatOrder::bgra>(x, y, topDisplay).value;
-				break;
+			if(spans[last].x2>x2){
+				spans.insert(last+1, spans[last]);
+				spans[last].x2 = x2;
+				spans[last+1].x1 = x2;
 			}
-		}
 
-		template <graphics2d::BufferFormatOrder formatOrder>
-		auto __calculate_blending_at(I32 x, I32 y, DisplayManager::Display *topDisplay) -> PackedPixel<formatOrder>;
+			spans[first] = {x1, x2, display, isTransparent};
 
-		auto _calculate_blending_at(Framebuffer &framebuffer, I32 x, I32 y, DisplayManager::Display *topDisplay) -> U32 {
-			switch(framebuffer.buffer->order){
-				case graphics2d::BufferFormatOrder::argb:
-					return __calculate_blending_at<graphics2d::BufferFormatOrder::argb>(x, y, topDisplay).value;
-				break;
-				case graphics2d::BufferFormatOrder::bgra:
-				default:
-					return __calculate_blending_at<graphics2d::BufferFormatOrder::bgra>(x, y, topDisplay).value;
-				break;
+			for(auto i=first;i<last;i++){
+				spans.remove(first+1);
 			}
 		}
 
-		template <graphics2d::BufferFormatOrder formatOrder>
-		auto __sample_at(I32 x, I32 y, DisplayManager::Display *display) -> PackedPixel<formatOrder> {
-			if(!display->isVisible) return {0,0,0,0};
+		// work out which display is on top along each part of a row, painting each visible display over those below
+		void _build_span_row(I32 y, PodArray<Span> &spans) {
+			spans.clear();
+			spans.push_back(totalArea.x1, totalArea.x2, nullptr, false);
 
-			// check just y
-			if(display->y>y||display->y+(I32)display->get_height()<=y) return {0,0,0,0};
+			for(auto display=displays.head; display; display=display->next){
+				if(!display->isVisible) continue;
+				if(display->y>y||display->y+(I32)display->get_height()<=y) continue;
 
-			// check x (+ corners)
-			const auto displayY = y-display->y;
-			if(
-				display->x+(I32)display->get_left_margin(displayY)>x||
-				display->x+(I32)display->get_width()-(I32)display->get_right_margin(displayY)<=x
-			) return {0,0,0,0};
+				const auto displayY = y-display->y;
+				const auto left = display->x+(I32)display->get_left_margin(displayY);
+				const auto right = display->x+(I32)display->get_width()-(I32)display->get_right_margin(displayY);
+
+				if(displayY<display->solidArea.y1||displayY>=display->solidArea.y2){
+					_set_span(spans, left, right, display, true);
 
-			const auto displayX = x-display->x;
+				}else{
+					const auto solidLeft = maths::clamp(display->x+display->solidArea.x1, left, right);
+					const auto solidRight = maths::clamp(display->x+display->solidArea.x2, solidLeft, right);
 
-			return *(PackedPixel<formatOrder>*)&display->buffer.address[(displayY/display->scale)*display->buffer.stride+(displayX/display->scale)*4];
+					_set_span(spans, left, solidLeft, display, true);
+					_set_span(spans, solidLeft, solidRight, display, false);
+					_set_span(spans, solidRight, right, display, true);
+				}
+			}
 		}
 
-		//TODO: implement alpha testing instead on non rgba modes (palette index 0 or 0xff00ff perhaps?)
-		template <graphics2d::BufferFormatOrder formatOrder>
-		auto __calculate_blending_at(I32 x, I32 y, DisplayManager::Display *topDisplay) -> PackedPixel<formatOrder> {
-			PackedPixel<formatOrder> result{0,0,0,0};
-			U8 visibility = 255;
+		// mark rows as needing their spans rebuilt (for when displays have moved, resized, shown, hidden or been restacked within them)
+		void _invalidate_spans(I32 y1, I32 y2) {
+			y1 = max(y1, totalArea.y1);
+			y2 = min(y2, totalArea.y1+(I32)spanRowCount);
 
-			for(auto display=topDisplay; display; display=display->prev){
-				if(!display->isVisible) continue;
+			for(auto y=y1;y<y2;y++){
+				spanRows[y-totalArea.y1].isDirty = true;
+			}
+		}
 
-				// check just y
-				if(display->y>y||display->y+(I32)display->get_height()<=y) continue;
+		void _invalidate_display_spans(DisplayManager::Display &display) {
+			_invalidate_spans(display.y, display.y+(I32)display.get_height());
+		}
 
-				// check x (+ corners)
-				const auto displayY = y-display->y;
-				if(
-					display->x+(I32)display->get_left_margin(displayY)>x||
-					display->x+(I32)display->get_width()-(I32)display->get_right_margin(displayY)<=x
-				) continue;
+		auto _get_span_row(I32 y) -> PodArray<Span>& {
+			auto &row = spanRows[y-totalArea.y1];
 
-				const auto displayX = x-display->x;
+			if(row.isDirty){
+				_build_span_row(y, row.spans);
+				row.isDirty = false;
+			}
 
-				auto &read = *(PackedPixel<formatOrder>*)&display->buffer.address[(displayY/display->scale)*display->buffer.stride+(displayX/display->scale)*4];
+			return row.spans;
+		}
 
-				result.r = min(result.r + read.r*(U32)visibility/255, 255u);
-				result.g = min(result.g + read.g*(U32)visibility/255, 255u);
-				result.b = min(result.b + read.b*(U32)visibility/255, 255u);
+		void _resize_span_map() {
+			if(spanRowCount!=(U32)totalArea.height()){
+				delete[] spanRows;
+				spanRowCount = totalArea.height();
+				spanRows = spanRowCount?new SpanRow[spanRowCount]:nullptr;
 
-				auto displayTransparent = !display->solidArea.contains(displayX, displayY);
+			}else{
+				_invalidate_spans(totalArea.y1, totalArea.y2);
+			}
+		}
 
-				// return early if we hit something solid
-				if(!displayTransparent) goto done;
+		#pragma GCC push_options
+		#pragma GCC optimize ("-O3")
 
-				// all visibility used up
-				if(visibility<=255-read.a) goto done;
+		void _draw_background_span(Framebuffer &framebuffer, I32 x1, I32 x2, I32 y) {
+			#if defined(BACKGROUND_STRIP)
+				framebuffer.buffer->set(x1-framebuffer.area.x1, y-framebuffer.area.y1, _sample_background_strip_at(y), x2-x1);
 
-				visibility -= 255-read.a;
-			}
+			#else
+				for(auto x=x1;x<x2;x++){
+					framebuffer.buffer->set(x-framebuffer.area.x1, y-framebuffer.area.y1, _sample_background_at(x, y));
+				}
+			#endif
+		}
 
-			// if(visibility==255) return; //nothing was found
+		struct __attribute__((packed)) Pixel24 {
+			U8 bytes[3];
+		};
 
-			{
-				auto bg = _sample_background_at(x, y);
+		// write `count` pixels of a source row scaled up by `scale`, starting from (scaled) pixel x
+		template <typename Pixel, unsigned scale>
+		void __upscale_span(Pixel *target, const Pixel *source, U32 x, U32 count) {
+			source += x/scale;
 
-				result.r += min((bg>>16 & 0xff) * (U32)visibility/255u, 255u);
-				result.g += min((bg>> 8 & 0xff) * (U32)visibility/255u, 255u);
-				result.b += min((bg>> 0 & 0xff) * (U32)visibility/255u, 255u);
+			// finish off a partly covered source pixel at the start
+			if(auto phase = x%scale){
+				for(;phase<scale&&count;phase++,count--){
+					*target++ = *source;
+				}
+				source++;
 			}
 
-			done:
+			for(;count>=scale;count-=scale,target+=scale,source++){
+				const auto pixel = *source;
+				for(auto i=0u;i<scale;i++){
+					target[i] = pixel;
+				}
+			}
 
-			return result;
+			for(;count;count--){
+				*target++ = *source;
+			}
 		}
 
-		auto _find_display_section_in_row(I32 &x, I32 y, I32 x2, bool &isTransparent, DisplayManager::Display *current) -> DisplayManager::Display* {
-			I32 foundLeft = x2;
-
-			if(current){
-				auto currentX = x-current->x;
-				auto currentY = y-current->y;
+		template <unsigned scale>
+		void __upscale_span(U32 bpp, U8 *target, const U8 *source, U32 x, U32 count) {
+			switch(bpp){
+				case 1: __upscale_span<U8, scale>(target, source, x, count); break;
+				case 2: __upscale_span<U16, scale>((U16*)target, (U16*)source, x, count); break;
+				case 3: __upscale_span<Pixel24, scale>((Pixel24*)target, (Pixel24*)source, x, count); break;
+				case 4: __upscale_span<U32, scale>((U32*)target, (U32*)source, x, count); break;
+			}
+		}
 
-				if(currentY<current->solidArea.y1||currentY>=current->solidArea.y2){
-					; // single section top and bottom
+		void _upscale_span(U32 scale, U32 bpp, U8 *target, const U8 *source, U32 x, U32 count) {
+			switch(scale){
+				case 1: memcpy(target, &source[x*bpp], count*bpp); break;
+				case 2: __upscale_span<2>(bpp, target, source, x, count); break;
+				case 3: __upscale_span<3>(bpp, target, source, x, count); break;
+				case 4: __upscale_span<4>(bpp, target, source, x, count); break;
+			}
+		}
 
-				}else if(current->solidArea.x1>0&&currentX<current->solidArea.x1){
-					foundLeft = current->x+current->solidArea.x1;
+		template <unsigned scale>
+		void __draw_display_span(Framebuffer &framebuffer, DisplayManager::Display &display, I32 x1, I32 x2, I32 y) {
+			const auto bpp = graphics2d::bufferFormat::size[(U8)framebuffer.buffer->format];
 
-				}else if(currentX<current->solidArea.x2){
-					foundLeft = current->x+current->solidArea.x2;
+			U8 *target = &framebuffer.buffer->address[(y-framebuffer.area.y1)*framebuffer.buffer->stride+(x1-framebuffer.area.x1)*bpp];
+			U8 *source = &display.buffer.address[((y-display.y)/scale)*display.buffer.stride];
 
-				}else{
-					foundLeft = current->x+current->get_width();
-				}
+			if(scale==1){
+				memcpy_aligned(target, &source[(x1-display.x)*bpp], (x2-x1)*bpp);
 
-				foundLeft = maths::clamp(foundLeft, current->x+(I32)current->get_left_margin(currentY), current->x+(I32)current->get_width()-(I32)current->get_right_margin(currentY));
+			}else{
+				__upscale_span<scale>(bpp, target, source, x1-display.x, x2-x1);
 			}
-			
-			DisplayManager::Display *found = nullptr;
-			auto foundTransparent = false;
-
-			for(auto display=displays.tail; display; display=display->prev){
-				if(!display->isVisible) goto next;
+		}
 
-				if(display==current){
-					// abort, we've now reached the current window. There is nothing more on top of it to check.
-					break;
-				}
+		void _draw_display_span(Framebuffer &framebuffer, DisplayManager::Display &display, I32 x1, I32 x2, I32 y) {
+			switch(display.scale){
+				case 1: __draw_display_span<1>(framebuffer, display, x1, x2, y); break;
+				case 2: __draw_display_span<2>(framebuffer, display, x1, x2, y); break;
+				case 3: __draw_display_span<3>(framebuffer, display, x1, x2, y); break;
+				case 4: __draw_display_span<4>(framebuffer, display, x1, x2, y); break;
+			}
+		}
 
-				// check just y
-				if(display->y>y||display->y+(I32)display->get_height()<=y) goto next;
+		// blend a transparent part of a display over whatever is below it
+		// what's below is drawn first (from the highest display solid across the whole span, or else the background), then each display from there up is blended over it a span at a time
+		void _draw_blended_span(Framebuffer &framebuffer, DisplayManager::Display &display, I32 x1, I32 x2, I32 y) {
+			auto base = display.prev;
+			while(base&&!_is_solid_across(*base, x1, x2, y)){
+				base = base->prev;
+			}
 
-				{
-					// check x (+ corners)
-					const auto displayX = x-display->x;
-					const auto displayY = y-display->y;
-					auto displayLeft = display->x+(I32)display->get_left_margin(displayY);
-					auto displayRight = display->x+(I32)display->get_width()-(I32)display->get_right_margin(displayY);
+			if(base){
+				_draw_display_span(framebuffer, *base, x1, x2, y);
+			}else{
+				_draw_background_span(framebuffer, x1, x2, y);
+			}
 
-					if(displayRight<=x) goto next;
+			for(auto above=base?base->next:displays.head; above; above=above->next){
+				_blend_display_span(framebuffer, *above, x1, x2, y);
+				if(above==&display) break;
+			}
+		}
 
-					auto transparent = false;
+		// blend whatever part of a display's row lies between x1 and x2 over the framebuffer
+		void _blend_display_span(Framebuffer &framebuffer, DisplayManager::Display &display, I32 x1, I32 x2, I32 y) {
+			if(!display.isVisible||display.y>y||display.y+(I32)display.get_height()<=y) return;
 
-					if(true){ // chop into separate regions when using solidArea
+			const auto displayY = y-display.y;
+			x1 = max(x1, display.x+(I32)display.get_left_margin(displayY));
+			x2 = min(x2, display.x+(I32)display.get_width()-(I32)display.get_right_margin(displayY));
+			if(x2<=x1) return;
 
-						if(displayY<display->solidArea.y1||displayY>=display->solidArea.y2){
-							// top and bottom transparent areas
-							transparent = true;
+			const auto bpp = graphics2d::bufferFormat::size[(U8)framebuffer.buffer->format];
+			const auto scale = (U32)display.scale;
+			const auto source = &display.buffer.address[(displayY/scale)*display.buffer.stride];
+			const auto targetY = (U32)(y-framebuffer.area.y1);
 
-						}else{
-							if(display->solidArea.x1>0&&displayX<display->solidArea.x1){
-								// left transparent edge
-								displayRight = min(display->x+display->solidArea.x1, displayRight);
-								transparent = true;
-
-							}else if(displayX<display->solidArea.x2){
-								// centre solid area
-								displayLeft = max(displayLeft, display->x+display->solidArea.x1);
-								displayRight = min(display->x+display->solidArea.x2, displayRight);
-
-							}else{
-								// right transparent edge
-								displayLeft = max(displayLeft, display->x+display->solidArea.x2);
-								transparent = true;
-							}
-						}
-					}
+			if(scale==1){
+				framebuffer.buffer->blend_span(x1-framebuffer.area.x1, targetY, &source[(x1-display.x)*bpp], x2-x1);
+				return;
+			}
 
-					if(displayLeft<=x){
-						// we're already inside it. Return immediately
-						foundTransparent = transparent;
-						found = display;
-						goto done;
-
-					}else if(displayLeft<foundLeft){
-						// it's further to the right, so set if the best match so far
-						foundLeft = displayLeft;
-						foundTransparent = transparent;
-						found = display;
-					}
-				}
+			// scaled displays are upscaled a chunk at a time to blend from
+			U8 buffer[1024];
+			const auto chunkLength = (I32)(sizeof(buffer)/bpp);
 
-				next:
-				;
+			for(auto x=x1; x<x2; x+=chunkLength){
+				const auto count = min(x2-x, chunkLength);
+				_upscale_span(scale, bpp, buffer, source, x-display.x, count);
+				framebuffer.buffer->blend_span(x-framebuffer.area.x1, targetY, buffer, count);
 			}
+		}
 
-			x = min(foundLeft, x2);
+		// is the display solid (so hiding everything below) all the way from x1 to x2?
+		auto _is_solid_across(DisplayManager::Display &display, I32 x1, I32 x2, I32 y) -> bool {
+			if(!display.isVisible||display.y>y||display.y+(I32)display.get_height()<=y) return false;
 
-			done:
+			const auto displayY = y-display.y;
 
-			isTransparent = foundTransparent;
-			return found;
+			return
+				display.x+(I32)display.get_left_margin(displayY)<=x1&&
+				display.x+(I32)display.get_width()-(I32)display.get_right_margin(displayY)>=x2&&
+				display.solidArea.contains(x1-display.x, displayY)&&
+				display.solidArea.contains(x2-1-display.x, displayY)
+			;
 		}
 
-		void _update_area(graphics2d::Rect rect, DisplayManager::Display *below) {
-			_update_area_solid(rect, below);
-			_update_area_transparency(rect); //TODO: pass this the below rect to extrude
-		}
+		#pragma GCC pop_options
 
-		//TODO: take a rect area to exclude
-		void _update_area_transparency(graphics2d::Rect screenRect) {
+		// composite an area of the screen, span by span from the span map
+		void _update_area(graphics2d::Rect screenRect) {
 			for(auto &framebuffer:framebuffers){
 				if(!framebuffer.buffer) continue;
 
-				auto rect = screenRect.intersect(framebuffer.area);
+				auto rect = screenRect.intersect(framebuffer.area).intersect({totalArea.x1, totalArea.y1, totalArea.x2, totalArea.y1+(I32)spanRowCount});
+
+				const auto bpp = graphics2d::bufferFormat::size[(U8)framebuffer.buffer->format];
+				PodArray<Span> *aboveSpans = nullptr; // the row just drawn above, if any
 
 				for(auto y=rect.y1; y<rect.y2; y++){
-					auto display = (DisplayManager::Display*)nullptr;
-					auto isTransparent = false;
-
-					for(auto scanX=rect.x1; scanX<rect.x2;){
-						auto nextScanX = scanX;
-						auto nextIsTransparent = false;
-						auto nextDisplay = _find_display_section_in_row(nextScanX, y, rect.x2, nextIsTransparent, display);
-						if(!display&&!nextDisplay) break; // we didn't end a current display, and didn't find a new one - this row is done
-
-						if(display){
-							if(isTransparent){
-								// render transparent strip to framebuffer
-								// do so in buffered chunks, to hopefully speed up the process
-
-								auto framebufferAddress = &framebuffer.buffer->address[(y-framebuffer.area.y1)*framebuffer.buffer->stride+(scanX-framebuffer.area.x1)*4];
-								U32 buffer[256];
-								auto bufferPosition = buffer;
-
-								for(auto x=scanX; x<nextScanX; x++){
-									{
-										auto top = _sample_at(framebuffer, x, y, display);
-
-										if(top>>24==0){
-											*bufferPosition++ = top;
-
-										}else if(top>>24==255||true){
-											auto below = _calculate_blending_at(framebuffer, x, y, display->prev);
-											*bufferPosition++ = graphics2d::blend_colours(below, top);
-
-										// }else{
-										// 	// auto radius = (I32)(255-(top>>24)+42)/85;
-										// 	auto radius = 1;
-
-										// 	U32 samples[5] = {
-										// 		_calculate_blending_at(framebuffer, maths::clamp(x-radius, 0, (I32)framebuffer.buffer->width), maths::clamp(y-radius, 0, (I32)framebuffer.buffer->height), display->prev),
-										// 		_calculate_blending_at(framebuffer, maths::clamp(x+radius, 0, (I32)framebuffer.buffer->width), maths::clamp(y-radius, 0, (I32)framebuffer.buffer->height), display->prev),
-										// 		_calculate_blending_at(framebuffer, maths::clamp(x-radius, 0, (I32)framebuffer.buffer->width), maths::clamp(y+radius, 0, (I32)framebuffer.buffer->height), display->prev),
-										// 		_calculate_blending_at(framebuffer, maths::clamp(x+radius, 0, (I32)framebuffer.buffer->width), maths::clamp(y+radius, 0, (I32)framebuffer.buffer->height), display->prev),
-										// 		_calculate_blending_at(framebuffer, x, y, display->prev),
-										// 	};
-										// 	auto below = 0
-										// 		|(U32)(((U32)((samples[0]>> 0)&0xff) + ((samples[1]>> 0)&0xff) + ((samples[2]>> 0)&0xff) + ((samples[3]>> 0)&0xff) + ((samples[4]>> 0)&0xff))/5) << 0
-										// 		|(U32)(((U32)((samples[0]>> 8)&0xff) + ((samples[1]>> 8)&0xff) + ((samples[2]>> 8)&0xff) + ((samples[3]>> 8)&0xff) + ((samples[4]>> 8)&0xff))/5) << 8
-										// 		|(U32)(((U32)((samples[0]>>16)&0xff) + ((samples[1]>>16)&0xff) + ((samples[2]>>16)&0xff) + ((samples[3]>>16)&0xff) + ((samples[4]>>16)&0xff))/5) <<16
-										// 		|(U32)(((U32)((samples[0]>>24)&0xff) + ((samples[1]>>24)&0xff) + ((samples[2]>>24)&0xff) + ((samples[3]>>24)&0xff) + ((samples[4]>>24)&0xff))/5) <<24
-										// 	;
-
-										// 	*bufferPosition++ = graphics2d::blend_colours(below, top);
-										}
-									}
-									// *bufferPosition++ = _calculate_blending_at(framebuffer, x, y, display);
-
-									if(bufferPosition>=&buffer[sizeof(buffer)/sizeof(buffer[0])]){
-										memcpy(framebufferAddress, buffer, (U8*)bufferPosition-(U8*)buffer);
-										framebufferAddress += (U8*)bufferPosition-(U8*)buffer;
-										bufferPosition = buffer;
-									}
-								}
-
-								if(bufferPosition>buffer){
-									memcpy(framebufferAddress, buffer, (U8*)bufferPosition-(U8*)buffer);
-								}
-							}
-						}
+					auto &spans = _get_span_row(y);
+					auto above = 0u;
+
+					for(auto &span:spans){
+						if(span.x2<=rect.x1) continue;
+						if(span.x1>=rect.x2) break;
+
+						const auto x1 = max(span.x1, rect.x1);
+						const auto x2 = min(span.x2, rect.x2);
+
+						if(!span.display){
+							_draw_background_span(framebuffer, x1, x2, y);
 
-						display = nextDisplay;
-						isTransparent = nextIsTransparent;
-						scanX = nextScanX;
+						}else if(span.isTransparent){
+							_draw_blended_span(framebuffer, *span.display, x1, x2, y);
+
+						}else if(span.display->scale>1&&aboveSpans&&(y-span.display->y)%span.display->scale!=0&&_is_drawn_above(*aboveSpans, above, span.display, x1, x2)){
+							// a scaled display repeats each row, so just copy what was drawn from it above
+							auto target = &framebuffer.buffer->address[(y-framebuffer.area.y1)*framebuffer.buffer->stride+(x1-framebuffer.area.x1)*bpp];
+							memcpy(target, target-framebuffer.buffer->stride, (x2-x1)*bpp);
+
+						}else{
+							_draw_display_span(framebuffer, *span.display, x1, x2, y);
+						}
 					}
+
+					aboveSpans = &spans;
 				}
+
+				_add_area(framebuffer.drawn, framebuffer.drawnCount, rect);
+				_count_written(framebuffer, rect);
 			}
 		}
 
-		void _update_area_solid(graphics2d::Rect rect, DisplayManager::Display *below) {
-			_update_background_area(rect);
+		// was the solid part of the display covering x1 to x2 drawn in the row above?
+		// `index` tracks our place within the row above, as spans are checked from left to right
+		auto _is_drawn_above(PodArray<Span> &aboveSpans, U32 &index, DisplayManager::Display *display, I32 x1, I32 x2) -> bool {
+			while(index<aboveSpans.length&&aboveSpans[index].x2<=x1) index++;
+			if(index>=aboveSpans.length) return false;
 
-			for(auto display=displays.head; display; display=display->next){
-				if(display==below) break;
-				if(!display->isVisible) continue;
+			const auto &span = aboveSpans[index];
+			return span.display==display&&!span.isTransparent&&span.x1<=x1&&span.x2>=x2;
+		}
+
+		// add to this frame's stats, for an area written to a framebuffer's back buffer
+		void _count_written(Framebuffer &framebuffer, graphics2d::Rect rect) {
+			if(rect.width()<1||rect.height()<1) return;
 
-				_update_display_area_solid(*display, rect.offset(-display->x, -display->y).intersect(display->solidArea));
+			const auto bytes = (U64)rect.width()*rect.height()*graphics2d::bufferFormat::size[(U8)framebuffer.buffer->format];
+
+			// without a separate back buffer, this went straight to the framebuffer
+			if(framebuffer.buffer==framebuffer.driver->get_framebuffer(framebuffer.driverFramebuffer)){
+				frameVramBytes += bytes;
+			}else{
+				frameRamBytes += bytes;
 			}
 		}
 
@@ -471,6 +520,8 @@ namespace driver {
 
 			totalArea.clear();
 
+			graphics2d::Rect changedArea;
+
 			for(auto &framebuffer:framebuffers){
 				if(!framebuffer.buffer) break; // a buffer is in a transitional state, so abort updating later stuff that depends on it!
 
@@ -480,15 +531,20 @@ namespace driver {
 
 				if(framebuffer.area != newArea){
 					framebuffer.area = newArea;
-					_update_area(framebuffer.area);
+					framebuffer.damageCount = 0; // anything left over was for the old position
+					framebuffer.drawnCount = 0;
+					changedArea = changedArea.include(newArea);
 				}
 
 				x = framebuffer.area.x2;
 			}
+
+			_resize_span_map();
+			_damage(changedArea);
 		}
 
 		void _update_background() {
-			_update_background_area(totalArea);
+			_damage(totalArea);
 		}
 
 		#pragma GCC push_options
@@ -555,125 +611,119 @@ namespace driver {
 			}
 		#endif
 
-		void _update_background_area(graphics2d::Rect screenRect) {
-			// mmio::PeripheralWriteGuard guard;
-
-			// debug::trace("update background area");
-
-			for(auto &framebuffer:framebuffers){
-				if(!framebuffer.buffer) continue;
+		#pragma GCC pop_options
 
-				// auto bpp = graphics2d::bufferFormat::size[(U8)framebuffer.buffer->format];
+		void _move_display_to(DisplayManager::Display &display, I32 x, I32 y, bool update) {
+			if(display.x==x&&display.y==y) return;
 
-				auto rect = screenRect.intersect(framebuffer.area);
+			const auto oldRect = graphics2d::Rect{display.x, display.y, display.x+(I32)display.get_width(), display.y+(I32)display.get_height()};
 
-				// debug::trace("paint background ", rect.y1, " to ", rect.y2);
+			display.x = x;
+			display.y = y;
 
-				for(auto y=rect.y1;y<rect.y2;y++){
-					// debug::trace("y = ", y, "\n");
-					auto startX = rect.x1;
-					while(startX<rect.x2){
-						auto endX = rect.x2;
-						auto nextX = startX;
-						for(auto display=displays.head; display; display=display->next){
-							if(!display->isVisible) continue;
+			if(display.isVisible){
+				_invalidate_spans(oldRect.y1, oldRect.y2);
+				_invalidate_display_spans(display);
+			}
 
-							auto viewArea = graphics2d::Rect{ display->x, display->y, display->x+(I32)display->get_width(), display->y+(I32)display->get_height() };
+			const auto area = graphics2d::Rect{display.x, display.y, display.x+(I32)display.get_width(), display.y+(I32)display.get_height()};
 
-							if(viewArea.y1>y||viewArea.y2<=y) continue;
+			if(display.isVisible){
+				// move what's already on screen, if we can, rather than compositing it all again
+				// (this must happen before the vacated area is damaged, as without a compositor thread that's redrawn immediately)
+				const auto isCopied = update&&_copy_moved_display(display, oldRect, area);
 
-							const auto areaX1 = viewArea.x1+(I32)display->get_left_margin(y-display->y);
-							const auto areaX2 = viewArea.x2-(I32)display->get_right_margin(y-display->y);
+				// old area above
+				if(area.y1>totalArea.y1) _damage(oldRect.intersect({totalArea.x1, totalArea.y1, totalArea.x2, area.y1}));
 
-							if(areaX1<=startX){
-								startX = maths::max(startX, areaX2);
-								if(startX>=endX) break;
+				// old area below
+				if(area.y2<totalArea.y2) _damage(oldRect.intersect({totalArea.x1, area.y2, totalArea.x2, totalArea.y2}));
 
-							}else if(areaX1<endX){
-								endX = areaX1;
-								nextX = maths::max(nextX, areaX2);
-							}
-						}
+				// old area to the left
+				if(area.x1>totalArea.x1) _damage(oldRect.intersect({totalArea.x1, area.y1, area.x1, area.y2}));
 
-						if(endX>startX){
-							#if defined(BACKGROUND_GRID)
-								const I32 edge = 64;
-								I32 x = startX;
-								for(;x<min(endX,edge);x++) {
-									const U32 fade = edge-x;
-									const U32 colour = (x/30+y/30)%2?windowBackgroundColour:backgroundColour2;
-									I32 r = max<I32>(0, ((colour>>16)&0xff)-fade/5);
-									I32 g = max<I32>(0, ((colour>> 8)&0xff)-fade/5);
-									I32 b = max<I32>(0, ((colour>> 0)&0xff)-fade/5);
-									framebuffer.set(x, y, r<<16|g<<8|b);
-								}
-								{
-									auto right = min(endX, (I32)totalArea.x2-(I32)edge);
-									while(x<right){
-										const U32 colour = (x/30+y/30)%2?windowBackgroundColour:backgroundColour2;
-										auto next = min(((x/30)+1)*30, right);
-										framebuffer.set(x, y, colour, next-x);
-										x = next;
-									}
-								}
-								for(;x<endX;x++) {
-									const U32 fade = edge-(totalArea.x2-x);
-									const U32 colour = (x/30+y/30)%2?windowBackgroundColour:backgroundColour2;
-									I32 r = max<I32>(0, ((colour>>16)&0xff)-fade/5);
-									I32 g = max<I32>(0, ((colour>> 8)&0xff)-fade/5);
-									I32 b = max<I32>(0, ((colour>> 0)&0xff)-fade/5);
-									framebuffer.set(x, y, r<<16|g<<8|b);
-								}
-
-							#elif defined(BACKGROUND_STRIP)
-								auto bgColour = _sample_background_strip_at(y);
-								framebuffer.buffer->set(startX-framebuffer.area.x1, y-framebuffer.area.y1, bgColour, endX-startX);
-							#endif
-						}
+				// old area to the right
+				if(area.x2<totalArea.x2) _damage(oldRect.intersect({area.x2, area.y1, totalArea.x2, area.y2}));
 
-						if(nextX>endX){
-							startX = nextX;
-						}else{
-							break;
-						}
-					}
+				if(update&&!isCopied){
+					_damage(area);
 				}
 			}
 		}
 
-		#pragma GCC pop_options
+		// the part of a display (in display coords) that fully covers what's below it, so on screen it's exactly the display's own pixels
+		auto _get_opaque_area(DisplayManager::Display &display) -> graphics2d::Rect {
+			if(display.mode!=DisplayManager::DisplayMode::solid) return {};
 
-		void _move_display_to(DisplayManager::Display &display, I32 x, I32 y, bool update) {
-			if(display.x==x&&display.y==y) return;
+			const auto area = display.solidArea.intersect({0, 0, (I32)display.get_width(), (I32)display.get_height()});
+			if(area.width()<1||area.height()<1) return {};
 
-			const auto oldRect = graphics2d::Rect{display.x, display.y, display.x+(I32)display.get_width(), display.y+(I32)display.get_height()};
+			// rounded corners cut into the rows they cover
+			U32 left = 0, right = 0;
+			auto include_margins = [&](I32 y1, I32 y2) {
+				for(auto y=max(y1, area.y1);y<min(y2, area.y2);y++){
+					left = max(left, display.get_left_margin(y));
+					right = max(right, display.get_right_margin(y));
+				}
+			};
+			include_margins(0, 16);
+			include_margins((I32)display.get_height()-16, (I32)display.get_height());
 
-			display.x = x;
-			display.y = y;
+			return area.cropped(left, 0, right, 0);
+		}
 
-			const auto area = graphics2d::Rect{display.x, display.y, display.x+(I32)display.get_width(), display.y+(I32)display.get_height()};
+		// copy the pixels of a moved display across on each framebuffer, damaging only what that can't cover
+		// returns false if this isn't possible, in which case it all needs compositing again
+		auto _copy_moved_display(DisplayManager::Display &display, graphics2d::Rect oldRect, graphics2d::Rect area) -> bool {
+			const auto opaqueArea = _get_opaque_area(display).offset(oldRect.x1, oldRect.y1);
+			if(opaqueArea.width()<1||opaqueArea.height()<1) return false;
 
-			if(display.isVisible){
-				// old area above
-				if(area.y1>totalArea.y1) _update_area(oldRect.intersect({totalArea.x1, totalArea.y1, totalArea.x2, area.y1}), &display);
+			for(auto &framebuffer:framebuffers){
+				if(!framebuffer.buffer) return false;
+			}
 
-				// old area below
-				if(area.y2<totalArea.y2) _update_area(oldRect.intersect({totalArea.x1, area.y2, totalArea.x2, totalArea.y2}), &display);
+			const auto offsetX = area.x1-oldRect.x1;
+			const auto offsetY = area.y1-oldRect.y1;
 
-				// old area to the left
-				if(area.x1>totalArea.x1) _update_area(oldRect.intersect({totalArea.x1, area.y1, area.x1, area.y2}), &display);
+			for(auto &framebuffer:framebuffers){
+				auto source = opaqueArea.intersect(framebuffer.area).intersect(framebuffer.area.offset(-offsetX, -offsetY));
+				auto dest = source.offset(offsetX, offsetY);
 
-				// old area to the right
-				if(area.x2<totalArea.x2) _update_area(oldRect.intersect({area.x2, area.y1, totalArea.x2, area.y2}), &display);
+				if(source.width()<1||source.height()<1||!framebuffer.driver->copy_rect(framebuffer.driverFramebuffer, source.offset(-framebuffer.area.x1, -framebuffer.area.y1), dest.x1-framebuffer.area.x1, dest.y1-framebuffer.area.y1)){
+					source = {};
+					dest = {};
+				}
+
+				// anything still waiting to be composited within the source was copied stale, so needs redoing where it landed
+				graphics2d::Rect pending[maxDamageRects];
+				const auto pendingCount = framebuffer.damageCount;
+				for(auto i=0u;i<pendingCount;i++){
+					pending[i] = framebuffer.damage[i];
+				}
+
+				for(auto i=0u;i<pendingCount;i++){
+					_add_damage(framebuffer, pending[i].intersect(source).offset(offsetX, offsetY));
+				}
 
-				auto newRect = graphics2d::Rect{display.x, display.y, display.x+(I32)display.get_width(), display.y+(I32)display.get_height()};
+				// displays above were copied along too, and now belong where they were, over the moved one
+				for(auto above=display.next;above;above=above->next){
+					if(!above->isVisible) continue;
 
-				if(update){
-					_update_area_solid(newRect, &display);
-					_update_display_area_solid(display, newRect.offset(-display.x, -display.y).intersect(display.solidArea));
-					_update_area_transparency(newRect);
+					const auto aboveRect = graphics2d::Rect{above->x, above->y, above->x+(I32)above->get_width(), above->y+(I32)above->get_height()};
+					_add_damage(framebuffer, aboveRect.intersect(dest));
+					_add_damage(framebuffer, aboveRect.intersect(source).offset(offsetX, offsetY));
 				}
+
+				// and anything of the new area that couldn't be copied (transparent edges, or previously offscreen)
+				_add_damage_excluding(framebuffer, area, dest);
+
+				_add_area(framebuffer.drawn, framebuffer.drawnCount, dest);
+				_count_written(framebuffer, dest);
 			}
+
+			_request_flush();
+
+			return true;
 		}
 
 		void _move_and_resize_display_to(DisplayManager::Display &display, graphics2d::Rect area) {
@@ -697,17 +747,20 @@ namespace driver {
 			display.y = area.y1;
 
 			if(display.isVisible){
+				_invalidate_spans(oldRect.y1, oldRect.y2);
+				_invalidate_display_spans(display);
+
 				// old area above
-				if(area.y1>totalArea.y1) _update_area(oldRect.intersect({totalArea.x1, totalArea.y1, totalArea.x2, area.y1}), &display);
+				if(area.y1>totalArea.y1) _damage(oldRect.intersect({totalArea.x1, totalArea.y1, totalArea.x2, area.y1}));
 
 				// old area below
-				if(area.y2<totalArea.y2) _update_area(oldRect.intersect({totalArea.x1, area.y2, totalArea.x2, totalArea.y2}), &display);
+				if(area.y2<totalArea.y2) _damage(oldRect.intersect({totalArea.x1, area.y2, totalArea.x2, totalArea.y2}));
 
 				// old area to the left
-				if(area.x1>totalArea.x1) _update_area(oldRect.intersect({totalArea.x1, area.y1, area.x1, area.y2}), &display);
+				if(area.x1>totalArea.x1) _damage(oldRect.intersect({totalArea.x1, area.y1, area.x1, area.y2}));
 
 				// old area to the right
-				if(area.x2<totalArea.x2) _update_area(oldRect.intersect({area.x2, area.y1, totalArea.x2, area.y2}), &display);
+				if(area.x2<totalArea.x2) _damage(oldRect.intersect({area.x2, area.y1, totalArea.x2, area.y2}));
 			}
 		}
 
@@ -728,8 +781,10 @@ namespace driver {
 			display.buffer.stride = width*bpp;
 
 			if(display.isVisible){
-				if(width<oldWidth) _update_area({display.x+(I32)display.get_width(), display.y, display.x+(I32)oldWidth, display.y+(I32)oldHeight}, &display);
-				if(height<oldHeight) _update_area({display.x, display.y+(I32)display.get_height(), display.x+(I32)oldWidth, display.y+(I32)oldHeight}, &display);
+				_invalidate_spans(display.y, display.y+(I32)max(height, oldHeight));
+
+				if(width<oldWidth) _damage({display.x+(I32)display.get_width(), display.y, display.x+(I32)oldWidth, display.y+(I32)oldHeight});
+				if(height<oldHeight) _damage({display.x, display.y+(I32)display.get_height(), display.x+(I32)oldWidth, display.y+(I32)oldHeight});
 			}
 		}
 
@@ -738,8 +793,8 @@ namespace driver {
 
 			display.layer = other.layer;
 			displays.insert_after(other, display);
-			_update_display_solid(display); //technically we only need to draw the parts that were previously obscured, oh well..
-			_update_area_transparency({display.x, display.y, display.x+(I32)display.get_width(), display.y+(I32)display.get_height()});
+			_invalidate_display_spans(display);
+			_damage({display.x, display.y, display.x+(I32)display.get_width(), display.y+(I32)display.get_height()}); //technically only the parts that were previously obscured need redrawing, oh well..
 		}
 
 		void _place_below(DisplayManager::Display &display, DisplayManager::Display &other) {
@@ -747,8 +802,8 @@ namespace driver {
 
 			display.layer = other.layer;
 			displays.insert_before(other, display);
-			_update_display_solid(display); //technically we only need to draw the parts that were previously obscured, oh well..
-			_update_area_transparency({display.x, display.y, display.x+(I32)display.get_width(), display.y+(I32)display.get_height()});
+			_invalidate_display_spans(display);
+			_damage({display.x, display.y, display.x+(I32)display.get_width(), display.y+(I32)display.get_height()}); //technically only the parts that were previously obscured need redrawing, oh well..
 		}
 
 		void _raise_display(DisplayManager::Display &display) {
@@ -771,8 +826,8 @@ namespace driver {
 
 			const auto rect = (graphics2d::Rect){display.x, display.y, display.x+(I32)display.get_width(), display.y+(I32)display.get_height()};
 
-			_update_display_solid(display); //technically we only need to draw the parts that were previously obscured, oh well..
-			_update_area_transparency(rect);
+			_invalidate_display_spans(display);
+			_damage(rect); //technically only the parts that were previously obscured need redrawing, oh well..
 		}
 
 		void _set_display_layer(DisplayManager::Display &display, DisplayManager::DisplayLayer layer) {
@@ -795,8 +850,8 @@ namespace driver {
 
 			const auto rect = (graphics2d::Rect){display.x, display.y, display.x+(I32)display.get_width(), display.y+(I32)display.get_height()};
 
-			_update_display_solid(display); //technically we only need to draw the parts that were previously obscured, oh well..
-			_update_area_transparency(rect);
+			_invalidate_display_spans(display);
+			_damage(rect); //technically only the parts that were previously obscured need redrawing, oh well..
 		}
 
 		auto _is_display_top(DisplayManager::Display &display) -> bool {
@@ -810,9 +865,10 @@ namespace driver {
 
 			const auto rect = (graphics2d::Rect){display.x, display.y, display.x+(I32)display.get_width(), display.y+(I32)display.get_height()};
 
+			_invalidate_display_spans(display);
+
 			if(update){
-				_update_display_solid(display);
-				_update_area_transparency(rect);
+				_damage(rect);
 			}
 		}
 
@@ -823,136 +879,210 @@ namespace driver {
 
 			const auto rect = (graphics2d::Rect){display.x, display.y, display.x+(I32)display.get_width(), display.y+(I32)display.get_height()};
 
-			_update_area(rect, &display);
+			_invalidate_display_spans(display);
+			_damage(rect);
 		}
 
-		inline void _update_display_solid(DisplayManager::Display &display) {
-			return _update_display_area_solid(display, display.solidArea);
-		};
+		auto _get_screen_buffer(U32 framebufferId, graphics2d::Rect rect) -> Optional<graphics2d::Buffer> {
+			if(framebufferId>=framebuffers.length) return {};
 
-		template <unsigned scale>
-		void __update_display_solid_area(DisplayManager::Display&, graphics2d::Rect);
+			if(!framebuffers[framebufferId].buffer) return {};
 
-		void _update_display_area_solid(DisplayManager::Display &display, graphics2d::Rect rect) {
-			if(!display.isVisible) return;
-			// if(display.mode==DisplayManager::DisplayMode::transparent) return; // this is handled by blended rendering, not directly, so abort here
+			return framebuffers[framebufferId].buffer->region(rect.x1, rect.y1, rect.width(), rect.height());
+		}
 
-			switch(display.scale){
-				case 1: __update_display_solid_area<1>(display, rect); break;
-				case 2: __update_display_solid_area<2>(display, rect); break;
-				case 3: __update_display_solid_area<3>(display, rect); break;
-				case 4: __update_display_solid_area<4>(display, rect); break;
+		// mark an area (in screen coords) as needing compositing
+		void _damage(graphics2d::Rect rect) {
+			if(rect.width()<1||rect.height()<1) return;
+
+			for(auto &framebuffer:framebuffers){
+				_add_damage(framebuffer, rect);
 			}
+
+			_request_flush();
 		}
 
-		#pragma GCC push_options
-		#pragma GCC optimize ("-O3")
-		template <unsigned scale>
-		void __update_display_solid_area(DisplayManager::Display &display, graphics2d::Rect displayRect) {
-			// mmio::PeripheralAccessGuard guard;
+		// have the damage composited, now if there's no compositor thread
+		void _request_flush() {
+			if(!compositorThread){
+				_flush_damage();
 
-			for(auto &framebuffer:framebuffers){
-				if(!framebuffer.buffer) continue;
+			}else if(compositorThread->state==Thread::State::paused){
+				compositorThread->resume();
+			}
+		}
+
+		void _add_damage(Framebuffer &framebuffer, graphics2d::Rect rect) {
+			rect = rect.intersect(framebuffer.area);
+			if(rect.width()<1||rect.height()<1) return;
+
+			_add_area(framebuffer.damage, framebuffer.damageCount, rect);
+		}
+
+		// add to the damage, except for the part within `exclude`
+		void _add_damage_excluding(Framebuffer &framebuffer, graphics2d::Rect rect, graphics2d::Rect exclude) {
+			exclude = exclude.intersect(rect);
+			if(exclude.width()<1||exclude.height()<1) return _add_damage(framebuffer, rect);
+
+			_add_damage(framebuffer, {rect.x1, rect.y1, rect.x2, exclude.y1});
+			_add_damage(framebuffer, {rect.x1, exclude.y2, rect.x2, rect.y2});
+			_add_damage(framebuffer, {rect.x1, exclude.y1, exclude.x1, exclude.y2});
+			_add_damage(framebuffer, {exclude.x2, exclude.y1, rect.x2, exclude.y2});
+		}
+
+		// add to a list of (non-overlapping) areas, such as the damage
+		void _add_area(graphics2d::Rect *areas, U32 &count, graphics2d::Rect rect) {
+			if(rect.width()<1||rect.height()<1) return;
+
+			if(!_add_area_from(areas, count, rect, 0)){
+				// too fragmented to be worth tracking separately, so collapse it all into one
+				auto bounds = rect;
+				for(auto i=0u;i<count;i++){
+					bounds = bounds.include(areas[i]);
+				}
+
+				areas[0] = bounds;
+				count = 1;
+			}
+		}
+
+		// add to a list of areas, checking against existing areas from `start` onwards (all before are known not to overlap)
+		// returns false if there wasn't room for it all
+		auto _add_area_from(graphics2d::Rect *areas, U32 &count, graphics2d::Rect rect, U32 start) -> bool {
+			for(auto i=start;i<count;i++){
+				const auto damage = areas[i];
+
+				if(rect.x1>=damage.x2||rect.x2<=damage.x1||rect.y1>=damage.y2||rect.y2<=damage.y1) continue;
+
+				// already covered
+				if(rect.x1>=damage.x1&&rect.x2<=damage.x2&&rect.y1>=damage.y1&&rect.y2<=damage.y2) return true;
+
+				// covers the existing, so drop that (swapping in the last, which we then check in its place)
+				if(damage.x1>=rect.x1&&damage.x2<=rect.x2&&damage.y1>=rect.y1&&damage.y2<=rect.y2){
+					areas[i--] = areas[--count];
+					continue;
+				}
 
-				auto bpp = graphics2d::bufferFormat::size[(U8)framebuffer.buffer->format];
+				// partially overlapping, so add just the parts outside of it - any above and below, then to the left and right within its rows
+				const auto y1 = max(rect.y1, damage.y1);
+				const auto y2 = min(rect.y2, damage.y2);
 
-				auto rect = displayRect
-					.intersect(display.solidArea)
-					.offset(display.x, display.y).intersect(framebuffer.area).offset(-display.x, -display.y)
+				return
+					(rect.y1>=damage.y1||_add_area_from(areas, count, {rect.x1, rect.y1, rect.x2, damage.y1}, i+1))&&
+					(rect.y2<=damage.y2||_add_area_from(areas, count, {rect.x1, damage.y2, rect.x2, rect.y2}, i+1))&&
+					(rect.x1>=damage.x1||_add_area_from(areas, count, {rect.x1, y1, damage.x1, y2}, i+1))&&
+					(rect.x2<=damage.x2||_add_area_from(areas, count, {damage.x2, y1, rect.x2, y2}, i+1))
 				;
+			}
 
-				for(auto y=rect.y1; y<rect.y2; y++){
-					auto startX = max(rect.x1, (I32)display.get_left_margin(y));
-					const auto x2 = min(rect.x2, (I32)display.get_width()-(I32)display.get_right_margin(y));
+			if(count>=maxDamageRects) return false;
 
-					while(startX<x2){
-						auto endX = x2;
-						auto nextX = startX;
-						for(auto displayAbove=display.next; displayAbove; displayAbove=displayAbove->next){
-							if(!displayAbove->isVisible) continue;
+			areas[count++] = rect;
+			return true;
+		}
 
-							auto aboveArea =
-								graphics2d::Rect{displayAbove->x, displayAbove->y, displayAbove->x+(I32)displayAbove->get_width(), displayAbove->y+(I32)displayAbove->get_height() }
-								.offset(-display.x, -display.y)
-							;
+		auto _has_damage() -> bool {
+			for(auto &framebuffer:framebuffers){
+				if(framebuffer.buffer&&framebuffer.damageCount>0) return true;
+			}
 
-							if(aboveArea.y1>y||aboveArea.y2<=y) continue;
+			return false;
+		}
 
-							const auto areaX1 = aboveArea.x1+(I32)displayAbove->get_left_margin(display.y+y-displayAbove->y);
-							const auto areaX2 = aboveArea.x2-(I32)displayAbove->get_right_margin(display.y+y-displayAbove->y);
+		// composite up to `flushRows` rows of a single damaged area, returning false if there was nothing left to
+		auto _flush_damage_slice() -> bool {
+			for(auto &framebuffer:framebuffers){
+				if(!framebuffer.buffer||framebuffer.damageCount<1) continue; // (if the buffer is changing we keep its damage for when it's back)
 
-							if(areaX1<=startX){
-								startX = max(startX, areaX2);
-								if(startX>=endX) break;
+				auto &damage = framebuffer.damage[framebuffer.damageCount-1];
+				auto rect = damage;
 
-							}else if(areaX1<endX){
-								if(areaX2<endX){ //does this display end before the next one starts again?
-									// if so, there's a gap between this display and the next blocking, so resume there
-									nextX = areaX2;
+				if(rect.height()>flushRows){
+					rect.y2 = rect.y1+flushRows;
+					damage.y1 = rect.y2;
+				}else{
+					framebuffer.damageCount--;
+				}
 
-								}else{
-									nextX = max(nextX, areaX2);
-								}
+				_update_area(rect);
+				return true;
+			}
 
-								endX = areaX1; // end drawing at the start of this display
-							}
+			return false;
+		}
 
-						}
+		void _flush_damage() {
+			while(_flush_damage_slice());
 
-						if(endX>startX){
-
-							// U8 *target = &framebuffer.buffer->address[((display.y+y)*framebuffer.buffer->width+display.x+startX)*bpp];
-							// U8 *source = &display.viewBuffer.address[((y/scale)*display.viewBuffer.width+startX/scale)*bpp];
-							// U32 length = (endX-startX)*bpp;
-							// if(source<display.viewBuffer.address||source+length>display.viewBuffer.address+display.viewBuffer.size){
-							// 	debug::trace("READ OUT OF BUFFER! ", source, " -> ", source+length, " vs ", display.viewBuffer.address, " -> ", display.viewBuffer.address+display.viewBuffer.size, "\n");
-							// }
-							// debug::trace(source, " -> ", source+length, "\n");
-							// memcpy_aligned(target, source, length);
-
-							if(scale==1){
-								U8 *target = &framebuffer.buffer->address[(display.y+y-framebuffer.area.y1)*framebuffer.buffer->stride+(display.x+startX-framebuffer.area.x1)*bpp];
-								U8 *source = &display.buffer.address[y*display.buffer.stride+startX*bpp];
-								U32 length = (endX-startX)*bpp;
-
-								// if(source<display.viewBuffer.address||source+length>display.viewBuffer.address+display.viewBuffer.size){
-								// 	debug::trace("READ OUT OF BUFFER! ", source, " -> ", source+length, " vs ", display.viewBuffer.address, " -> ", display.viewBuffer.address+display.viewBuffer.size, "\n");
-								// }
-								memcpy_aligned(target, source, length);
-
-							}else{
-								U8 *target = &framebuffer.buffer->address[(display.y+y-framebuffer.area.y1)*framebuffer.buffer->stride+(display.x+startX-framebuffer.area.x1)*bpp];
-								U8 *source = &display.buffer.address[(y/scale)*display.buffer.stride];
-
-								for(I32 x=startX;x<endX;x++){
-									U8 *sourceData = &source[(x/scale)*bpp]; 
-									for(unsigned i=0;i<bpp;i++){
-										// if(sourceData<display.viewBuffer.address||source>=display.viewBuffer.address+display.viewBuffer.size){
-										// 	debug::trace("READ OUT OF BUFFER! ", source, " vs ", display.viewBuffer.address, " -> ", display.viewBuffer.address+display.viewBuffer.size, "\n");
-										// }
-										*target++ = *sourceData++;
-									}
-								}
-							}
-						}
+			_present();
+		}
 
-						if(nextX>endX){
-							startX = nextX;
-						}else{
-							break;
-						}
-					}
+		// show everything composited so far
+		void _present() {
+			for(auto &framebuffer:framebuffers){
+				if(!framebuffer.buffer||framebuffer.drawnCount<1) continue;
+
+				for(auto i=0u;i<framebuffer.drawnCount;i++){
+					framebuffer.drawn[i] = framebuffer.drawn[i].offset(-framebuffer.area.x1, -framebuffer.area.y1);
 				}
+
+				const auto presentedBytes = framebuffer.driver->presentedBytes;
+
+				if(auto result = framebuffer.driver->present(framebuffer.driverFramebuffer, framebuffer.drawn, framebuffer.drawnCount); !result){
+					DisplayManager::log.print_error("Error: Unable to present framebuffer: ", result.errorMessage);
+				}
+
+				frameVramBytes += framebuffer.driver->presentedBytes-presentedBytes;
+				framebuffer.drawnCount = 0;
+			}
+
+			if(frameRamBytes||frameVramBytes){
+				frameStats.frameCount++;
+				frameStats.ramBytes += frameRamBytes;
+				frameStats.vramBytes += frameVramBytes;
+				frameStats.lastFrameRamBytes = frameRamBytes;
+				frameStats.lastFrameVramBytes = frameVramBytes;
+
+				frameRamBytes = 0;
+				frameVramBytes = 0;
 			}
 		}
-		#pragma GCC pop_options
 
-		auto _get_screen_buffer(U32 framebufferId, graphics2d::Rect rect) -> Optional<graphics2d::Buffer> {
-			if(framebufferId>=framebuffers.length) return {};
+		void _run_compositor() {
+			auto &thread = *scheduler->get_current_thread();
 
-			if(!framebuffers[framebufferId].buffer) return {};
+			while(true){
+				const auto frameStart = time::now();
 
-			return framebuffers[framebufferId].buffer->region(rect.x1, rect.y1, rect.width(), rect.height());
+				// composite everything damaged, a slice at a time
+				while(true){
+					Lock_Guard guard(lock);
+					if(!_flush_damage_slice()) break;
+				}
+
+				{
+					Lock_Guard guard(lock);
+
+					// and then show it all at once
+					_present();
+
+					// nothing more to do, so wait until something's damaged (which resumes us)
+					if(!_has_damage()){
+						thread.pause();
+					}
+				}
+
+				if(thread.state==Thread::State::active&&DisplayManager::instance.refreshRate){
+					const auto frameTime = 1'000'000/DisplayManager::instance.refreshRate;
+					const auto elapsed = time::now()-frameStart;
+
+					if(elapsed<frameTime){
+						thread.sleep(frameTime-elapsed);
+					}
+				}
+
+				scheduler->yield();
+			}
 		}
 
 		void _on_driver_event(const drivers::Event &event) {
@@ -974,7 +1104,7 @@ namespace driver {
 						framebuffers.push_back({
 							driver: graphics,
 							driverFramebuffer: i,
-							buffer: graphics->get_framebuffer(i)
+							buffer: graphics->get_back_buffer(i)
 						});
 					}
 
@@ -1021,7 +1151,7 @@ namespace driver {
 				case driver::Graphics::Event::Type::framebufferChanged:
 					for(auto &framebuffer:framebuffers){
 						if(framebuffer.driver==event.instance&&event.framebufferChanging.index==framebuffer.driverFramebuffer){
-							framebuffer.buffer = event.instance->get_framebuffer(event.framebufferChanged.index);
+							framebuffer.buffer = event.instance->get_back_buffer(event.framebufferChanged.index);
 							framebuffer.area.clear(); //invalidate
 
 							_update_framebuffer_positions();
@@ -1054,7 +1184,7 @@ namespace driver {
 				framebuffers.push_back({
 					driver: &graphics,
 					driverFramebuffer: i,
-					buffer: graphics.get_framebuffer(i)
+					buffer: graphics.get_back_buffer(i)
 				});
 			}
 		}
@@ -1068,6 +1198,19 @@ namespace driver {
 		drivers::events.subscribe(_on_driver_event);
 		driver::Graphics::allEvents.subscribe(_on_graphics_event);
 
+		if(!compositorThread){
+			scheduler = drivers::find_and_activate<driver::Scheduler>(this);
+
+			if(scheduler){
+				auto &process = process::create_kernel("display compositor");
+				compositorThread = &process.create_kernel_thread(_run_compositor);
+				scheduler->add_thread(*compositorThread);
+
+			}else{
+				log.print_warning("No scheduler available - compositing immediately on update");
+			}
+		}
+
 		return {};
 	}
 
@@ -1079,6 +1222,8 @@ namespace driver {
 	}
 
 	/**/ DisplayManager::Display::~Display() {
+		Lock_Guard guard(lock); // (held throughout, so the compositor can't be part way through drawing us)
+
 		graphics2d::Rect area;
 
 		{
@@ -1096,7 +1241,8 @@ namespace driver {
 			displays.pop(*this);
 		}
 
-		_update_area(area);
+		_invalidate_spans(area.y1, area.y2);
+		_damage(area);
 	}
 
 	void DisplayManager::set_background_colour(U32 colour) {
@@ -1150,6 +1296,15 @@ namespace driver {
 		return _get_screen_buffer(framebufferId, rect);
 	}
 
+	auto DisplayManager::get_screen_framebuffer(U32 framebufferId) -> graphics2d::Buffer* {
+		Lock_Guard guard(lock);
+
+		if(framebufferId>=framebuffers.length) return nullptr;
+
+		auto &framebuffer = framebuffers[framebufferId];
+		return framebuffer.driver->get_framebuffer(framebuffer.driverFramebuffer);
+	}
+
 	auto DisplayManager::get_screen_area(U32 framebufferId) -> graphics2d::Rect {
 		Lock_Guard guard(lock);
 
@@ -1161,7 +1316,7 @@ namespace driver {
 	void DisplayManager::update_area(graphics2d::Rect rect, Display *below) {
 		Lock_Guard guard(lock);
 
-		_update_area(rect, below);
+		_damage(rect);
 	}
 
 	void DisplayManager::update_background() {
@@ -1173,7 +1328,7 @@ namespace driver {
 	void DisplayManager::update_background_area(graphics2d::Rect rect) {
 		Lock_Guard guard(lock);
 
-		return _update_background_area(rect);
+		return _damage(rect);
 	}
 
 	void DisplayManager::Display::move_to(I32 x, I32 y, bool update) {
@@ -1241,15 +1396,17 @@ namespace driver {
 
 		if(!isVisible) return;
 
-		_update_display_solid(*this);
-		_update_area_transparency(graphics2d::Rect{x, y, x+(I32)get_width(), y+(I32)get_height()});
+		_invalidate_display_spans(*this); // (in case its solid area or corners have changed)
+		_damage(graphics2d::Rect{x, y, x+(I32)get_width(), y+(I32)get_height()});
 	}
 
 	void DisplayManager::Display::update_area(graphics2d::Rect rect) {
 		Lock_Guard guard(lock);
 
-		_update_display_area_solid(*this, rect.intersect(solidArea));
-		_update_area_transparency(rect.offset(x, y)); //TODO: avoid unneccasary redraws here if this area is obscured
+		if(!isVisible) return;
+
+		_invalidate_spans(y+rect.y1, y+rect.y2);
+		_damage(rect.intersect({0, 0, (I32)get_width(), (I32)get_height()}).offset(x, y)); //TODO: avoid unneccasary redraws here if this area is obscured
 	}
 
 	auto DisplayManager::get_width() -> U32 {
@@ -1259,4 +1416,10 @@ namespace driver {
 	auto DisplayManager::get_height() -> U32 {
 		return totalArea.height();
 	}
+
+	auto DisplayManager::get_frame_stats() -> FrameStats {
+		Lock_Guard guard(lock);
+
+		return frameStats;
+	}
 }
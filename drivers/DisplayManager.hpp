@@ -13,7 +13,7 @@
 namespace driver {
 	//TODO: should graphics drivers also include an api for querying their active processor(s) drivers if present? This would allow us to work out what processor speeds and temps relate to this graphics adapter, which might be useful/neat
 	struct DisplayManager: Software {
-		DRIVER_INSTANCE(DisplayManager, 0xdc52bf38, "display", "DisplayManager", Software);
+		DRIVER_INSTANCE(DisplayManager, 0x69c2e4b5, "display", "DisplayManager", Software);
 		
 		auto _on_start() -> Try<> override;
 		auto _on_stop() -> Try<> override;
@@ -30,6 +30,9 @@ namespace driver {
 
 		EventEmitter<Event> events;
 
+		// updates only mark areas as damaged. These are composited to the screen by a separate thread, at most this many times a second (or as fast as possible if 0)
+		U32 refreshRate = 60;
+
 		enum struct DisplayMode {
 			solid
 		};
@@ -127,11 +130,23 @@ namespace driver {
 
 		auto get_display_at(I32 x, I32 y, bool includeNonInteractive, Display *below = nullptr, I32 margin = 0) -> Display*;
 		auto get_screen_count() -> U32;
-		auto get_screen_buffer(U32 framebuffer) -> graphics2d::Buffer*; // this may be missing while the framebuffer is changing
-		auto get_screen_buffer(U32 framebuffer, graphics2d::Rect rect) -> Optional<graphics2d::Buffer>; // this may be missing while the framebuffer is changing
+		auto get_screen_buffer(U32 framebuffer) -> graphics2d::Buffer*; // the back buffer composited to. This may be missing while the framebuffer is changing
+		auto get_screen_buffer(U32 framebuffer, graphics2d::Rect rect) -> Optional<graphics2d::Buffer>; // a region of the back buffer. This may be missing while the framebuffer is changing
+		auto get_screen_framebuffer(U32 framebuffer) -> graphics2d::Buffer*; // the live framebuffer itself, for drawing outside of the compositor (e.g on panic). Anything drawn here is overwritten whenever that area is next presented
 		auto get_screen_area(U32 framebuffer) -> graphics2d::Rect;
 
 		auto get_width() -> U32;
 		auto get_height() -> U32;
+
+		// how much is written per frame, to ram (composited to back buffers) and to video memory (presented, or composited directly if there's no back buffer)
+		struct FrameStats {
+			U64 frameCount = 0;
+			U64 ramBytes = 0;
+			U64 vramBytes = 0;
+			U64 lastFrameRamBytes = 0;
+			U64 lastFrameVramBytes = 0;
+		};
+
+		auto get_frame_stats() -> FrameStats;
 	};
 }
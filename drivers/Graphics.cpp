@@ -65,4 +65,68 @@ namespace driver {
 			return Failure{"Could not find matching suitable mode"};
 		}
 	}
+
+	auto Graphics::copy_rect(U32 framebufferId, graphics2d::Rect source, I32 x, I32 y) -> Try<> {
+		auto buffer = get_back_buffer(framebufferId);
+		if(!buffer) return Failure{"Framebuffer not available"};
+
+		buffer->copy_rect(source, x, y);
+
+		return {};
+	}
+
+	auto Graphics::get_back_buffer(U32 framebufferId) -> graphics2d::Buffer* {
+		auto framebuffer = get_framebuffer(framebufferId);
+		if(!framebuffer) return nullptr;
+
+		// no room for a shadow, so just draw directly
+		if(framebufferId>=maxShadowBuffers) return framebuffer;
+
+		auto &shadow = shadowBuffers[framebufferId];
+
+		if(!shadow.address||shadow.width!=framebuffer->width||shadow.height!=framebuffer->height||shadow.format!=framebuffer->format||shadow.order!=framebuffer->order){
+			delete[] shadow.address;
+
+			const auto stride = framebuffer->width*graphics2d::bufferFormat::size[(U8)framebuffer->format];
+			shadow = {new U8[stride*framebuffer->height], stride, framebuffer->width, framebuffer->height, framebuffer->format, framebuffer->order};
+
+			if(!shadow.address){
+				log.print_warning("Warning: Unable to allocate a back buffer for ", get_framebuffer_name(framebufferId), ", drawing directly instead");
+				shadow = {};
+				return framebuffer;
+			}
+
+			bzero(shadow.address, stride*shadow.height);
+		}
+
+		return &shadow;
+	}
+
+	auto Graphics::present(U32 framebufferId, const graphics2d::Rect *areas, U32 count) -> Try<> {
+		auto framebuffer = get_framebuffer(framebufferId);
+		if(!framebuffer) return Failure{"Framebuffer not available"};
+
+		auto back = get_back_buffer(framebufferId);
+		if(!back||back==framebuffer) return {}; // already drawn directly
+
+		_copy_areas(*framebuffer, *back, areas, count);
+
+		return {};
+	}
+
+	void Graphics::_copy_areas(graphics2d::Buffer &dest, graphics2d::Buffer &source, const graphics2d::Rect *areas, U32 count) {
+		const auto bpp = graphics2d::bufferFormat::size[(U8)source.format];
+		const auto bounds = graphics2d::Rect{0, 0, (I32)min(source.width, dest.width), (I32)min(source.height, dest.height)};
+
+		for(auto i=0u;i<count;i++){
+			const auto area = areas[i].intersect(bounds);
+			if(area.width()<1||area.height()<1) continue;
+
+			for(auto y=area.y1;y<area.y2;y++){
+				memcpy(&dest.address[y*dest.stride+area.x1*bpp], &source.address[y*source.stride+area.x1*bpp], area.width()*bpp);
+			}
+
+			presentedBytes += (U64)area.width()*area.height()*bpp;
+		}
+	}
 }
@@ -10,7 +10,7 @@
 namespace driver {
 	//TODO: should graphics drivers also include an api for querying their active processor(s) drivers if present? This would allow us to work out what processor speeds and temps relate to this graphics adapter, which might be useful/neat
 	struct Graphics: Hardware {
-		DRIVER_TYPE(Graphics, 0x2d7d3b85, "graphics", "Graphics Hardware", Hardware);
+		DRIVER_TYPE(Graphics, 0x6a1c94e2, "graphics", "Graphics Hardware", Hardware);
 
 		struct Mode {
 			U32 width;
@@ -51,5 +51,24 @@ namespace driver {
 		virtual auto get_framebuffer_count() -> U32 = 0;
 		virtual auto get_framebuffer(U32 index) -> graphics2d::Buffer* = 0; // these may temporarily be null when switching mode - This is expected. Assume they are still valid screenspace, just don't render to them while nullptr
 		virtual auto get_framebuffer_name(U32 index) -> const char* = 0;
+
+		// copy an area of a framebuffer's back buffer to another position within it (clipped to the buffer). The two may overlap
+		// drivers with a blitter that can reach their back buffer can override this to do so in hardware. By default it's done in software
+		virtual auto copy_rect(U32 framebufferId, graphics2d::Rect source, I32 x, I32 y) -> Try<>;
+
+		// double buffering
+		// draw into the back buffer, and then present() the areas changed to have them shown. The back buffer is in regular (cached) memory, so unlike the framebuffer it's quick to read back from
+		// by default the back buffer is a shadow in ram, with presented areas copied across. Drivers that can flip between pages of video memory override present() to do so, avoiding tearing
+		virtual auto get_back_buffer(U32 framebufferId) -> graphics2d::Buffer*; // as with get_framebuffer(), this may temporarily be null when switching mode
+		virtual auto present(U32 framebufferId, const graphics2d::Rect *areas, U32 count) -> Try<>;
+
+		U64 presentedBytes = 0; // written to video memory by present(), for measuring how much bandwidth the compositor needs
+
+	protected:
+		static const U32 maxShadowBuffers = 4;
+		graphics2d::Buffer shadowBuffers[maxShadowBuffers];
+
+		// copy areas from a buffer (generally the shadow) to another of the same size and format
+		void _copy_areas(graphics2d::Buffer &dest, graphics2d::Buffer &source, const graphics2d::Rect *areas, U32 count);
 	};
 }
@@ -6,13 +6,16 @@ struct Thread;
 
 namespace driver {
 	struct Scheduler: Software {
-		DRIVER_TYPE(Scheduler, 0xc35897a, "scheduler", "Thread Scheduler", Software)
+		DRIVER_TYPE(Scheduler, 0x4e1b27d9, "scheduler", "Thread Scheduler", Software)
 
 		virtual void add_thread(Thread&) = 0;
 		virtual void remove_thread(Thread&) = 0;
 		virtual auto get_current_thread() -> Thread* = 0;
 		virtual void yield() = 0;
 
+		// join the calling processor to scheduling, once the arch has brought it up. The calling context becomes its idle thread, and should keep calling yield() from then on (as the boot processor does)
+		virtual auto start_processor() -> Try<> = 0;
+
 		virtual void _on_thread_sleep(Thread&, U32 usecs) = 0;
 		virtual void _on_thread_paused(Thread&) = 0;
 		virtual void _on_thread_paused_resumed(Thread&) = 0;
@@ -0,0 +1,212 @@
+#include "StorageController.hpp"
+
+#include <drivers/Scheduler.hpp>
+
+#include <kernel/drivers.hpp>
+#include <kernel/Thread.hpp>
+
+namespace driver {
+	auto StorageController::Request::wait() -> Try<> {
+		auto scheduler = drivers::find_active<driver::Scheduler>();
+		auto thread = scheduler?scheduler->get_current_thread():nullptr;
+
+		while(true){
+			if(thread){
+				{
+					// (checked under the lock, so that completion can't slip in between checking and pausing)
+					Lock_Guard guard(controller->requestLock);
+					if(isComplete) break;
+
+					waitingThread = thread;
+					thread->pause();
+				}
+
+				scheduler->yield();
+
+			}else{
+				if(isComplete) break;
+				asm volatile("" ::: "memory");
+			}
+		}
+
+		waitingThread = nullptr;
+
+		return get_result();
+	}
+
+	auto StorageController::submit_request(Request &request) -> Try<> {
+		if(request.count<1) return Failure{"empty request"};
+		if(!request.buffer) return Failure{"no buffer"};
+		if(!does_drive_exist(request.drive)) return Failure{"drive not present"};
+
+		request.controller = this;
+		request.merged = nullptr;
+		request.waitingThread = nullptr;
+		request.errorMessage = nullptr;
+		request.isComplete = false;
+
+		// if too many are in flight, help out by transferring some ourselves until there's room
+		while(true){
+			{
+				Lock_Guard guard(requestLock);
+				if(queuedCount<maxQueueDepth) break;
+			}
+
+			if(!_process_requests(request.drive)){
+				if(auto scheduler = drivers::find_active<driver::Scheduler>()){
+					scheduler->yield();
+				}
+			}
+		}
+
+		bool isPickedUp;
+
+		{
+			Lock_Guard guard(requestLock);
+
+			auto queue = _get_drive_queue(request.drive);
+			if(!queue){
+				queue = &driveQueues.push_back(request.drive, LList<Request>{}, 0);
+			}
+
+			// keep them sorted by sector (after any others at the same one, so those stay in order)
+			auto after = queue->requests.tail;
+			while(after&&after->sector>request.sector) after = after->prev;
+
+			if(after){
+				queue->requests.insert_after(*after, request);
+			}else{
+				queue->requests.push_front(request);
+			}
+
+			queuedCount++;
+
+			isPickedUp = _on_request_queued(request.drive);
+		}
+
+		if(!isPickedUp){
+			_process_requests(request.drive);
+		}
+
+		return {};
+	}
+
+	auto StorageController::read_drive_sectors(U32 drive, U64 sector, U32 count, void *buffer) -> Try<> {
+		Request request;
+		request.type = Request::Type::read;
+		request.drive = drive;
+		request.sector = sector;
+		request.count = count;
+		request.buffer = (U8*)buffer;
+
+		TRY(submit_request(request));
+
+		return request.wait();
+	}
+
+	auto StorageController::write_drive_sectors(U32 drive, U64 sector, U32 count, const void *buffer) -> Try<> {
+		Request request;
+		request.type = Request::Type::write;
+		request.drive = drive;
+		request.sector = sector;
+		request.count = count;
+		request.buffer = (U8*)buffer;
+
+		TRY(submit_request(request));
+
+		return request.wait();
+	}
+
+	auto StorageController::get_queued_request_count() -> U32 {
+		Lock_Guard guard(requestLock);
+
+		return queuedCount;
+	}
+
+	auto StorageController::_next_request(U32 drive) -> Request* {
+		Lock_Guard guard(requestLock);
+
+		auto queue = _get_drive_queue(drive);
+		if(!queue||!queue->requests.head) return nullptr;
+
+		// carry on sweeping upwards from where we got to, and once at the end go back round to the lowest sector
+		auto request = queue->requests.head;
+		while(request&&request->sector<queue->position) request = request->next;
+		if(!request) request = queue->requests.head;
+
+		auto next = request->next;
+		queue->requests.pop(*request);
+		request->merged = nullptr;
+
+		// and take any requests continuing on from it with it
+		auto last = request;
+		auto count = request->count;
+
+		while(next){
+			if(next->sector!=last->sector+last->count) break;
+			if(next->type!=request->type||count+next->count>maxMergedSectors) break;
+
+			auto following = next->next;
+			queue->requests.pop(*next);
+			next->merged = nullptr;
+			last->merged = next;
+			last = next;
+			count += next->count;
+			next = following;
+		}
+
+		queue->position = request->sector+count;
+
+		return request;
+	}
+
+	auto StorageController::_has_requests(U32 drive) -> bool {
+		auto queue = _get_drive_queue(drive);
+		return queue&&queue->requests.head;
+	}
+
+	void StorageController::_complete_request(Request &request, Try<> result) {
+		for(auto part=&request;part;){
+			const auto next = part->merged;
+
+			part->errorMessage = result.errorMessage;
+
+			// (before it's marked as complete, as a waiter may then destroy it)
+			if(part->onComplete){
+				part->onComplete(*part, part->onCompleteData);
+			}
+
+			{
+				Lock_Guard guard(requestLock);
+
+				part->isComplete = true;
+				queuedCount--;
+
+				if(auto thread = part->waitingThread){
+					thread->resume();
+				}
+			}
+
+			part = next;
+		}
+	}
+
+	auto StorageController::_process_requests(U32 drive) -> bool {
+		auto processed = false;
+
+		while(auto request = _next_request(drive)){
+			_complete_request(*request, _transfer(*request));
+			processed = true;
+		}
+
+		return processed;
+	}
+
+	auto StorageController::_get_drive_queue(U32 drive) -> DriveQueue* {
+		for(auto &queue:driveQueues){
+			if(queue.drive==drive) return &queue;
+		}
+
+		return nullptr;
+	}
+}
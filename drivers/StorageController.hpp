@@ -2,11 +2,17 @@
 
 #include <drivers/Hardware.hpp>
 
+#include <kernel/Lock.hpp>
+
+#include <common/LList.hpp>
+#include <common/PodArray.hpp>
 #include <common/Try.hpp>
 
+struct Thread;
+
 namespace driver {
 	struct StorageController: Hardware {
-		DRIVER_TYPE(StorageController, 0x83f29031, "storageController", "Storage controller", Hardware);
+		DRIVER_TYPE(StorageController, 0x1d6c58f3, "storageController", "Storage controller", Hardware);
 
 		virtual auto get_drive_count() -> U32 = 0;
 		virtual auto get_drive_id(U32) -> U32 = 0;
@@ -20,5 +26,76 @@ namespace driver {
 		virtual auto is_drive_present(U32) -> Try<bool> = 0;
 		virtual auto is_drive_removable(U32) -> Try<bool> = 0;
 		virtual auto eject_drive(U32) -> Try<bool> = 0;
+
+		virtual auto get_drive_sectorSize(U32) -> Try<U32> = 0;
+
+		// a block transfer, queued until the drive gets to it
+		// requests in flight together aren't ordered against each other (they're sorted by sector), so wait on any that later ones depend on
+		struct Request: LListItem<Request> {
+			enum struct Type: U8 {
+				read,
+				write
+			};
+
+			Type type = Type::read;
+			U32 drive = 0; // the controller's drive id
+			U64 sector = 0;
+			U32 count = 0;
+			U8 *buffer = nullptr; // count*sectorSize bytes
+
+			// called once transferred, from whichever thread transferred it, just before it's marked as complete. The request mustn't be reused or destroyed until it is
+			void (*onComplete)(Request&, void *data) = nullptr;
+			void *onCompleteData = nullptr;
+
+			auto is_complete() -> bool { return isComplete; }
+			auto get_result() -> Try<> { return errorMessage?Try<>{Failure{errorMessage}}:Try<>{}; }
+			auto wait() -> Try<>; // blocks until complete
+
+			// set by the controller
+			StorageController *controller = nullptr;
+			Request *merged = nullptr; // following requests merged onto the end of this one, transferred with it as a single run of sectors
+			Thread *waitingThread = nullptr;
+			const char *errorMessage = nullptr;
+			volatile bool isComplete = false;
+		};
+
+		static const U32 maxQueueDepth = 32; // requests queued per controller, beyond which submitting transfers queued ones itself
+		static const U32 maxMergedSectors = 256; // requests aren't merged into transfers longer than this
+
+		// the request must remain valid until complete, after which the controller no longer touches it
+		auto submit_request(Request&) -> Try<>;
+
+		// buffers must be sectorSize*count bytes long
+		auto read_drive_sectors(U32, U64 sector, U32 count, void *buffer) -> Try<>;
+		auto write_drive_sectors(U32, U64 sector, U32 count, const void *buffer) -> Try<>;
+
+		auto get_queued_request_count() -> U32;
+
+	protected:
+		struct DriveQueue {
+			U32 drive;
+			LList<Request> requests; // sorted by sector
+			U64 position; // where the elevator got to
+		};
+
+		Lock<LockType::flat> requestLock;
+		PodArray<DriveQueue> driveQueues;
+		U32 queuedCount = 0; // including those being transferred
+
+		// transfer a request, along with any merged onto it (the lot covering a single run of sectors)
+		virtual auto _transfer(Request&) -> Try<> { return Failure{"not supported"}; }
+
+		// called with the request lock held once a request is queued. Return true if something will pick it up (e.g. by waking a thread to), otherwise the submitter transfers it immediately
+		virtual auto _on_request_queued(U32 drive) -> bool { return false; }
+
+		// take the next request for a drive in elevator order, with following contiguous ones merged onto it
+		auto _next_request(U32 drive) -> Request*;
+		auto _has_requests(U32 drive) -> bool; // must have the request lock held
+		void _complete_request(Request&, Try<> result);
+
+		// transfer requests queued for a drive, until there are none left. Returns whether any were
+		auto _process_requests(U32 drive) -> bool;
+
+		auto _get_drive_queue(U32 drive) -> DriveQueue*;
 	};
 }
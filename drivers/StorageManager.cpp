@@ -1,7 +1,14 @@
 #include "StorageManager.hpp"
 
+#include <drivers/Scheduler.hpp>
 #include <drivers/StorageController.hpp>
 
+#include <kernel/drivers.hpp>
+#include <kernel/memory.hpp>
+#include <kernel/Process.hpp>
+#include <kernel/Thread.hpp>
+
+#include <common/maths.hpp>
 #include <common/String.hpp>
 #include <common/ListOrdered.hpp>
 #include <common/ListUnordered.hpp>
@@ -25,9 +32,582 @@ namespace driver {
 		PodArray<Drive> drives;
 
 		Lock<LockType::flat> lock;
+
+		driver::Scheduler *scheduler = nullptr;
+		Thread *flushThread = nullptr;
+
+		void wait_a_moment() {
+			if(scheduler){
+				scheduler->yield();
+			}else{
+				asm("pause");
+			}
+		}
+
+		// block cache
+		// drive contents are cached a block (page) at a time, keyed by controller drive and block number. Entries are found through a hash table, and replaced in CLOCK order
+		// writes are held in the cache, and written back by flush_cache() (periodically, if there's a scheduler)
+		namespace cache {
+			const auto blockSize = (U32)memory::pageSize;
+			#ifdef STORAGE_CACHE_FRACTION
+				const auto memoryFraction = (U32)STORAGE_CACHE_FRACTION; // of total memory, to use for the cache
+			#else
+				const auto memoryFraction = 32u;
+			#endif
+			const auto minBlocks = 64u;
+			const auto maxBatch = 32u; // blocks handled at once within a read or write
+			const auto readAheadBlocks = 8u;
+			const auto maxStreams = 8u; // sequential readers tracked for read-ahead
+			const auto flushInterval = 2u*1000u*1000u; // usecs
+
+			const U32 none = ~0u;
+
+			struct Entry {
+				StorageController *controller = nullptr;
+				U32 drive = 0;
+				U64 block = 0;
+				U32 sectorCount = 0; // sectors held (fewer than a whole block at the end of a drive)
+				U8 *data = nullptr;
+
+				U32 nextInBucket = none;
+				U32 pins = 0; // in use by a read or write, so not to be replaced
+				bool isHashed = false;
+				bool isValid = false; // holds the data
+				bool isBusy = false; // being transferred to or from the drive
+				bool isDirty = false; // written to, but not yet written back
+				bool isReferenced = false; // used since the clock hand last passed
+
+				StorageController::Request request;
+			};
+
+			// a sequential reader, for detecting when to read ahead
+			struct Stream {
+				StorageController *controller = nullptr;
+				U32 drive = 0;
+				U64 nextBlock = 0;
+				U32 sequentialCount = 0;
+			};
+
+			Lock<LockType::flat> lock;
+
+			Entry *entries = nullptr;
+			U32 entryCount = 0;
+			U32 *buckets = nullptr;
+			U32 bucketMask = 0;
+			U32 clockHand = 0;
+
+			Stream streams[maxStreams];
+			U32 nextStream = 0;
+
+			StorageManager::CacheStats stats = {};
+
+			void init() {
+				if(entries) return;
+
+				auto blocks = maths::max((U32)(memory::totalMemory/memoryFraction/blockSize), minBlocks);
+
+				U8 *data = nullptr;
+				for(;blocks>=minBlocks;blocks/=2){
+					if((data = (U8*)memory::Transaction().allocate_pages(blocks))) break;
+				}
+
+				if(!data){
+					StorageManager::log.print_warning("Warning: unable to allocate the block cache - drives will be accessed uncached");
+					return;
+				}
+
+				U32 bucketCount = 1;
+				while(bucketCount<blocks) bucketCount <<= 1;
+
+				buckets = new U32[bucketCount];
+				for(auto i=0u;i<bucketCount;i++) buckets[i] = none;
+				bucketMask = bucketCount-1;
+
+				entries = new Entry[blocks];
+				for(auto i=0u;i<blocks;i++){
+					entries[i].data = data+i*blockSize;
+				}
+				entryCount = blocks;
+
+				stats.blockSize = blockSize;
+				stats.blockCount = blocks;
+
+				StorageManager::log.print_info("block cache of ", blocks*blockSize/1024, "KiB");
+			}
+
+			auto get_bucket(StorageController &controller, U32 drive, U64 block) -> U32& {
+				auto hash = (U64)(UPtr)&controller*0x9e3779b97f4a7c15ull^(U64)drive*0xc2b2ae3d27d4eb4full^block*0x165667b19e3779f9ull;
+				hash ^= hash>>29;
+				return buckets[hash&bucketMask];
+			}
+
+			auto find(StorageController &controller, U32 drive, U64 block) -> Entry* {
+				for(auto index=get_bucket(controller, drive, block);index!=none;index=entries[index].nextInBucket){
+					auto &entry = entries[index];
+					if(entry.block==block&&entry.drive==drive&&entry.controller==&controller) return &entry;
+				}
+
+				return nullptr;
+			}
+
+			void unhash(Entry &entry) {
+				if(!entry.isHashed) return;
+
+				auto *link = &get_bucket(*entry.controller, entry.drive, entry.block);
+				while(*link!=none&&&entries[*link]!=&entry) link = &entries[*link].nextInBucket;
+				if(*link!=none) *link = entry.nextInBucket;
+
+				entry.nextInBucket = none;
+				entry.isHashed = false;
+			}
+
+			void hash(Entry &entry) {
+				auto &bucket = get_bucket(*entry.controller, entry.drive, entry.block);
+				entry.nextInBucket = bucket;
+				bucket = &entry-entries;
+				entry.isHashed = true;
+			}
+
+			// find an entry to reuse, giving those used since the hand last passed a second chance. Dirty ones are left for the flush to write back
+			// neither transferring nor still held by the controller (which it is until the request is complete, even after the completion callback). Must have the lock held
+			auto is_idle(Entry &entry) -> bool {
+				return !entry.isBusy&&(!entry.request.controller||entry.request.is_complete());
+			}
+
+			auto claim_victim(bool &skippedDirty) -> Entry* {
+				skippedDirty = false;
+
+				for(auto i=0u;i<entryCount*2;i++){
+					auto &entry = entries[clockHand];
+					clockHand = (clockHand+1)%entryCount;
+
+					if(!is_idle(entry)||entry.pins) continue;
+
+					if(entry.isDirty){
+						skippedDirty = true;
+						continue;
+					}
+
+					if(entry.isReferenced){
+						entry.isReferenced = false;
+						continue;
+					}
+
+					if(entry.isHashed){
+						stats.evictions++;
+						unhash(entry);
+					}
+
+					entry.isValid = false;
+					return &entry;
+				}
+
+				return nullptr;
+			}
+
+			void on_loaded(StorageController::Request &request, void *data) {
+				auto &entry = *(Entry*)data;
+
+				Lock_Guard guard(lock);
+
+				if(request.errorMessage){
+					unhash(entry);
+					entry.isValid = false;
+				}else{
+					entry.isValid = true;
+				}
+
+				entry.isBusy = false;
+			}
+
+			void on_written(StorageController::Request &request, void *data) {
+				auto &entry = *(Entry*)data;
+
+				Lock_Guard guard(lock);
+
+				if(request.errorMessage){
+					entry.isDirty = true; // (try again on the next flush)
+					stats.writeErrors++;
+				}else{
+					stats.writeBacks++;
+				}
+
+				entry.isBusy = false;
+			}
+
+			void prepare_request(Entry &entry, StorageController::Request::Type type, U32 sectorsPerBlock) {
+				auto &request = entry.request;
+				request.type = type;
+				request.drive = entry.drive;
+				request.sector = entry.block*sectorsPerBlock;
+				request.count = entry.sectorCount;
+				request.buffer = entry.data;
+				request.onComplete = type==StorageController::Request::Type::read?on_loaded:on_written;
+				request.onCompleteData = &entry;
+			}
+
+			// claim an entry for a block not yet cached, marked as busy loading. Must have the lock held
+			auto start_load(StorageController &controller, U32 drive, U64 block, U32 sectorCount) -> Entry* {
+				bool skippedDirty;
+				auto entry = claim_victim(skippedDirty);
+				if(!entry) return nullptr;
+
+				entry->controller = &controller;
+				entry->drive = drive;
+				entry->block = block;
+				entry->sectorCount = sectorCount;
+				entry->isBusy = true;
+				entry->isReferenced = true;
+				hash(*entry);
+
+				return entry;
+			}
+
+			void submit_load(Entry &entry, U32 sectorsPerBlock) {
+				prepare_request(entry, StorageController::Request::Type::read, sectorsPerBlock);
+
+				if(auto result = entry.controller->submit_request(entry.request); !result){
+					// (never queued, so complete it ourselves)
+					entry.request.errorMessage = result.errorMessage;
+					entry.request.isComplete = true;
+					on_loaded(entry.request, &entry);
+				}
+			}
+
+			// if this continues on from a previous read, start loading the blocks following it
+			void read_ahead(StorageController &controller, U32 drive, U64 firstBlock, U64 lastBlock, U64 blockCount, U32 sectorsPerBlock, U64 driveSectors) {
+				Entry *loads[readAheadBlocks];
+				U32 loadCount = 0;
+
+				{
+					Lock_Guard guard(cache::lock);
+
+					Stream *stream = nullptr;
+					for(auto &existing:streams){
+						if(existing.controller==&controller&&existing.drive==drive&&existing.nextBlock==firstBlock){
+							stream = &existing;
+							break;
+						}
+					}
+
+					if(!stream){
+						stream = &streams[nextStream];
+						nextStream = (nextStream+1)%maxStreams;
+						*stream = {&controller, drive, 0, 0};
+					}else{
+						stream->sequentialCount++;
+					}
+
+					stream->nextBlock = lastBlock+1;
+
+					if(stream->sequentialCount<1) return;
+
+					// (only topped up once half used, so that it's read in larger transfers)
+					if(find(controller, drive, lastBlock+readAheadBlocks/2+1)) return;
+
+					for(auto block=lastBlock+1;block<=lastBlock+readAheadBlocks&&block<blockCount;block++){
+						if(find(controller, drive, block)) continue;
+
+						const auto sectorCount = (U32)maths::min((U64)sectorsPerBlock, driveSectors-block*sectorsPerBlock);
+						auto entry = start_load(controller, drive, block, sectorCount);
+						if(!entry) break;
+
+						entry->isReferenced = false; // (not actually used yet)
+						loads[loadCount++] = entry;
+						stats.readAheads++;
+					}
+				}
+
+				// (submitted together, so the controller can merge them into a single transfer)
+				for(auto i=0u;i<loadCount;i++){
+					submit_load(*loads[i], sectorsPerBlock);
+				}
+			}
+
+			// pin a block, claiming an entry for it if it's not cached. A claimed entry is left busy until we've filled it, by loading it (or by writing all of it, if it's about to be entirely overwritten)
+			// returns nullptr if nothing can be replaced. If that's because everything replaceable is dirty, then it's worth flushing and trying again
+			auto pin_block(StorageController &controller, U32 drive, U64 block, U32 sectorCount, bool &isClaimed, bool &isFullOfDirty) -> Entry* {
+				Lock_Guard guard(lock);
+
+				isClaimed = false;
+				isFullOfDirty = false;
+
+				auto entry = find(controller, drive, block);
+
+				if(!entry){
+					entry = claim_victim(isFullOfDirty);
+
+					if(!entry){
+						if(!isFullOfDirty) stats.misses++; // (counted when tried again, otherwise)
+						return nullptr;
+					}
+
+					stats.misses++;
+
+					entry->controller = &controller;
+					entry->drive = drive;
+					entry->block = block;
+					entry->sectorCount = sectorCount;
+					entry->isBusy = true;
+					hash(*entry);
+
+					isClaimed = true;
+
+				}else{
+					stats.hits++;
+				}
+
+				entry->pins++;
+				entry->isReferenced = true;
+
+				return entry;
+			}
+
+			// wait until an entry we have pinned is no longer being transferred
+			void wait_until_idle(Entry &entry) {
+				while(true){
+					{
+						Lock_Guard guard(lock);
+						if(is_idle(entry)) return;
+					}
+
+					wait_a_moment();
+				}
+			}
+
+			// write back everything dirty (for a single drive, if specified), waiting until it's done
+			auto flush(StorageController *controller = nullptr, U32 drive = 0) -> Try<>;
+
+			auto transfer(bool isWrite, StorageController &controller, U32 drive, U64 sector, U32 count, U8 *buffer) -> Try<> {
+				const auto sectorSize = TRY_RESULT(controller.get_drive_sectorSize(drive));
+
+				if(!entries||sectorSize>blockSize||blockSize%sectorSize){
+					return isWrite?controller.write_drive_sectors(drive, sector, count, buffer):controller.read_drive_sectors(drive, sector, count, buffer);
+				}
+
+				const auto driveSectors = TRY_RESULT(controller.get_drive_size(drive))/sectorSize;
+				if(sector+count>driveSectors) return Failure{"transfer beyond the end of the drive"};
+
+				const auto sectorsPerBlock = blockSize/sectorSize;
+				const auto blockCount = (driveSectors+sectorsPerBlock-1)/sectorsPerBlock;
+				const auto firstBlock = sector/sectorsPerBlock;
+				const auto lastBlock = (sector+count-1)/sectorsPerBlock;
+
+				if(!isWrite){
+					read_ahead(controller, drive, firstBlock, lastBlock, blockCount, sectorsPerBlock, driveSectors);
+				}
+
+				for(auto batchStart=firstBlock;batchStart<=lastBlock;batchStart+=maxBatch){
+					const auto batchCount = (U32)maths::min((U64)maxBatch, lastBlock-batchStart+1);
+
+					Entry *batch[maxBatch];
+					bool isClaimed[maxBatch];
+					bool isOverwrite[maxBatch]; // (claimed entries that are entirely overwritten needn't be loaded first)
+
+					// pin the blocks, starting loads for any not cached
+					for(auto i=0u;i<batchCount;i++){
+						const auto block = batchStart+i;
+						const auto blockSector = block*sectorsPerBlock;
+						const auto sectorCount = (U32)maths::min((U64)sectorsPerBlock, driveSectors-blockSector);
+						isOverwrite[i] = isWrite&&sector<=blockSector&&sector+count>=blockSector+sectorCount;
+
+						bool isFullOfDirty;
+						batch[i] = pin_block(controller, drive, block, sectorCount, isClaimed[i], isFullOfDirty);
+
+						if(!batch[i]&&isFullOfDirty){
+							// write back to make room (anything of ours being filled is busy, so left alone)
+							TRY_IGNORE(flush());
+							batch[i] = pin_block(controller, drive, block, sectorCount, isClaimed[i], isFullOfDirty);
+						}
+					}
+
+					for(auto i=0u;i<batchCount;i++){
+						if(isClaimed[i]&&!isOverwrite[i]){
+							submit_load(*batch[i], sectorsPerBlock);
+						}
+					}
+
+					// then copy to or from each of them as they become available
+					Try<> result;
+
+					for(auto i=0u;i<batchCount;i++){
+						const auto block = batchStart+i;
+						const auto blockSector = block*sectorsPerBlock;
+						const auto from = maths::max(sector, blockSector);
+						const auto to = maths::min(sector+count, blockSector+sectorsPerBlock);
+						const auto offset = (U32)(from-blockSector)*sectorSize;
+						const auto size = (U32)(to-from)*sectorSize;
+						auto target = buffer+(from-sector)*sectorSize;
+
+						auto entry = batch[i];
+
+						if(!entry){
+							// the cache is full of blocks in use, so go directly to the drive
+							if(result){
+								result = isWrite?controller.write_drive_sectors(drive, from, to-from, target):controller.read_drive_sectors(drive, from, to-from, target);
+							}
+							continue;
+						}
+
+						if(isClaimed[i]&&isOverwrite[i]){
+							// ours to fill, and busy until we have (so no one else reads it part written)
+							Lock_Guard guard(lock);
+
+							if(result){
+								memcpy(entry->data+offset, target, size);
+								entry->isValid = true;
+								entry->isDirty = true;
+							}else{
+								unhash(*entry);
+							}
+
+							entry->isBusy = false;
+							entry->pins--;
+							continue;
+						}
+
+						if(isClaimed[i]){
+							TRY_IGNORE(entry->request.wait());
+						}
+
+						wait_until_idle(*entry);
+
+						Lock_Guard guard(lock);
+
+						if(!entry->isValid){
+							if(result) result = Failure{"unable to read from drive"};
+
+						}else if(result){
+							if(isWrite){
+								memcpy(entry->data+offset, target, size);
+								entry->isDirty = true;
+							}else{
+								memcpy(target, entry->data+offset, size);
+							}
+						}
+
+						entry->pins--;
+					}
+
+					TRY(result);
+				}
+
+				return {};
+			}
+
+			auto flush(StorageController *controller, U32 drive) -> Try<> {
+				Try<> result;
+
+				for(auto start=0u;start<entryCount;){
+					Entry *batch[maxBatch];
+					U32 batchCount = 0;
+
+					{
+						Lock_Guard guard(lock);
+
+						for(;start<entryCount&&batchCount<maxBatch;start++){
+							auto &entry = entries[start];
+							if(!entry.isDirty||!is_idle(entry)||!entry.isValid) continue;
+							if(controller&&(entry.controller!=controller||entry.drive!=drive)) continue;
+
+							entry.isDirty = false;
+							entry.isBusy = true;
+							entry.pins++;
+							batch[batchCount++] = &entry;
+						}
+					}
+
+					// (submitted together, so the controller can merge neighbouring blocks into single transfers)
+					for(auto i=0u;i<batchCount;i++){
+						auto &entry = *batch[i];
+						const auto sectorSize = TRY_RESULT_OR(entry.controller->get_drive_sectorSize(entry.drive), blockSize);
+						prepare_request(entry, StorageController::Request::Type::write, blockSize/sectorSize);
+
+						if(auto submitted = entry.controller->submit_request(entry.request); !submitted){
+							entry.request.errorMessage = submitted.errorMessage;
+							entry.request.isComplete = true;
+							on_written(entry.request, &entry);
+						}
+					}
+
+					for(auto i=0u;i<batchCount;i++){
+						auto &entry = *batch[i];
+
+						if(auto written = entry.request.wait(); !written&&result){
+							result = written;
+						}
+
+						wait_until_idle(entry);
+
+						Lock_Guard guard(lock);
+						entry.pins--;
+					}
+				}
+
+				return result;
+			}
+
+			// drop everything cached for a drive (unwritten changes are lost, so flush first if it's still there), waiting on any still in use
+			void forget(StorageController &controller, U32 drive) {
+				while(true){
+					auto isInUse = false;
+
+					{
+						Lock_Guard guard(lock);
+
+						for(auto i=0u;i<entryCount;i++){
+							auto &entry = entries[i];
+							if(entry.controller!=&controller||entry.drive!=drive) continue;
+
+							if(!is_idle(entry)||entry.pins){
+								isInUse = true;
+								continue;
+							}
+
+							unhash(entry);
+							entry.isValid = false;
+							entry.isDirty = false;
+							entry.controller = nullptr;
+						}
+					}
+
+					if(!isInUse) return;
+
+					wait_a_moment();
+				}
+			}
+
+			void run_flush() {
+				auto &thread = *scheduler->get_current_thread();
+
+				while(true){
+					thread.sleep(flushInterval);
+					scheduler->yield();
+
+					if(auto result = flush(); !result){
+						StorageManager::log.print_warning("Warning: unable to write back cached blocks: ", result.errorMessage);
+					}
+				}
+			}
+		}
 	}
 
 	auto StorageManager::_on_start() -> Try<> {
+		cache::init();
+
+		if(!flushThread){
+			scheduler = drivers::find_and_activate<driver::Scheduler>(this);
+
+			if(scheduler){
+				auto &process = process::create_kernel("block cache flush");
+				flushThread = &process.create_kernel_thread(cache::run_flush);
+				scheduler->add_thread(*flushThread);
+
+			}else{
+				log.print_warning("No scheduler available - cached writes are only written back on flush_cache()");
+			}
+		}
+
 		return {};
 	}
 
@@ -182,14 +762,138 @@ namespace driver {
 	}
 
 	auto StorageManager::eject_drive(U32 index) -> Try<bool> {
+		StorageController *controller;
+		U32 controllerIndex;
+
+		{
+			Lock_Guard guard(lock);
+
+			if(index>=drives.length) return Failure{"drive not present"};
+
+			auto &drive = drives[index];
+			if(!drive.controller) return Failure{"drive not present"};
+
+			controller = drive.controller;
+			controllerIndex = drive.index;
+		}
+
+		// write back anything unwritten while the media is still there, and then forget it, as it won't be once ejected
+		TRY(cache::flush(controller, controllerIndex));
+
+		const auto isEjected = TRY_RESULT(controller->eject_drive(controllerIndex));
+		if(isEjected){
+			cache::forget(*controller, controllerIndex);
+		}
+
+		return isEjected;
+	}
+
+	auto StorageManager::get_drive_sectorSize(U32 index) -> Try<U32> {
 		Lock_Guard guard(lock);
 
 		if(index>=drives.length) return Failure{"drive not present"};
 
 		auto &drive = drives[index];
-		if(!drive.controller) Failure{"drive not present"};
+		if(!drive.controller) return Failure{"drive not present"};
+
+		return drive.controller->get_drive_sectorSize(drive.index);
+	}
+
+	// transfers can block until the drive completes them (or make room in its queue), so the controller is called without our lock held
+
+	auto StorageManager::read_drive_sectors(U32 index, U64 sector, U32 count, void *buffer) -> Try<> {
+		StorageController *controller;
+		U32 controllerIndex;
+
+		{
+			Lock_Guard guard(lock);
+
+			if(index>=drives.length) return Failure{"drive not present"};
 
-		return drive.controller->eject_drive(drive.index);
+			auto &drive = drives[index];
+			if(!drive.controller) return Failure{"drive not present"};
+
+			controller = drive.controller;
+			controllerIndex = drive.index;
+		}
+
+		return cache::transfer(false, *controller, controllerIndex, sector, count, (U8*)buffer);
+	}
+
+	auto StorageManager::write_drive_sectors(U32 index, U64 sector, U32 count, const void *buffer) -> Try<> {
+		StorageController *controller;
+		U32 controllerIndex;
+
+		{
+			Lock_Guard guard(lock);
+
+			if(index>=drives.length) return Failure{"drive not present"};
+
+			auto &drive = drives[index];
+			if(!drive.controller) return Failure{"drive not present"};
+
+			controller = drive.controller;
+			controllerIndex = drive.index;
+		}
+
+		return cache::transfer(true, *controller, controllerIndex, sector, count, (U8*)buffer);
+	}
+
+	auto StorageManager::flush_cache() -> Try<> {
+		return cache::flush();
+	}
+
+	auto StorageManager::flush_drive_cache(U32 index) -> Try<> {
+		StorageController *controller;
+		U32 controllerIndex;
+
+		{
+			Lock_Guard guard(lock);
+
+			if(index>=drives.length) return Failure{"drive not present"};
+
+			auto &drive = drives[index];
+			if(!drive.controller) return Failure{"drive not present"};
+
+			controller = drive.controller;
+			controllerIndex = drive.index;
+		}
+
+		return cache::flush(controller, controllerIndex);
+	}
+
+	auto StorageManager::get_cache_stats() -> CacheStats {
+		Lock_Guard guard(cache::lock);
+
+		auto stats = cache::stats;
+		stats.dirtyBlocks = 0;
+		stats.usedBlocks = 0;
+
+		for(auto i=0u;i<cache::entryCount;i++){
+			auto &entry = cache::entries[i];
+			if(entry.isValid) stats.usedBlocks++;
+			if(entry.isDirty) stats.dirtyBlocks++;
+		}
+
+		return stats;
+	}
+
+	auto StorageManager::submit_request(U32 index, StorageController::Request &request) -> Try<> {
+		StorageController *controller;
+
+		{
+			Lock_Guard guard(lock);
+
+			if(index>=drives.length) return Failure{"drive not present"};
+
+			auto &drive = drives[index];
+			if(!drive.controller) return Failure{"drive not present"};
+
+			controller = drive.controller;
+			request.drive = drive.index;
+		}
+
+		return controller->submit_request(request);
 	}
 
 	auto StorageManager::allocate_name(AllocationOptions options, StorageController &controller, U32 index) -> const char* {
@@ -222,13 +926,29 @@ namespace driver {
 	// we don't want an old drive name ever be assigned to a new different drive, as this could cause actions being accidentally applied to other drives
 	// TODO: when restarting StorageController drivers, avoid releasing and re-allocating drives so that they can continue with the same drive names (if they're still the same drive with i.e. the same serial number)
 	void StorageManager::release_name(const char *name) {
-		Lock_Guard guard(lock);
+		StorageController *controller = nullptr;
+		U32 controllerIndex;
+
+		{
+			Lock_Guard guard(lock);
+
+			for(auto &drive:drives){
+				if(drive.name==name){
+					controller = drive.controller;
+					controllerIndex = drive.index;
+					drive.controller = nullptr;
+					break;
+				}
+			}
+		}
 
-		for(auto &drive:drives){
-			if(drive.name==name){
-				drive.controller = nullptr;
-				break;
+		if(controller){
+			// (may fail if the drive has already gone, in which case the changes are lost)
+			if(auto result = cache::flush(controller, controllerIndex); !result){
+				log.print_warning("Warning: unable to write back cached blocks for ", name, ": ", result.errorMessage);
 			}
+
+			cache::forget(*controller, controllerIndex);
 		}
 	}
 
@@ -2,14 +2,13 @@
 
 #include <drivers/ResidentService.hpp>
 #include <drivers/Software.hpp>
+#include <drivers/StorageController.hpp>
 
 #include <common/Try.hpp>
 
 namespace driver {
-	struct StorageController;
-
 	struct StorageManager: ResidentService<Software> {
-		DRIVER_INSTANCE(StorageManager, 0x2c9497e1, "storage", "Storage manager", ResidentService<Software>);
+		DRIVER_INSTANCE(StorageManager, 0x58b1cf27, "storage", "Storage manager", ResidentService<Software>);
 
 		auto _on_start() -> Try<> override;
 
@@ -30,6 +29,32 @@ namespace driver {
 		auto is_system_drive(U32) -> bool;
 		auto eject_drive(U32) -> Try<bool>;
 
+		auto get_drive_sectorSize(U32) -> Try<U32>;
+
+		// reads and writes go through the block cache. Writes reach the drive once flushed (which happens periodically)
+		auto read_drive_sectors(U32, U64 sector, U32 count, void *buffer) -> Try<>;
+		auto write_drive_sectors(U32, U64 sector, U32 count, const void *buffer) -> Try<>;
+		auto flush_cache() -> Try<>;
+		auto flush_drive_cache(U32) -> Try<>;
+
+		// directly to the controller, bypassing the cache (the request's drive is set for you)
+		auto submit_request(U32, StorageController::Request&) -> Try<>;
+
+		struct CacheStats {
+			U32 blockSize;
+			U32 blockCount;
+			U32 usedBlocks;
+			U32 dirtyBlocks;
+			U64 hits;
+			U64 misses;
+			U64 evictions;
+			U64 readAheads; // blocks loaded ahead of being asked for
+			U64 writeBacks;
+			U64 writeErrors;
+		};
+
+		auto get_cache_stats() -> CacheStats;
+
 		struct AllocationOptions {
 			const char *prefix;
 			bool systemMapping = false; // refers to the system device. Hidden by default
@@ -8,7 +8,7 @@
 
 namespace driver {
 	struct Timer: Hardware {
-		DRIVER_TYPE(Timer, 0x72ded0a6, "timer", "Hardware Timer Driver", Hardware)
+		DRIVER_TYPE(Timer, 0x3a9c51e7, "timer", "Hardware Timer Driver", Hardware)
 
 		typedef void (*ScheduledCallback)(void *data, U32 id);
 		typedef void (*ScheduledCallback2)(void *data);
@@ -25,6 +25,7 @@ namespace driver {
 		inline auto schedule_important(U32 usecs, ScheduledCallback2 callback, void *data) -> U32 { return schedule_important(usecs, (ScheduledCallback)callback, data); }
 		inline auto schedule(U32 usecs, ScheduledCallback3 callback) -> U32 { return schedule(usecs, (ScheduledCallback)callback, nullptr); }
 		inline auto schedule_important(U32 usecs, ScheduledCallback3 callback) -> U32 { return schedule_important(usecs, (ScheduledCallback)callback, nullptr); }
+		virtual void cancel(U32 id) = 0; // cancel a scheduled callback. Does nothing if it's already been called
 
 		virtual auto get_timer_count() -> U8 = 0;
 		virtual void set_timer(U8, U32 usecs, Callback, void *data) = 0;
@@ -45,28 +46,46 @@ namespace driver {
 
 		static auto find_and_claim_timer(Callback onTerminated, void *onTerminatedData) -> Try<ClaimedTimer>;
 
+		// scheduled callbacks due within this many usecs of each other may be coalesced into one interrupt, by delaying the earlier (never for important callbacks)
+		U32 scheduleSlack = 500;
+
+		// timer interrupts handled per second, over the last second or so (to keep an eye on how often an idle system is being woken)
+		auto get_wakeups_per_second() -> U32;
+
 	protected:
 		Bitmask256 timersInUse;
+
+		U64 wakeupWindowStart = 0;
+		U32 wakeupWindowCount = 0;
+		U32 wakeupsPerSecond = 0;
+
+		void _on_wakeup(); // call on each timer interrupt
 	};
 }
 
 #include <common/PodArray.hpp>
 
 namespace driver {
+	// scheduled callbacks, held in binary min-heaps ordered by time
+	// each is held in a slot, which records its current position in the heap, so it can be found from its id and removed directly
 	struct TimerQueue {
 		struct Scheduled {
 			U64 time;
 			Timer::ScheduledCallback callback;
-			U32 id;
 			void *data;
+			U32 id; // 0 while the slot is free
+			U32 heapIndex;
+			bool isImportant;
 		};
 
 		/**/ TimerQueue(Timer &timer);
 		Timer &timer;
-		U32 nextTimerId = 0;
+		U16 nextSerial = 1; // ids are the serial in the upper 16 bits, and the slot index in the lower
 
-		PodArray<Scheduled> scheduledCallbacks;
-		PodArray<Scheduled> scheduledImportantCallbacks;
+		PodArray<Scheduled> slots;
+		PodArray<U32> freeSlots;
+		PodArray<U32> scheduledCallbacks; // min-heap of slot indices
+		PodArray<U32> scheduledImportantCallbacks; // min-heap of slot indices
 
 		U64 _nextScheduledTime;
 
@@ -74,6 +93,18 @@ namespace driver {
 
 		auto schedule(U32 usecs, Timer::ScheduledCallback callback, void *data) -> U32;
 		auto schedule_important(U32 usecs, Timer::ScheduledCallback callback, void *data) -> U32;
+		void cancel(U32 id);
+
+	protected:
+		auto add(bool isImportant, U32 usecs, Timer::ScheduledCallback callback, void *data) -> U32;
+		void remove(U32 slot);
+		auto get_heap(U32 slot) -> PodArray<U32>&;
+		auto is_before(U32 slotA, U32 slotB) -> bool;
+		void set_heap_index(PodArray<U32> &heap, U32 index, U32 slot);
+		void sift_up(PodArray<U32> &heap, U32 index);
+		void sift_down(PodArray<U32> &heap, U32 index);
+		auto get_latest_within(PodArray<U32> &heap, U32 index, U64 limit) -> U64;
+		void update_timer();
 	};
 }
 
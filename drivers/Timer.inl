@@ -49,6 +49,31 @@ namespace driver {
 		timersInUse.set(id, false);
 	}
 
+	inline void Timer::_on_wakeup() {
+		const auto time = now64();
+
+		if(!wakeupWindowStart){
+			wakeupWindowStart = time;
+		}
+
+		wakeupWindowCount++;
+
+		if(const auto elapsed = time-wakeupWindowStart; elapsed>=1'000'000){
+			wakeupsPerSecond = wakeupWindowCount*(U64)1'000'000/elapsed;
+			wakeupWindowStart = time;
+			wakeupWindowCount = 0;
+		}
+	}
+
+	inline auto Timer::get_wakeups_per_second() -> U32 {
+		// if nothing's woken us to close the window in a while, go by what's been counted so far
+		if(const auto elapsed = now64()-wakeupWindowStart; wakeupWindowStart&&elapsed>=2'000'000){
+			return wakeupWindowCount*(U64)1'000'000/elapsed;
+		}
+
+		return wakeupsPerSecond;
+	}
+
 	inline /**/ TimerQueue::TimerQueue(Timer &timer):
 		timer(timer)
 	{}
@@ -59,92 +84,160 @@ namespace driver {
 		// const auto time = self->timer.now64();
 		const auto time = self->_nextScheduledTime; // we use the stored time, rather than rely on the actual clock. Timings can drift, so use what we EXPECTED the time to be
 
-		{
-			auto count = 0u;
-			while(count<self->scheduledImportantCallbacks.length&&self->scheduledImportantCallbacks[count].time+-time>0xffffffff<<2){
-				self->scheduledImportantCallbacks[count++].time = 0; // we count and initially set the callbacks to 0, so that any new additions from the callbacks position after them
-			}
+		// important callbacks first. Each is removed before it's called, so callbacks are free to schedule or cancel others
+		for(auto i=0;i<2;i++){
+			auto &heap = i==0?self->scheduledImportantCallbacks:self->scheduledCallbacks;
 
-			for(auto i=0u;i<count;i++){
-				//NOTE: None of these callbacks should erase from scheduledImportantCallbacks. This should be done purely below with the shift_left below
-				self->scheduledImportantCallbacks[i].callback(self->scheduledImportantCallbacks[i].data, self->scheduledImportantCallbacks[i].id);
+			while(heap.length>0&&self->slots[heap[0]].time<=time){
+				const auto slot = heap[0];
+				const auto scheduled = self->slots[slot];
+				self->remove(slot);
+
+				scheduled.callback(scheduled.data, scheduled.id);
 			}
+		}
 
-			self->scheduledImportantCallbacks.shift_left(count);
+		self->update_timer();
+	}
+
+	inline auto TimerQueue::schedule(U32 usecs, Timer::ScheduledCallback callback, void *data) -> U32 {
+		return add(false, usecs, callback, data);
+	}
+
+	inline auto TimerQueue::schedule_important(U32 usecs, Timer::ScheduledCallback callback, void *data) -> U32 {
+		return add(true, usecs, callback, data);
+	}
+
+	inline void TimerQueue::cancel(U32 id) {
+		const auto slot = id&0xffff;
+		if(slot>=slots.length||slots[slot].id!=id) return; // already called (or cancelled)
+
+		const auto wasNext = slots[slot].heapIndex==0;
+
+		remove(slot);
+
+		if(wasNext){
+			update_timer();
 		}
+	}
 
-		{
-			auto count = 0u;
-			while(count<self->scheduledCallbacks.length&&self->scheduledCallbacks[count].time+-time>0xffffffff<<2){
-				self->scheduledCallbacks[count++].time = 0; // we count and initially set the callbacks to 0, so that any new additions from the callbacks position after them
-			}
+	inline auto TimerQueue::add(bool isImportant, U32 usecs, Timer::ScheduledCallback callback, void *data) -> U32 {
+		U32 slot;
+		if(freeSlots.length>0){
+			slot = freeSlots.pop_back();
+		}else{
+			slot = slots.length;
+			slots.push_back();
+		}
 
-			for(auto i=0u;i<count;i++){
-				//NOTE: None of these callbacks should erase from scheduledCallbacks. This should be done purely below with the shift_left below
-				self->scheduledCallbacks[i].callback(self->scheduledCallbacks[i].data, self->scheduledCallbacks[i].id);
-			}
+		if(!++nextSerial) nextSerial = 1; // never 0, so ids are never 0
+		const auto id = (U32)nextSerial<<16|slot;
+
+		slots[slot] = {
+			.time = timer.now64()+usecs,
+			.callback = callback,
+			.data = data,
+			.id = id,
+			.heapIndex = 0,
+			.isImportant = isImportant
+		};
+
+		auto &heap = get_heap(slot);
+		heap.push_back(slot);
+		set_heap_index(heap, heap.length-1, slot);
+		sift_up(heap, heap.length-1);
+
+		if(slots[slot].heapIndex==0){
+			update_timer();
+		}
+
+		return id;
+	}
 
-			self->scheduledCallbacks.shift_left(count);
+	inline void TimerQueue::remove(U32 slot) {
+		auto &heap = get_heap(slot);
+		const auto index = slots[slot].heapIndex;
+		const auto last = heap.pop_back();
+
+		if(last!=slot){
+			// fill the gap with the last, and move it whichever way it needs to go
+			set_heap_index(heap, index, last);
+			sift_up(heap, index);
+			sift_down(heap, slots[last].heapIndex);
 		}
 
-		if(self->scheduledCallbacks.length>0){
-			if(self->scheduledImportantCallbacks.length>0){
-				self->timer.set_timer(0, self->_nextScheduledTime = min(self->scheduledCallbacks[0].time, self->scheduledImportantCallbacks[0].time), _on_schedule_timer, self);
+		slots[slot].id = 0;
+		freeSlots.push_back(slot);
+	}
 
-			}else{
-				self->timer.set_timer(0, self->_nextScheduledTime = self->scheduledCallbacks[0].time, _on_schedule_timer, self);
-			}
+	inline auto TimerQueue::get_heap(U32 slot) -> PodArray<U32>& {
+		return slots[slot].isImportant?scheduledImportantCallbacks:scheduledCallbacks;
+	}
+
+	inline auto TimerQueue::is_before(U32 slotA, U32 slotB) -> bool {
+		return slots[slotA].time<slots[slotB].time;
+	}
+
+	inline void TimerQueue::set_heap_index(PodArray<U32> &heap, U32 index, U32 slot) {
+		heap[index] = slot;
+		slots[slot].heapIndex = index;
+	}
+
+	inline void TimerQueue::sift_up(PodArray<U32> &heap, U32 index) {
+		const auto slot = heap[index];
+
+		while(index>0){
+			const auto parent = (index-1)/2;
+			if(!is_before(slot, heap[parent])) break;
 
-		}else if(self->scheduledImportantCallbacks.length>0){
-			self->timer.set_timer(0, self->_nextScheduledTime = self->scheduledImportantCallbacks[0].time, _on_schedule_timer, self);
+			set_heap_index(heap, index, heap[parent]);
+			index = parent;
 		}
+
+		set_heap_index(heap, index, slot);
 	}
 
-	inline auto TimerQueue::schedule(U32 usecs, Timer::ScheduledCallback callback, void *data) -> U32 {
-		auto time = timer.now64()+usecs;
-
-		for(auto i=0u;i<scheduledCallbacks.length;i++){
-			if(!scheduledCallbacks[i].time) continue; // don't insert before zero times
-
-			auto diff = time - scheduledCallbacks[i].time;
-			if(diff>0xffffffff<<2){ // if time LOWER than existing (this will cause wrap-around and so a large value)
-				scheduledCallbacks.insert(i, time, callback, nextTimerId, data);
-				if(i==0){
-					if(scheduledImportantCallbacks.length>0 && scheduledImportantCallbacks[0].time>0){
-						timer.set_timer(0, _nextScheduledTime = min(time, scheduledImportantCallbacks[0].time), _on_schedule_timer, this);
-					}else{
-						timer.set_timer(0, _nextScheduledTime = time, _on_schedule_timer, this);
-					}
-				}
-				return nextTimerId++;
-			}
+	inline void TimerQueue::sift_down(PodArray<U32> &heap, U32 index) {
+		const auto slot = heap[index];
+
+		while(true){
+			auto child = index*2+1;
+			if(child>=heap.length) break;
+			if(child+1<heap.length&&is_before(heap[child+1], heap[child])) child++;
+			if(!is_before(heap[child], slot)) break;
+
+			set_heap_index(heap, index, heap[child]);
+			index = child;
 		}
 
-		scheduledCallbacks.push_back(time, callback, nextTimerId, data);
-		return nextTimerId++;
+		set_heap_index(heap, index, slot);
 	}
 
-	inline auto TimerQueue::schedule_important(U32 usecs, Timer::ScheduledCallback callback, void *data) -> U32 {
-		auto time = timer.now64()+usecs;
-
-		for(auto i=0u;i<scheduledImportantCallbacks.length;i++){
-			if(!scheduledImportantCallbacks[i].time) continue; // don't insert before zero times
-
-			auto diff = time - scheduledImportantCallbacks[i].time;
-			if(diff>0xffffffff<<2){ // if time LOWER than existing (this will cause wrap-around and so a large value)
-				scheduledImportantCallbacks.insert(i, time, callback, nextTimerId, data);
-				if(i==0){
-					if(scheduledCallbacks.length>0 && scheduledCallbacks[0].time>0){
-						timer.set_timer(0, _nextScheduledTime = min(time, scheduledCallbacks[0].time), _on_schedule_timer, this);
-					}else{
-						timer.set_timer(0, _nextScheduledTime = time, _on_schedule_timer, this);
-					}
-				}
-				return nextTimerId++;
-			}
+	// the latest time in the heap (from `index` down) that's no later than `limit`, or 0 if none are
+	// children are never due before their parents, so this only visits those within the limit (and their direct children)
+	inline auto TimerQueue::get_latest_within(PodArray<U32> &heap, U32 index, U64 limit) -> U64 {
+		if(index>=heap.length) return 0;
+
+		const auto time = slots[heap[index]].time;
+		if(time>limit) return 0;
+
+		return max(time, get_latest_within(heap, index*2+1, limit), get_latest_within(heap, index*2+2, limit));
+	}
+
+	// point the timer at whichever callback is due first
+	// regular callbacks are coalesced, holding the first back until the last due within `Timer::scheduleSlack` of it, so they all fire in one interrupt
+	inline void TimerQueue::update_timer() {
+		U64 next = ~(U64)0;
+		if(scheduledCallbacks.length>0) next = get_latest_within(scheduledCallbacks, 0, slots[scheduledCallbacks[0]].time+timer.scheduleSlack);
+		if(scheduledImportantCallbacks.length>0) next = min(next, slots[scheduledImportantCallbacks[0]].time);
+
+		if(next==~(U64)0){
+			timer.stop_timer(0);
+			return;
 		}
 
-		scheduledImportantCallbacks.push_back(time, callback, nextTimerId, data);
-		return nextTimerId++;
+		const auto now = timer.now64();
+		timer.set_timer(0, next>now?(U32)min(next-now, (U64)0xffffffff):0, _on_schedule_timer, this);
+		_nextScheduledTime = next;
 	}
 }
@@ -13,7 +13,17 @@ namespace driver {
 		namespace {
 			Mode defaultMode;
 
-			Framebuffer framebuffer;
+			Framebuffer framebuffer; // the page currently shown
+			U8 *framebufferMemory = nullptr;
+
+			// if the virtual framebuffer has room for two pages, we flip between them (via the virtual offset), updating the hidden one rather than drawing to what's shown
+			U32 pageCount = 1;
+			U32 visiblePage = 0;
+
+			// what was presented to the visible page, which the hidden one (shown a frame before) is missing
+			const U32 maxPreviousAreas = 32;
+			graphics2d::Rect previousAreas[maxPreviousAreas];
+			U32 previousAreaCount = 0;
 
 			// THERE is surely a better way than bruting a list of possibles (list from https://www.raspberrypi.com/documentation/computers/config_txt.html)
 			// TODO: use the Get EDID block mailbox message to properly get the display options
@@ -85,9 +95,10 @@ namespace driver {
 			tags[0].data.screenSize.width = width;
 			tags[0].data.screenSize.height = height;
 
+			// twice the height, so there's a second page to flip to
 			tags[1].tag = mailbox::PropertyTag::set_virtual_dimensions;
 			tags[1].data.screenSize.width = width;
-			tags[1].data.screenSize.height = height;
+			tags[1].data.screenSize.height = height*2;
 
 			tags[2].tag = mailbox::PropertyTag::set_bits_per_pixel;
 			tags[2].data.bitsPerPixel = bitdepth;
@@ -98,8 +109,10 @@ namespace driver {
 
 			auto assignBitdepth = tags[2].data.bitsPerPixel;
 
-			framebuffer.buffer.width = tags[1].data.screenSize.width;
-			framebuffer.buffer.height = tags[1].data.screenSize.height;
+			framebuffer.buffer.width = tags[0].data.screenSize.width;
+			framebuffer.buffer.height = tags[0].data.screenSize.height;
+			pageCount = tags[1].data.screenSize.height>=framebuffer.buffer.height*2?2:1;
+			visiblePage = 0;
 
 			tags[0].tag = mailbox::PropertyTag::allocate_buffer;
 			tags[0].data.screenSize.width = 0;
@@ -146,7 +159,8 @@ namespace driver {
 			// log.print_info("got address ", format::Hex64{tags[0].data.allocate_res.fb_addr});
 
 			framebuffer.buffer.stride = framebuffer.buffer.width*bitdepth;
-			framebuffer.buffer.address = (U8*)(size_t)(tags[0].data.allocate_res.fb_addr&0x3FFFFFFF);
+			framebufferMemory = (U8*)(size_t)(tags[0].data.allocate_res.fb_addr&0x3FFFFFFF);
+			framebuffer.buffer.address = framebufferMemory;
 			framebuffer.buffer.size = tags[0].data.allocate_res.fb_size;
 			framebuffer.buffer.format = format;
 
@@ -202,6 +216,21 @@ namespace driver {
 				break;
 			}
 
+			if(pageCount>1){
+				tags[0].tag = mailbox::PropertyTag::set_virtual_offset;
+				tags[0].data.virtualOffset.x = 0;
+				tags[0].data.virtualOffset.y = 0;
+				tags[1].tag = mailbox::PropertyTag::null_tag;
+
+				if(!send_messages(tags)){
+					log.print_warning("Warning: Unable to set virtual offset, so not page flipping");
+					pageCount = 1;
+				}
+			}
+
+			previousAreas[0] = {0, 0, (I32)framebuffer.buffer.width, (I32)framebuffer.buffer.height};
+			previousAreaCount = 1;
+
 			// graphics2d::redraw_background();
 
 			framebuffer.driver = this;
@@ -327,5 +356,57 @@ namespace driver {
 
 			return "framebuffer";
 		}
+	
+		auto Raspi_videocore_mailbox::present(U32 framebufferId, const graphics2d::Rect *areas, U32 count) -> Try<> {
+			if(framebufferId>0) return Failure{"Invalid framebuffer id"};
+			if(pageCount<2) return Super::present(framebufferId, areas, count);
+
+			auto back = get_back_buffer(framebufferId);
+			if(!back||framebuffer.driver!=this) return Failure{"Framebuffer not available"};
+			if(back==&framebuffer.buffer) return {}; // already drawn directly
+
+			const auto hiddenPage = 1-visiblePage;
+
+			auto page = framebuffer.buffer;
+			page.address = framebufferMemory+hiddenPage*framebuffer.buffer.stride*framebuffer.buffer.height;
+
+			// bring the hidden page up to date, and then show it
+			_copy_areas(page, *back, previousAreas, previousAreaCount);
+			_copy_areas(page, *back, areas, count);
+
+			mailbox::PropertyMessage tags[2];
+			tags[0].tag = mailbox::PropertyTag::set_virtual_offset;
+			tags[0].data.virtualOffset.x = 0;
+			tags[0].data.virtualOffset.y = hiddenPage*framebuffer.buffer.height;
+			tags[1].tag = mailbox::PropertyTag::null_tag;
+
+			if(!send_messages(tags)){
+				// stay on this page, drawing to it directly from now on
+				log.print_warning("Warning: Unable to flip framebuffer pages");
+				pageCount = 1;
+				return Super::present(framebufferId, areas, count);
+			}
+
+			visiblePage = hiddenPage;
+			framebuffer.buffer.address = page.address;
+
+			if(count<=maxPreviousAreas){
+				for(auto i=0u;i<count;i++){
+					previousAreas[i] = areas[i];
+				}
+				previousAreaCount = count;
+
+			}else{
+				graphics2d::Rect bounds;
+				for(auto i=0u;i<count;i++){
+					bounds = bounds.include(areas[i]);
+				}
+
+				previousAreas[0] = bounds;
+				previousAreaCount = 1;
+			}
+
+			return {};
+		}
 	}
 }
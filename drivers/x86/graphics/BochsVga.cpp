@@ -20,9 +20,19 @@ namespace driver::graphics {
 		U16 maxHeight = 1600;
 		U16 maxBpp = 32;
 
-		graphics2d::Buffer framebuffer;
+		graphics2d::Buffer framebuffer; // the page currently shown
 		Physical<U8> physicalFramebufferAddress;
 		U32 physicalFramebufferSize;
+		U8 *framebufferMemory = nullptr;
+
+		// if there's room for two pages, we flip between them (via the y offset), updating the hidden one rather than drawing to what's shown
+		U32 pageCount = 1;
+		U32 visiblePage = 0;
+
+		// what was presented to the visible page, which the hidden one (shown a frame before) is missing
+		const U32 maxPreviousAreas = 32;
+		graphics2d::Rect previousAreas[maxPreviousAreas];
+		U32 previousAreaCount = 0;
 
 		Graphics::Mode modes[] = {
 			#define COMMON_MODES(WIDTH, HEIGHT) /**/\
@@ -89,7 +99,6 @@ namespace driver::graphics {
 
 		void assign_framebuffer(U32 width, U32 height, U8 bpp) {
 			//FIXME: there is a race condition between nulling the framebuffer, and broadcasting the invalid event. The framebuffer access should likely be wrapped with a spinlock to avoid this
-			auto framebufferAddress = framebuffer.address;
 			framebuffer.address = nullptr;
 
 			BochsVga::instance.events.trigger({
@@ -130,11 +139,17 @@ namespace driver::graphics {
 
 			// log.print_info("got address ", format::Hex64{tags[0].data.allocate_res.fb_addr});
 
-			framebuffer.address = framebufferAddress;
+			framebuffer.address = framebufferMemory;
 			framebuffer.stride = width*(bpp/8);
 			framebuffer.format = format;
 			framebuffer.order = order;
 
+			// flipping is only enabled once the mode is set
+			pageCount = 1;
+			visiblePage = 0;
+			previousAreas[0] = {0, 0, (I32)width, (I32)height};
+			previousAreaCount = 1;
+
 			BochsVga::instance.events.trigger({
 				instance: &BochsVga::instance,
 				type: driver::Graphics::Event::Type::framebufferChanged,
@@ -169,7 +184,8 @@ namespace driver::graphics {
 		// check framebuffer address first before enabling, so we don't trample other drivers
 		physicalFramebufferAddress = pciDevice->bar[0].memoryAddress.as_native_type<U8>();
 		physicalFramebufferSize = pciDevice->bar[0].memorySize;
-		framebuffer.address = TRY_RESULT(api.subscribe_memory<U8>(physicalFramebufferAddress, physicalFramebufferSize, mmu::Caching::writeCombining));
+		framebufferMemory = TRY_RESULT(api.subscribe_memory<U8>(physicalFramebufferAddress, physicalFramebufferSize, mmu::Caching::writeCombining));
+		framebuffer.address = framebufferMemory;
 
 		set16(Register::enable, (U16)Enable::getCaps|(U16)Enable::noClearMem);
 		maxWidth = get16(Register::xRes);
@@ -274,6 +290,15 @@ namespace driver::graphics {
 
 		set16(Register::enable, enables);
 
+		// use a second page below the first, if there's room for it
+		set16(Register::virtHeight, appliedHeight*2);
+		set16(Register::yOffset, 0);
+
+		if(get16(Register::virtHeight)>=appliedHeight*2&&framebuffer.stride*appliedHeight*2<=physicalFramebufferSize){
+			pageCount = 2;
+			log.print_info("page flipping enabled");
+		}
+
 		return {};
 	}
 
@@ -292,4 +317,44 @@ namespace driver::graphics {
 
 		return "framebuffer";
 	}
+
+	auto BochsVga::present(U32 framebufferId, const graphics2d::Rect *areas, U32 count) -> Try<> {
+		if(framebufferId>0) return Failure{"Invalid framebuffer id"};
+		if(pageCount<2) return Super::present(framebufferId, areas, count);
+
+		auto back = get_back_buffer(framebufferId);
+		if(!back||!framebuffer.address) return Failure{"Framebuffer not available"};
+		if(back==&framebuffer) return {}; // already drawn directly
+
+		const auto hiddenPage = 1-visiblePage;
+
+		auto page = framebuffer;
+		page.address = framebufferMemory+hiddenPage*framebuffer.stride*framebuffer.height;
+
+		// bring the hidden page up to date, and then show it
+		_copy_areas(page, *back, previousAreas, previousAreaCount);
+		_copy_areas(page, *back, areas, count);
+
+		set16(Register::yOffset, hiddenPage*framebuffer.height);
+		visiblePage = hiddenPage;
+		framebuffer.address = page.address;
+
+		if(count<=maxPreviousAreas){
+			for(auto i=0u;i<count;i++){
+				previousAreas[i] = areas[i];
+			}
+			previousAreaCount = count;
+
+		}else{
+			graphics2d::Rect bounds;
+			for(auto i=0u;i<count;i++){
+				bounds = bounds.include(areas[i]);
+			}
+
+			previousAreas[0] = bounds;
+			previousAreaCount = 1;
+		}
+
+		return {};
+	}
 }
@@ -17,5 +17,7 @@ namespace driver::graphics {
 		auto get_framebuffer_count() -> U32 override;
 		auto get_framebuffer(U32 index) -> graphics2d::Buffer* override;
 		auto get_framebuffer_name(U32 index) -> const char* override;
+
+		auto present(U32 framebufferId, const graphics2d::Rect *areas, U32 count) -> Try<> override;
 	};
 }
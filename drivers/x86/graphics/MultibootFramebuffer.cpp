@@ -129,7 +129,7 @@ namespace driver::graphics {
 				break;
 			}
 	
-			framebuffer.address = TRY_RESULT(MultibootFramebuffer::instance.api.subscribe_memory<U8>(Physical<void>{(UPtr)multiboot.framebuffer_addr}, multiboot.framebuffer_pitch*multiboot.framebuffer_width, mmu::Caching::writeCombining));
+			framebuffer.address = TRY_RESULT(MultibootFramebuffer::instance.api.subscribe_memory<U8>(Physical<void>{(UPtr)multiboot.framebuffer_addr}, multiboot.framebuffer_pitch*multiboot.framebuffer_height, mmu::Caching::writeCombining));
 			framebuffer.format = format;
 			framebuffer.order = formatOrder;
 			framebuffer.stride = multiboot.framebuffer_pitch;
@@ -251,7 +251,7 @@ namespace driver::graphics {
 				break;
 			}
 	
-			framebuffer.address = TRY_RESULT(MultibootFramebuffer::instance.api.subscribe_memory<U8>(Physical<void>{(UPtr)multiboot.common.framebuffer_addr}, multiboot.common.framebuffer_pitch*multiboot.common.framebuffer_width, mmu::Caching::writeCombining));
+			framebuffer.address = TRY_RESULT(MultibootFramebuffer::instance.api.subscribe_memory<U8>(Physical<void>{(UPtr)multiboot.common.framebuffer_addr}, multiboot.common.framebuffer_pitch*multiboot.common.framebuffer_height, mmu::Caching::writeCombining));
 			framebuffer.format = format;
 			framebuffer.order = formatOrder;
 			framebuffer.stride = multiboot.common.framebuffer_pitch;
@@ -3,12 +3,18 @@
 #include "ide/InfoBlock.hpp"
 
 #include <drivers/x86/system/Pci.hpp>
+#include <drivers/Scheduler.hpp>
 #include <drivers/StorageManager.hpp>
 
 #include <kernel/arch/x86/ioPort.hpp>
 #include <kernel/arch/x86/PciDevice.hpp>
+#include <kernel/CriticalSection.hpp>
 #include <kernel/DriverReference.hpp>
 #include <kernel/drivers.hpp>
+#include <kernel/exceptions.hpp>
+#include <kernel/memory/Page.hpp>
+#include <kernel/Process.hpp>
+#include <kernel/Thread.hpp>
 
 #include <common/ListUnordered.hpp>
 #include <common/String.hpp>
@@ -23,6 +29,13 @@ namespace driver::storage {
 		const U16 legacyIoAta3 = 0x376; // secondary control
 		const U16 legacyIoAta4 = 0x3f6; // primary control
 
+		const U8 legacyIrqAta1 = 15; // secondary
+		const U8 legacyIrqAta2 = 14; // primary
+
+		const auto maxTransferSize = 128u*1024u; // bytes per command (longer transfers are split)
+		const auto maxPrdEntries = (U32)(memory::pageSize/8); // a page of them
+		const auto transferTimeout = 5u*1000u*1000u; // usecs
+
 		void pause();
 
 		enum struct Bus: U8 {
@@ -147,6 +160,30 @@ namespace driver::storage {
 			badBlockDetected       = 1<<7
 		};
 
+		enum struct Control: U8 {
+			softwareReset = 1<<2,
+		};
+
+		enum struct BusMasterCommand: U8 {
+			start    = 1<<0,
+			toMemory = 1<<3, // the device is read from (otherwise written to)
+		};
+
+		enum struct BusMasterStatus: U8 {
+			active    = 1<<0,
+			error     = 1<<1,
+			interrupt = 1<<2,
+		};
+
+		// physical region descriptor. A run of physical memory for the bus master to transfer, not crossing a 64KB boundary
+		struct __attribute__((packed)) PrdEntry {
+			U32 address;
+			U16 size; // 0 means 64KB
+			U16 flags;
+
+			static const U16 endOfTable = 1<<15;
+		};
+
 		struct BusMaster {
 			arch::x86::IoPort ioPort;
 			volatile void *address;
@@ -199,15 +236,15 @@ namespace driver::storage {
 				}
 			}
 
-			auto read_command(Bus bus) -> U8 {
-				return read8(0x00+(bus==Bus::secondary?0x08:0x00));
+			auto read_command() -> U8 {
+				return read8(0x00);
 			}
 
 			auto write_command(U8 value) {
 				write8(0x00, value);
 			}
 
-			auto read_status(Bus bus) -> U8 {
+			auto read_status() -> U8 {
 				return read8(0x02);
 			}
 
@@ -215,7 +252,7 @@ namespace driver::storage {
 				write8(0x02, value);
 			}
 
-			auto read_prdt(Bus bus) -> U32 {
+			auto read_prdt() -> U32 {
 				return read32(0x04);
 			}
 
@@ -224,11 +261,29 @@ namespace driver::storage {
 			}
 		};
 
+		driver::Scheduler *scheduler = nullptr;
+
 		struct IdeChannel {
 			bool isPresent;
 			arch::x86::IoPort ioBase;
 			arch::x86::IoPort ioControl;
 			BusMaster busMaster;
+			Drive selectedDrive = (Drive)0xff;
+
+			U8 irq = 0;
+			bool hasIrq = false;
+			bool isBusy = false; // claimed for a transfer (under the driver lock)
+
+			PrdEntry *prdt = nullptr; // a page of entries, reused for each dma transfer
+			U32 prdtPhysical = 0;
+			U32 prdCount = 0;
+
+			Thread *requestThread = nullptr;
+
+			volatile bool isDmaPending = false;
+			volatile U8 dmaStatus = 0; // bus master status once the transfer ended
+			volatile U8 driveStatus = 0; // drive status once the transfer ended
+			Thread *volatile waitingThread = nullptr;
 
 			auto read8(Register reg) {
 				return arch::x86::ioPort::read8(ioBase+(arch::x86::IoPort)reg);
@@ -254,20 +309,180 @@ namespace driver::storage {
 			auto read_control() {
 				return arch::x86::ioPort::read8(ioControl);
 			}
+			void write_control(U8 value) {
+				return arch::x86::ioPort::write8(ioControl, value);
+			}
+
+			// reading the alternate status takes ~100ns, and doesn't acknowledge the interrupt
+			void delay_400ns() {
+				for(auto i=0;i<4;i++) read_control();
+			}
 
 			void select_drive(Drive drive, U8 extra = 0) {
-				//TODO:OPTIMISE: no need to select drive and pause if we're already on it
 				write8(Register::driveSelect, 0xa0|((U8)drive<<4)|extra);
-				pause();
+
+				// the drive only needs time to respond if we've switched to it
+				if(drive!=selectedDrive){
+					selectedDrive = drive;
+					pause();
+				}
+			}
+
+			void select_lba(Drive drive, U64 sector, U32 count, bool lba48) {
+				if(lba48){
+					// the high bytes go in first, then the low ones
+					select_drive(drive, 0x40);
+					write8(Register::sectorCount, count>> 8);
+					write8(Register::lbaLow     , sector>>24);
+					write8(Register::lbaMedium  , sector>>32);
+					write8(Register::lbaHigh    , sector>>40);
+					write8(Register::sectorCount, count>> 0);
+					write8(Register::lbaLow     , sector>> 0);
+					write8(Register::lbaMedium  , sector>> 8);
+					write8(Register::lbaHigh    , sector>>16);
+
+				}else{
+					select_drive(drive, 0x40|((sector>>24)&0x0f));
+					write8(Register::sectorCount, count); // 0 is 256
+					write8(Register::lbaLow     , sector>> 0);
+					write8(Register::lbaMedium  , sector>> 8);
+					write8(Register::lbaHigh    , sector>>16);
+				}
 			}
 
 			void command(Command command) {
 				write8(Register::command, (U8)command);
 			}
 
+			auto has_dma() -> bool {
+				return prdt&&(busMaster.ioPort||busMaster.address);
+			}
+
+			// the table describes buffers as runs of physical memory, so they needn't be physically contiguous (or even a single buffer)
+			void begin_prdt() {
+				prdCount = 0;
+			}
+
+			auto add_prdt(U8 *buffer, U32 size) -> Try<> {
+				if((UPtr)buffer&1||size&1) return Failure{"buffer is not word aligned"};
+
+				auto kernelTransaction = mmu::kernel::transaction();
+
+				for(U32 offset=0;offset<size;){
+					const U64 physical = kernelTransaction.get_physical(buffer+offset).address;
+					const auto length = maths::min((U32)(memory::pageSize-physical%memory::pageSize), size-offset);
+					if(physical+length>0x100000000ull) return Failure{"buffer is not addressable by the bus master"};
+
+					auto last = prdCount>0?&prdt[prdCount-1]:nullptr;
+					const U32 lastSize = last?(last->size?last->size:0x10000):0;
+
+					if(last&&(U64)last->address+lastSize==physical&&last->address>>16==(physical+length-1)>>16){
+						last->size = (U16)(lastSize+length);
+
+					}else{
+						if(prdCount>=maxPrdEntries) return Failure{"buffer is too fragmented"};
+
+						prdt[prdCount++] = {(U32)physical, (U16)length, 0};
+					}
+
+					offset += length;
+				}
+
+				return {};
+			}
+
+			auto end_prdt() -> Try<> {
+				if(prdCount<1) return Failure{"empty transfer"};
+
+				prdt[prdCount-1].flags = PrdEntry::endOfTable;
+
+				return {};
+			}
+
+			void on_dma_complete() {
+				dmaStatus = busMaster.read_status();
+				driveStatus = read8(Register::status); // (also acknowledges the drive's interrupt)
+				busMaster.write_status(dmaStatus); // clear the error and interrupt bits
+				isDmaPending = false;
+
+				if(auto thread = waitingThread){
+					thread->resume();
+				}
+			}
+
+			void on_irq() {
+				if(!isDmaPending){
+					read8(Register::status); // acknowledge it (it was for a pio command, or spurious)
+					return;
+				}
+
+				// the irq may be shared, so check it was actually us
+				if(!(busMaster.read_status()&(U8)BusMasterStatus::interrupt)) return;
+
+				on_dma_complete();
+			}
+
+			// abandon whatever the channel was part way through (such as a timed out transfer), so that it's usable again
+			void reset() {
+				if(busMaster.ioPort||busMaster.address){
+					busMaster.write_command(0);
+					busMaster.write_status((U8)BusMasterStatus::error|(U8)BusMasterStatus::interrupt);
+				}
+
+				isDmaPending = false;
+
+				write_control((U8)Control::softwareReset);
+				pause();
+				write_control(0);
+				pause();
+
+				selectedDrive = (Drive)0xff; // (the reset deselects it)
+
+				if(!wait_for_status(transferTimeout)){
+					Ide::log.print_warning("channel still busy after reset");
+				}
+			}
+
+			auto wait_for_dma(U32 usecs) -> Try<> {
+				const auto start = time::now();
+				const auto thread = scheduler?scheduler->get_current_thread():nullptr;
+
+				while(isDmaPending){
+					const auto elapsed = time::now()-start;
+					if(elapsed>=usecs){
+						isDmaPending = false;
+						return Failure{"timeout waiting on DMA transfer"};
+					}
+
+					if(thread&&hasIrq&&exceptions::_is_active()){
+						// sleep until the irq resumes us (holding it off, so that it can't slip in between checking and sleeping)
+						{
+							CriticalSection guard;
+							if(!isDmaPending) break;
+
+							waitingThread = thread;
+							thread->sleep(usecs-elapsed);
+						}
+
+						scheduler->yield();
+						waitingThread = nullptr;
+
+					}else{
+						// the irq can't reach us, so poll the bus master for completion instead
+						if(busMaster.read_status()&(U8)BusMasterStatus::interrupt){
+							on_dma_complete();
+						}else{
+							asm("pause");
+						}
+					}
+				}
+
+				return {};
+			}
+
 			auto wait_for_status(U32 usecs = 400) -> Try<Status> {
 				auto start = time::now();
-				do{
+				while(true){
 					const auto status = read8(Register::status);
 					if(status&(U8)Status::busy){
 						asm("pause");
@@ -276,14 +491,14 @@ namespace driver::storage {
 					}
 
 					return (Status)status;
-				}while(false);
+				}
 
 				return Failure{"timeout waiting on status"};
 			}
 
 			auto wait_until_data_request_ready(U32 usecs = 1000) -> Try<Status> {
 				auto start = time::now();
-				do{
+				while(true){
 					const auto control = read_control();
 					if(!(control&(U8)Status::dataRequestReady)){
 						asm("pause");
@@ -292,7 +507,7 @@ namespace driver::storage {
 					}
 
 					return (Status)control;
-				}while(false);
+				}
 
 				return Failure{"timeout waiting for DQR"};
 			}
@@ -327,37 +542,145 @@ namespace driver::storage {
 			String8 serialNumber;
 			U64 sectorSize = 512;
 			U64 size = 0;
+			bool isLba48 = false;
+			bool isDmaSupported = false;
 
 			virtual auto eject() -> Try<bool> { return Failure{"not supported"}; }
 			virtual auto is_present() -> Try<bool> { return true; }
 			virtual auto is_removable() -> Try<bool> { return false; }
 
-			virtual auto read_data(U64 address, size_t length) -> Try<> {
-				auto sector = address/sectorSize;
-				auto sectorOffset = address%sectorSize;
-				auto sectorCount = (sectorOffset + length + (sectorSize-1)) / sectorSize;
-
-				TRY(ideChannel.wait_for_status(1000*1000));
-
-				if(sector>0x0fffffff){
-					//lba48
-					ideChannel.select_drive(drive, 0x40);
-					ideChannel.write8(Register::sectorCount, 0);
-					ideChannel.write8(Register::sectorCount, sectorCount);
-					ideChannel.write8(Register::lbaHigh  , sector>>40);
-					ideChannel.write8(Register::lbaMedium, sector>>32);
-					ideChannel.write8(Register::lbaLow   , sector>>24);
-					ideChannel.write8(Register::lbaHigh  , sector>>16);
-					ideChannel.write8(Register::lbaMedium, sector>> 8);
-					ideChannel.write8(Register::lbaLow   , sector>> 0);
+			// walks the buffers of a request and those merged onto it
+			struct Cursor {
+				StorageController::Request *request;
+				U32 index; // sector within the request
 
-				}else{
-					//lba28
-					ideChannel.select_drive(drive, 0x40 | (sector >> 24));
-					ideChannel.write8(Register::sectorCount, sectorCount);
-					ideChannel.write8(Register::lbaHigh  , sector>>16);
-					ideChannel.write8(Register::lbaMedium, sector>> 8);
-					ideChannel.write8(Register::lbaLow   , sector>> 0);
+				auto get_buffer(U64 sectorSize) -> U8* { return request->buffer+index*sectorSize; }
+				auto get_contiguous_count() -> U32 { return request->count-index; }
+
+				void advance(U32 count) {
+					index += count;
+					while(request&&index>=request->count){
+						index -= request->count;
+						request = request->merged;
+					}
+				}
+			};
+
+			virtual auto transfer(StorageController::Request &request, bool useDma) -> Try<> {
+				const auto isWrite = request.type==StorageController::Request::Type::write;
+
+				U32 count = 0;
+				for(auto part=&request;part;part=part->merged) count += part->count;
+
+				if(request.sector+count>size/sectorSize) return Failure{"transfer beyond the end of the drive"};
+
+				// lba28 commands can only count up to 256 sectors
+				const auto maxCount = maths::min((U32)(maxTransferSize/sectorSize), isLba48?65536u:256u);
+
+				useDma = useDma&&isDmaSupported&&ideChannel.has_dma();
+
+				auto sector = request.sector;
+				Cursor cursor{&request, 0};
+
+				while(count>0){
+					const auto chunkCount = maths::min(count, maxCount);
+					const auto lba48 = isLba48&&(sector+chunkCount>0x0fffffff||chunkCount>256);
+
+					// only fall back to pio when the buffers can't be described to the bus master. Failures of the dma transfer itself are returned
+					if(useDma&&prepare_dma(chunkCount, cursor)){
+						TRY(transfer_dma(isWrite, sector, chunkCount, lba48));
+					}else{
+						TRY(transfer_pio(isWrite, sector, chunkCount, cursor, lba48));
+					}
+
+					sector += chunkCount;
+					count -= chunkCount;
+					cursor.advance(chunkCount);
+				}
+
+				if(isWrite){
+					// make sure it's actually on the disk before we report success
+					ideChannel.command(isLba48?Command::cacheFlushExt:Command::cacheFlush);
+					ideChannel.delay_400ns();
+
+					const auto status = TRY_RESULT(ideChannel.wait_for_status(transferTimeout));
+					if((U8)status&((U8)Status::error|(U8)Status::driveWriteFault)) return Failure{"drive error flushing cache"};
+				}
+
+				return {};
+			}
+
+			// describe the buffers to the bus master (fails on buffers it can't reach)
+			auto prepare_dma(U32 count, Cursor cursor) -> Try<> {
+				ideChannel.begin_prdt();
+				for(auto remaining=count;remaining>0;){
+					const auto partCount = maths::min(remaining, cursor.get_contiguous_count());
+					TRY(ideChannel.add_prdt(cursor.get_buffer(sectorSize), partCount*sectorSize));
+					cursor.advance(partCount);
+					remaining -= partCount;
+				}
+				TRY(ideChannel.end_prdt());
+
+				return {};
+			}
+
+			// transfer the buffers given to prepare_dma()
+			auto transfer_dma(bool isWrite, U64 sector, U32 count, bool lba48) -> Try<> {
+				auto &busMaster = ideChannel.busMaster;
+
+				TRY(ideChannel.wait_for_status(transferTimeout));
+
+				const U8 direction = isWrite?0:(U8)BusMasterCommand::toMemory;
+				busMaster.write_command(direction);
+				busMaster.write_status(busMaster.read_status()|(U8)BusMasterStatus::error|(U8)BusMasterStatus::interrupt);
+				busMaster.write_prdt(ideChannel.prdtPhysical);
+
+				ideChannel.select_lba(drive, sector, count, lba48);
+
+				ideChannel.isDmaPending = true;
+				ideChannel.command(isWrite?(lba48?Command::writeDmaExt:Command::writeDma):(lba48?Command::readDmaExt:Command::readDma));
+				busMaster.write_command(direction|(U8)BusMasterCommand::start);
+
+				auto result = ideChannel.wait_for_dma(transferTimeout);
+
+				busMaster.write_command(direction);
+
+				if(!result){
+					// the drive may still be part way through the command, so reset it before anything else uses the channel
+					ideChannel.reset();
+					return result;
+				}
+
+				if(ideChannel.dmaStatus&(U8)BusMasterStatus::error) return Failure{"DMA transfer failed"};
+				if(ideChannel.driveStatus&((U8)Status::error|(U8)Status::driveWriteFault)) return Failure{"drive error during DMA transfer"};
+
+				return {};
+			}
+
+			auto transfer_pio(bool isWrite, U64 sector, U32 count, Cursor cursor, bool lba48) -> Try<> {
+				TRY(ideChannel.wait_for_status(transferTimeout));
+
+				ideChannel.select_lba(drive, sector, count, lba48);
+				ideChannel.command(isWrite?(lba48?Command::writePioExt:Command::writePio):(lba48?Command::readPioExt:Command::readPio));
+				ideChannel.delay_400ns();
+
+				const auto sectorWords = sectorSize/2;
+
+				for(auto i=0u;i<count;i++){
+					const auto status = TRY_RESULT(ideChannel.wait_for_status(transferTimeout));
+					if((U8)status&((U8)Status::error|(U8)Status::driveWriteFault)) return Failure{"drive error during PIO transfer"};
+					if(!((U8)status&(U8)Status::dataRequestReady)) return Failure{"drive not ready for PIO transfer"};
+
+					auto data = (U16*)cursor.get_buffer(sectorSize);
+
+					if(isWrite){
+						for(auto word=0u;word<sectorWords;word++) ideChannel.write16(Register::data, data[word]);
+					}else{
+						for(auto word=0u;word<sectorWords;word++) data[word] = ideChannel.read16(Register::data);
+					}
+
+					ideChannel.delay_400ns();
+					cursor.advance(1);
 				}
 
 				return {};
@@ -406,6 +729,9 @@ namespace driver::storage {
 				return isRemovable;
 			}
 
+			//TODO: transfer through SCSI read/write packets
+			auto transfer(StorageController::Request&, bool useDma) -> Try<> override { return Failure{"not supported"}; }
+
 			auto send_command(ScsiCommand command, U16 p1, U16 p2, U16 p3, U16 p4, U16 p5) -> Try<Status> {
 				U16 data[5] = {p1, p2, p3, p4, p5};
 				return send_command(command, data);
@@ -440,6 +766,36 @@ namespace driver::storage {
 
 		Lock<LockType::flat> lock;
 
+		// claims the disk's channel for a transfer, waiting on anything else using it
+		// (transfers run without the lock held, so that the irq can reach us)
+		auto claim_disk(U32 id) -> Try<AtaDisk*> {
+			while(true){
+				{
+					Lock_Guard guard(lock);
+
+					auto disk = get_disk_by_id(id);
+					if(!disk) return Failure{"drive not present"};
+
+					if(!disk->ideChannel.isBusy){
+						disk->ideChannel.isBusy = true;
+						return disk;
+					}
+				}
+
+				if(scheduler){
+					scheduler->yield();
+				}else{
+					asm("pause");
+				}
+			}
+		}
+
+		void release_disk(AtaDisk &disk) {
+			Lock_Guard guard(lock);
+
+			disk.ideChannel.isBusy = false;
+		}
+
 		AutomaticDriverReference<StorageManager> storageManager;
 
 		const char *driveNames[4] = {};
@@ -463,6 +819,9 @@ namespace driver::storage {
 		auto storageManager = storage::storageManager.get();
 		if(!storageManager) return Failure{"StorageManager unavailable"};
 
+		// (optional, without it we poll for dma completion)
+		scheduler = drivers::find_and_activate<driver::Scheduler>(this);
+
 		if(!driveNames[0]){
 			for(auto i=0;i<4;i++){
 				driveNames[i] = storageManager->allocate_name({prefix:"pata", systemMapping:true}, *this);
@@ -495,9 +854,10 @@ namespace driver::storage {
 		ideChannel[(U8)Bus::secondary].busMaster.ioPort = 0;
 		ideChannel[(U8)Bus::secondary].busMaster.address = nullptr;
 
-		if(!progIf.isBusMaster) return Failure{"bus mastering (DMA) is not supported for this ide controller"};
+		if(!progIf.isBusMaster){
+			log.print_warning("bus mastering (DMA) is not supported for this ide controller - using PIO");
 
-		{ // retrieve bus master
+		}else{ // retrieve bus master
 			if(pciDevice->bar[4].ioPort){
 				ideChannel[(U8)Bus::primary].busMaster.ioPort = TRY_RESULT(api.subscribe_ioPort(pciDevice->bar[4].ioPort));
 				ideChannel[(U8)Bus::secondary].busMaster.ioPort = TRY_RESULT(api.subscribe_ioPort(ideChannel[(U8)Bus::primary].busMaster.ioPort + 8));
@@ -529,9 +889,21 @@ namespace driver::storage {
 			}
 		}
 
+		{ // retrieve irqs (legacy channels have fixed ones, native channels share the pci interrupt line)
+			const auto pciIrq = pciDevice->readConfig8((UPtr)PciDevice::RegisterOffset::interrupt_line);
+
+			ideChannel[(U8)Bus::primary].irq = progIf.primaryIsPciNativeMode?pciIrq:legacyIrqAta2;
+			ideChannel[(U8)Bus::secondary].irq = progIf.secondaryIsPciNativeMode?pciIrq:legacyIrqAta1;
+		}
+
 		for(auto bus=Bus::primary; bus<=Bus::max; bus=(Bus)((U8)bus+1)){
 			auto &channel = ideChannel[(U8)bus];
 
+			channel.selectedDrive = (Drive)0xff;
+			channel.isBusy = false;
+			channel.isDmaPending = false;
+			channel.hasIrq = false;
+
 			// does the bus appear to be present?
 			if(channel.read8(Register::command)==0xff) continue;
 
@@ -547,6 +919,36 @@ namespace driver::storage {
 			channel.write8(Register::control, 1);
 
 			channel.isPresent = true;
+
+			// native channels share the pci interrupt line, so it's only subscribed to once (_on_irq() checks both channels)
+			const auto &primary = ideChannel[(U8)Bus::primary];
+			if(bus!=Bus::primary&&primary.hasIrq&&primary.irq==channel.irq){
+				channel.hasIrq = true;
+
+			}else if(auto result = api.subscribe_irq(channel.irq)){
+				channel.hasIrq = true;
+
+			}else{
+				log.print_warning("unable to subscribe to irq ", channel.irq, " - polling for completion: ", result.errorMessage);
+			}
+
+			if(channel.hasIrq){
+				channel.write_control(0); // allow the drives to raise irqs
+			}
+
+			if(channel.busMaster.ioPort||channel.busMaster.address){
+				if(!channel.prdt){
+					auto page = memory::Transaction().allocate_page();
+					const auto physical = page?mmu::kernel::transaction().get_physical(page).address:0;
+
+					if(page&&(U64)physical+memory::pageSize<=0x100000000ull){
+						channel.prdt = (PrdEntry*)page;
+						channel.prdtPhysical = (U32)physical;
+					}else{
+						log.print_warning("unable to allocate a PRD table - using PIO");
+					}
+				}
+			}
 			// log.print_debug("bus ", (U32)bus+1, " found");
 
 			for(auto drive=Drive::master; drive<=Drive::max; drive=(Drive)((U8)drive+1)){
@@ -630,6 +1032,8 @@ namespace driver::storage {
 
 				disk->sectorSize = infoBlock.get_sector_size();
 				disk->size = infoBlock.get_sector_size()*sectorCount;
+				disk->isLba48 = infoBlock.get_accessMode()==Infoblock::AccessMode::lba48;
+				disk->isDmaSupported = !!infoBlock.dmaSupported;
 
 				log.print_info("found ", driveName, " sectorSize = ", disk->sectorSize);
 
@@ -661,6 +1065,23 @@ namespace driver::storage {
 			}
 		}
 
+		// each bus transfers its queued requests on its own thread, so both can be busy at once (without one, they're transferred by whoever submitted them)
+		if(scheduler){
+			void (*const entrypoints[(U8)Bus::max+1])() = {
+				[]() { Ide::instance._run_channel((U8)Bus::primary); },
+				[]() { Ide::instance._run_channel((U8)Bus::secondary); }
+			};
+
+			for(auto bus=Bus::primary; bus<=Bus::max; bus=(Bus)((U8)bus+1)){
+				auto &channel = ideChannel[(U8)bus];
+				if(!channel.isPresent||channel.requestThread) continue;
+
+				auto &process = process::create_kernel(bus==Bus::primary?"ide primary":"ide secondary");
+				channel.requestThread = &process.create_kernel_thread(entrypoints[(U8)bus]);
+				scheduler->add_thread(*channel.requestThread);
+			}
+		}
+
 		return {};
 	}
 
@@ -762,4 +1183,81 @@ namespace driver::storage {
 
 		return disk->eject();
 	}
+
+	auto Ide::get_drive_sectorSize(U32 id) -> Try<U32> {
+		Lock_Guard guard(lock);
+
+		auto disk = get_disk_by_id(id);
+		if(!disk) return Failure{"drive not present"};
+
+		return disk->sectorSize;
+	}
+
+	auto Ide::_transfer(Request &request) -> Try<> {
+		auto disk = TRY_RESULT(claim_disk(request.drive));
+
+		auto result = disk->transfer(request, isDmaEnabled);
+
+		release_disk(*disk);
+
+		return result;
+	}
+
+	auto Ide::_on_request_queued(U32 drive) -> bool {
+		// (the request lock is held, so the thread can't be part way into pausing)
+		for(auto disk:disks){
+			if(disk->id!=drive) continue;
+
+			auto thread = disk->ideChannel.requestThread;
+			if(!thread) return false;
+
+			if(thread->state==Thread::State::paused){
+				thread->resume();
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	void Ide::_run_channel(U8 bus) {
+		auto &channel = ideChannel[bus];
+		auto &thread = *scheduler->get_current_thread();
+
+		while(true){
+			for(auto disk:disks){
+				if(&disk->ideChannel!=&channel) continue;
+
+				_process_requests(disk->id);
+			}
+
+			{
+				Lock_Guard guard(requestLock);
+
+				auto hasRequests = false;
+				for(auto disk:disks){
+					if(&disk->ideChannel==&channel&&_has_requests(disk->id)){
+						hasRequests = true;
+						break;
+					}
+				}
+
+				// nothing more to do, so wait until something's queued (which resumes us)
+				if(!hasRequests){
+					thread.pause();
+				}
+			}
+
+			scheduler->yield();
+		}
+	}
+
+	void Ide::_on_irq(U8 irq) {
+		for(auto &channel:ideChannel){
+			if(!channel.isPresent||!channel.hasIrq||channel.irq!=irq) continue;
+
+			channel.on_irq();
+		}
+	}
 }
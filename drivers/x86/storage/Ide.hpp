@@ -21,5 +21,16 @@ namespace driver::storage {
 		auto is_drive_present(U32) -> Try<bool> override;
 		auto is_drive_removable(U32) -> Try<bool> override;
 		auto eject_drive(U32) -> Try<bool> override;
+
+		auto get_drive_sectorSize(U32) -> Try<U32> override;
+
+		bool isDmaEnabled = true; // when disabled (or unsupported) transfers fall back to PIO
+
+		void _on_irq(U8) override;
+		void _run_channel(U8 bus); // (request thread for each bus)
+
+	protected:
+		auto _transfer(Request&) -> Try<> override;
+		auto _on_request_queued(U32 drive) -> bool override;
 	};
 }
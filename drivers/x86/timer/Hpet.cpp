@@ -283,6 +283,8 @@ namespace driver {
 			auto interruptStatus = registers->read_interruptStatus();
 			if(!interruptStatus.isInterruptActive(clockId)) return;
 
+			_on_wakeup();
+
 			clock[clockId].callback(clock[clockId].callbackData);
 		}
 
@@ -351,5 +353,9 @@ namespace driver {
 		auto Hpet::schedule_important(U32 usecs, ScheduledCallback callback, void *data) -> U32 {
 			return timerQueue.schedule_important(usecs, callback, data);
 		}
+
+		void Hpet::cancel(U32 id) {
+			timerQueue.cancel(id);
+		}
 	}
 }
\ No newline at end of file
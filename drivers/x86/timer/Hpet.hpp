@@ -20,6 +20,7 @@ namespace driver::timer {
 		auto now64() -> U64 override;
 		auto schedule(U32 usecs, ScheduledCallback, void *data) -> U32 override;
 		auto schedule_important(U32 usecs, ScheduledCallback, void *data) -> U32 override;
+		void cancel(U32 id) override;
 
 		auto get_timer_count() -> U8 override;
 		void set_timer(U8 timer, U32 usecs, Callback, void *data) override;
@@ -1,13 +1,16 @@
 #include "Cli.hpp"
 
+#include <drivers/DisplayManager.hpp>
 #include <drivers/Graphics.hpp>
 #include <drivers/Interrupt.hpp>
 #include <drivers/Processor.hpp>
 #include <drivers/Serial.hpp>
+#include <drivers/StorageManager.hpp>
 
 #include <kernel/console.hpp>
 #include <kernel/Driver.hpp>
 #include <kernel/drivers.hpp>
+#include <kernel/lockStats.hpp>
 #include <kernel/Log.hpp>
 #include <kernel/memory.hpp>
 #include <kernel/mmio.hpp>
@@ -398,7 +401,7 @@ namespace cli {
 		void(*execute)(Cli &cli, VerbObject *object, const char *path, const char *parameters);
 	};
 
-	Verb verbs[4] = {
+	Verb verbs[7] = {
 		{ "?", "help", "Show help",
 			[](Cli &cli, VerbObject *object, const char *path, const char *parameters) {
 				log.print_info("Use ", format_verb, "verbs", format_none, " to list all currently valid actions");
@@ -473,6 +476,80 @@ namespace cli {
 				delete cli.currentPath;
 				cli.currentPath = strcpy(new C8[strlen(path)], path);
 			}
+		},
+		{ "locks", "", "Show lock contention statistics",
+			[](Cli &cli, VerbObject *object, const char *path, const char *parameters) {
+				#ifdef LOCK_STATS
+					const auto count = lockStats::get_count();
+					if(!count){
+						log.print_info("No locks have been taken yet");
+						return;
+					}
+
+					for(auto i=0u;i<count;i++){
+						auto &entry = lockStats::get_entry(i);
+						const auto acquires = entry.acquireCount.load();
+						const auto contended = entry.contendedCount.load();
+
+						log.print_info_start();
+						log.print_inline(format_object, entry.name.load(), format_none, " - ", acquires, acquires==1?" acquire":" acquires", ", ", contended, " contended");
+						if(acquires){
+							log.print_inline(" (", contended*100/acquires, "%)");
+						}
+						log.print_inline(", ", entry.maxHoldTime.load(), "us max hold");
+						log.print_end();
+					}
+				#else
+					log.print_warning("Lock statistics are not recorded in this build (build with LOCK_STATS defined)");
+				#endif
+			}
+		},
+		{ "frames", "", "Show how much the compositor writes to ram and video memory",
+			[](Cli &cli, VerbObject *object, const char *path, const char *parameters) {
+				auto displayManager = drivers::find_active<driver::DisplayManager>();
+				if(!displayManager){
+					log.print_warning("Display manager not active");
+					return;
+				}
+
+				const auto stats = displayManager->get_frame_stats();
+				if(!stats.frameCount){
+					log.print_info("No frames have been composited yet");
+					return;
+				}
+
+				log.print_info(format_object, "Frames", format_none, " - ", stats.frameCount);
+				log.print_info(format_object, "Last frame", format_none, " - ", stats.lastFrameRamBytes/1024, "KiB to ram, ", stats.lastFrameVramBytes/1024, "KiB to video memory");
+				log.print_info(format_object, "Average", format_none, " - ", stats.ramBytes/stats.frameCount/1024, "KiB to ram, ", stats.vramBytes/stats.frameCount/1024, "KiB to video memory");
+			}
+		},
+		{ "cache", "", "Show block cache statistics",
+			[](Cli &cli, VerbObject *object, const char *path, const char *parameters) {
+				auto storageManager = drivers::find_active<driver::StorageManager>();
+				if(!storageManager){
+					log.print_warning("Storage manager not active");
+					return;
+				}
+
+				const auto stats = storageManager->get_cache_stats();
+				if(!stats.blockCount){
+					log.print_info("No block cache is allocated");
+					return;
+				}
+
+				const auto lookups = stats.hits+stats.misses;
+
+				log.print_info(format_object, "Size", format_none, " - ", stats.blockCount, " blocks of ", stats.blockSize/1024, "KiB (", stats.usedBlocks, " used, ", stats.dirtyBlocks, " dirty)");
+				log.print_info_start();
+				log.print_inline(format_object, "Lookups", format_none, " - ", stats.hits, " hits, ", stats.misses, " misses");
+				if(lookups){
+					log.print_inline(" (", stats.hits*100/lookups, "% hit rate)");
+				}
+				log.print_end();
+				log.print_info(format_object, "Evictions", format_none, " - ", stats.evictions);
+				log.print_info(format_object, "Read ahead", format_none, " - ", stats.readAheads, " blocks");
+				log.print_info(format_object, "Written back", format_none, " - ", stats.writeBacks, " blocks, ", stats.writeErrors, " errors");
+			}
 		}
 	};
 }
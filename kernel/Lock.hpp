@@ -2,11 +2,16 @@
 
 #include <kernel/CriticalSection.hpp>
 
+#ifdef LOCK_STATS
+	#include <kernel/lockStats.hpp>
+#endif
+
 #include <atomic>
 
 enum struct LockType {
 	flat, // no nesting allowed - single depth
-	recursive // nested locking allowed within the same processor
+	recursive, // nested locking allowed within the same processor
+	ticket // no nesting allowed, and processors are granted the lock in the order they asked for it (fair, so none can be starved under contention)
 };
 
 template <LockType lockType>
@@ -47,6 +52,11 @@ protected:
 	#ifdef HAS_SMP
 		std::atomic<U32> lockActive = 0;
 	#endif
+
+	#ifdef LOCK_STATS
+		lockStats::Entry *stats = nullptr;
+		U64 lockedTime = 0;
+	#endif
 };
 
 template <>
@@ -66,6 +76,36 @@ protected:
 		std::atomic<U32> lockDepth = 0;
 		std::atomic<U32> lockProcessor = ~0;
 	#endif
+
+	#ifdef LOCK_STATS
+		lockStats::Entry *stats = nullptr;
+		U64 lockedTime = 0;
+		U32 statsDepth = 0;
+	#endif
+};
+
+template <>
+struct Lock<LockType::ticket>: NonCopyable<Lock<LockType::ticket>> {
+	constexpr /**/ Lock(const char *name = "unnamed"):
+		name(name)
+	{}
+
+	void lock();
+	void unlock();
+
+	const char *name;
+
+protected:
+
+	#ifdef HAS_SMP
+		std::atomic<U32> nextTicket = 0; // taken by each processor on arrival
+		std::atomic<U32> nowServing = 0; // the ticket currently holding the lock
+	#endif
+
+	#ifdef LOCK_STATS
+		lockStats::Entry *stats = nullptr;
+		U64 lockedTime = 0;
+	#endif
 };
 
 #include "Lock.inl"
@@ -7,19 +7,31 @@
 inline void Lock<LockType::flat>::lock() {
 	CriticalSection::lock();
 
+	[[maybe_unused]] auto wasContended = false;
+
 	#ifdef HAS_SMP
 		while(true){
 			U32 expected = 0;
 			if(lockActive.compare_exchange_weak(expected, 1, std::memory_order_acquire)) break;
 
+			wasContended = true;
+
 			do {
 				processor::pause();
 			}while(lockActive.load(std::memory_order_relaxed) & 1);
 		}
 	#endif
+
+	#ifdef LOCK_STATS
+		lockStats::on_locked(stats, name, wasContended, lockedTime);
+	#endif
 }
 
 inline void Lock<LockType::flat>::unlock() {
+	#ifdef LOCK_STATS
+		lockStats::on_unlocked(stats, lockedTime);
+	#endif
+
 	#ifdef HAS_SMP
 		lockActive = 0;
 	#endif
@@ -30,6 +42,8 @@ inline void Lock<LockType::flat>::unlock() {
 inline void Lock<LockType::recursive>::lock() {
 	CriticalSection::lock();
 
+	[[maybe_unused]] auto wasContended = false;
+
 	#ifdef HAS_SMP
 		auto processor = processor::get_active_id();
 
@@ -37,6 +51,8 @@ inline void Lock<LockType::recursive>::lock() {
 			auto expected = (U32)~0;
 			if(lockProcessor.compare_exchange_weak(expected, processor, std::memory_order_acquire) || expected==processor) break;
 
+			wasContended = true;
+
 			do {
 				processor::pause();
 			}while(lockProcessor.load(std::memory_order_relaxed) != (U32)~0);
@@ -44,9 +60,22 @@ inline void Lock<LockType::recursive>::lock() {
 
 		lockDepth++;
 	#endif
+
+	#ifdef LOCK_STATS
+		// only the outermost lock counts, so nested locking isn't mistaken for extra acquires
+		if(!statsDepth++){
+			lockStats::on_locked(stats, name, wasContended, lockedTime);
+		}
+	#endif
 }
 
 inline void Lock<LockType::recursive>::unlock() {
+	#ifdef LOCK_STATS
+		if(!--statsDepth){
+			lockStats::on_unlocked(stats, lockedTime);
+		}
+	#endif
+
 	#ifdef HAS_SMP
 		if(lockDepth.fetch_sub(1)==1){
 			lockProcessor = (U32)~0;
@@ -55,3 +84,38 @@ inline void Lock<LockType::recursive>::unlock() {
 
 	CriticalSection::unlock();
 }
+
+inline void Lock<LockType::ticket>::lock() {
+	CriticalSection::lock();
+
+	[[maybe_unused]] auto wasContended = false;
+
+	#ifdef HAS_SMP
+		const auto ticket = nextTicket.fetch_add(1, std::memory_order_relaxed);
+
+		if(nowServing.load(std::memory_order_acquire)!=ticket){
+			wasContended = true;
+
+			do {
+				processor::pause();
+			}while(nowServing.load(std::memory_order_acquire)!=ticket);
+		}
+	#endif
+
+	#ifdef LOCK_STATS
+		lockStats::on_locked(stats, name, wasContended, lockedTime);
+	#endif
+}
+
+inline void Lock<LockType::ticket>::unlock() {
+	#ifdef LOCK_STATS
+		lockStats::on_unlocked(stats, lockedTime);
+	#endif
+
+	#ifdef HAS_SMP
+		// only the holder ever writes this, so no need for an atomic increment
+		nowServing.store(nowServing.load(std::memory_order_relaxed)+1, std::memory_order_release);
+	#endif
+
+	CriticalSection::unlock();
+}
@@ -5,7 +5,8 @@
 struct Log {
 	const char *name;
 	
-	/**/ Log(const char *name):
+	// (constexpr, so that static logs are usable even before global constructors have run)
+	constexpr /**/ Log(const char *name):
 		name(name)
 	{}
 
@@ -97,6 +97,15 @@ struct Thread: LListItem<Thread> {
 	void set_priority(U16 priority);
 
 	U32 _pending_timer_id = 0;
+	U8 _pending_timer_processor = 0; // which processor's timer the wakeup was scheduled on
+
+	// scheduler bookkeeping, so that it can find and move us in O(1)
+	std::atomic<U8> _schedulerQueue = 0; // which of its queues we're on
+	std::atomic<U8> _schedulerProcessor = 0; // which processor's queue, if it has one per processor
+	std::atomic<bool> _schedulerRemoved = false; // removed while queued on another processor, for that processor to drop next time it comes across it
+	std::atomic<bool> _schedulerIsRunning = false; // running on (or still being switched away from on) some processor, so can't yet be run by another
+	U8 _schedulerBand = 0; // priority band while active (may drop below our priority's band after using full time slices)
+	U32 _schedulerPriority = 0; // priority * process priority, as of when we were queued
 };
 
 #include <common/stdlib.hpp>
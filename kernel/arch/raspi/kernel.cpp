@@ -36,6 +36,9 @@ namespace arch {
 
 				arch::raspi::serial::init();
 
+				// (before the kernel hands the heap to the page allocator)
+				arch::raspi::memory::size_heap();
+
 				::kernel::run();
 			}
 		}
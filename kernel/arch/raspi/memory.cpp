@@ -2,17 +2,14 @@
 
 #include <kernel/arch/raspi/atags.hpp>
 #include <kernel/arch/raspi/hwquery.hpp>
+#include <kernel/arch/raspi/mailbox.hpp>
 #include <kernel/arch/raspi/memory.hpp>
 #include <kernel/kernel.h>
 #include <kernel/Log.hpp>
 
-#include <common/LList.hpp>
-#include <common/MemoryPool.hpp>
 #include <common/stdlib.hpp>
 #include <common/types.hpp>
 
-#include <new>
-
 static Log log("memory");
 
 extern U8 __text_start;
@@ -25,22 +22,27 @@ extern U8 __bss_start;
 extern U8 __bss_end;
 extern U8 __end;
 
-namespace memory {
-	extern LList<Page> freePages;
-	// extern MemoryPool<32> *heap;
-}
-
-
 namespace arch {
 	namespace raspi {			
 		namespace memory {
-			Page *pageData;
-			U32 pageDataSize;
-
-			using ::memory::freePages;
 			using ::memory::pageSize;
 			using ::memory::totalMemory;
-			using ::memory::Page;
+
+			void size_heap() {
+				// the heap runs from the end of the kernel up to the end of the arm's share of memory (the gpu's follows it)
+				mailbox::PropertyMessage tags[2];
+				tags[0].tag = mailbox::PropertyTag::get_arm_memory;
+				tags[1].tag = mailbox::PropertyTag::null_tag;
+
+				if(!mailbox::send_messages(tags)) return;
+
+				const auto heapStart = ::memory::heap.address;
+				const auto heapEnd = (UPtr)tags[0].data.memory.address+tags[0].data.memory.size;
+
+				if(heapEnd>heapStart){
+					::memory::heapSize = (heapEnd-heapStart)/pageSize*pageSize;
+				}
+			}
 
 			void init() {
 				auto section = log.section("arch::raspi::memory::init...");
@@ -67,33 +69,18 @@ namespace arch {
 
 				log.print_info("total memory: ", totalMemory/1024/1024, "MB");
 				log.print_info("kernel stack: ", stackSize/1024, "KB");
-				// log.print("kernel heap: ", heapSize/1024, "KB\n");
 
 				log.print_info("page size: ", pageSize/1024, "KB");
 
-				#pragma GCC diagnostic push
-				#pragma GCC diagnostic ignored "-Warray-bounds"
-					// heap = (MemoryPool<32>*)((U8*)&__end)+stackSize;
-					auto kernelEnd = ::memory::heap + ::memory::heapSize;
-				#pragma GCC diagnostic pop
-
-				// { //initialise heap
-				// 	bzero(heap, heapSize); //clear to be safe
-				// 	new (heap) MemoryPool<32>(((U8*)heap)+sizeof(MemoryPool<32>), heapSize);
-				// }
+				const auto heapStart = ::memory::heap.address;
 
 				auto pageCount = totalMemory / pageSize;
-				pageData = (Page*)kernelEnd;
-				pageDataSize = (pageCount * sizeof(Page) + pageSize-1) / pageSize * pageSize;
-
-				auto kernelPageCount = ((size_t)kernelEnd+pageDataSize+pageSize-1) / pageSize;
-
-				if(kernelPageCount>pageCount) pageCount = kernelPageCount;
+				auto kernelPageCount = (heapStart+pageSize-1) / pageSize;
 				auto vramPageCount = (hwquery::videoMemory+pageSize-1) / pageSize;
-				auto userPageCount = pageCount-kernelPageCount-vramPageCount;
+				auto heapPageCount = ::memory::heapSize / pageSize;
 
 				log.print_debug("kernel start @ ", &__end);
-				log.print_debug("kernel end @ ", kernelEnd);
+				log.print_debug("heap @ ", (void*)heapStart, " - ", (void*)(heapStart+::memory::heapSize));
 
 				log.print_debug("text @ ", &__text_start, " - ", &__text_end);
 				log.print_debug("rodata @ ", &__rodata_start, " - ", &__rodata_end);
@@ -103,59 +90,8 @@ namespace arch {
 				log.print_info("pages: ", pageCount);
 				log.print_info(kernelPageCount, " kernel pages");
 				log.print_info(vramPageCount, " vram pages");
-				log.print_info(userPageCount, " user pages");
+				log.print_info(heapPageCount, " heap pages");
 				log.print_info("");
-
-				{ // initialise pages
-					auto section = log.section("Clearing pages...");
-
-					auto i = 0u;
-
-					{ // kernel pages
-						// auto section = log.section("Clearing kernel...");
-
-						// log.print_info_start();
-
-						for(;i<kernelPageCount;i++) {
-							// log.print("kernel page ", i, "\n");
-							auto page = new (&pageData[i]) Page((void*)(i*pageSize));
-							page->virtualAddress = i*pageSize;
-							page->isAllocated = true;
-							page->isKernel = true;
-							page->hasNextPage = i+1<kernelPageCount;
-
-							// log.print_inline('.');
-						}
-
-						// log.print_end();
-					}
-
-					{ // user pages
-						// auto section = log.section("Clearing user...");
-
-						// log.print_info_start();
-
-						for(;i<pageCount;i++) {
-							// log.print("user page ", i, "\n");
-							const auto address = (void*)(i*pageSize);
-							auto page = new (&pageData[i]) Page(address);
-							page->hasNextPage = i+1<pageCount;
-
-							if(address>=hwquery::videoMemoryStart&&address<(void*)((U64)hwquery::videoMemoryStart+hwquery::videoMemory)){
-								page->isAllocated = true;
-								page->isKernel = true; //technically vram, not kernel ¯\_(ツ)_/¯
-								
-							}else{
-								freePages.push_back(*page);
-							}
-							// return;
-
-							// log.print_inline('.');
-						}
-
-						// log.print_end();
-					}
-				}
 			}
 		}
 	}
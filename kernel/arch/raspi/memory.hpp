@@ -5,6 +5,7 @@
 namespace arch {
 	namespace raspi {
 		namespace memory {
+			void size_heap(); // runs before global constructors and logging, so mustn't rely on either
 			void init();
 		}
 	}
@@ -1,6 +1,7 @@
 #include "mmu.hpp"
 
 #include <kernel/arch/x86/cpuInfo.hpp>
+#include <kernel/arch/x86/msr.hpp>
 #include <kernel/assert.hpp>
 #include <kernel/memory.hpp>
 
@@ -39,11 +40,64 @@ namespace mmu {
 			//TODO: fail gracefully if out of tables
 			return tables[nextTableIndex++];
 		}
+
+		// page attribute table (PAT) memory types
+		enum struct PatType: U8 {
+			uncached = 0x00,
+			writeCombining = 0x01,
+			writeThrough = 0x04,
+			writeProtected = 0x05,
+			writeBack = 0x06,
+			uncachedMinus = 0x07 // uncached, unless overridden by the MTRRs
+		};
+
+		const U32 patMsr = 0x277;
+
+		// each page selects one of these by its pat, pat_disableCache and pat_writeThroughCaching bits (in that order)
+		// these are the power-on defaults, except for the last, which is write combining rather than uncached
+		const PatType patEntries[8] = {
+			PatType::writeBack, PatType::writeThrough, PatType::uncachedMinus, PatType::uncached,
+			PatType::writeBack, PatType::writeThrough, PatType::uncachedMinus, PatType::writeCombining
+		};
+
+		void set_pat() {
+			U32 lo = 0, hi = 0;
+			for(auto i=0u;i<4;i++){
+				lo |= (U32)patEntries[i]<<i*8;
+				hi |= (U32)patEntries[4+i]<<i*8;
+			}
+
+			::arch::x86::msr::set(patMsr, lo, hi);
+		}
+
+		void set_caching(Mapping::TableEntry &entry, Caching caching) {
+			entry.pat_writeThroughCaching = caching==Caching::writeThrough||caching==Caching::writeCombining;
+			entry.pat_disableCache = caching==Caching::uncached||caching==Caching::writeCombining;
+			entry.pat = caching==Caching::writeCombining;
+		}
+
+		auto get_caching(Mapping::TableEntry &entry) -> Caching {
+			switch(patEntries[entry.pat<<2|entry.pat_disableCache<<1|entry.pat_writeThroughCaching]){
+				case PatType::writeCombining:
+					return Caching::writeCombining;
+				case PatType::writeThrough:
+				case PatType::writeProtected:
+					return Caching::writeThrough;
+				case PatType::uncached:
+				case PatType::uncachedMinus:
+					return Caching::uncached;
+				case PatType::writeBack:
+				default:
+					return Caching::writeBack;
+			}
+		}
 	}
 
 	void init() {
 		assert(::arch::x86::cpuInfo::get_features().pat, "PAT not supported by cpu");
 
+		set_pat();
+
 		{
 			// allocate enough to address all heap (plus 1/8th for shared memory overlap)
 			auto pages = (((memory::heapSize+memory::pageSize-1)/memory::pageSize)*9/8 / 1024 * sizeof(Mapping::Table) + memory::pageSize-1) / memory::pageSize;
@@ -270,11 +324,9 @@ namespace mmu {
 		debug::assert(tableEntry.isPresent);
 		tableEntry.isWritable = options.isWritable;
 		tableEntry.isUserspaceAccessible = options.isUserspace;
-		tableEntry.pat_writeThroughCaching = options.caching==Caching::writeThrough||options.caching==Caching::writeCombining;
-		tableEntry.pat_disableCache = options.caching==Caching::uncached||options.caching==Caching::writeCombining;
+		set_caching(tableEntry, options.caching);
 		tableEntry.isAccessed = false;
 		tableEntry.isDirty = true;
-		tableEntry.pat = false;
 		tableEntry.isGlobal = false;
 		tableEntry.set_address(physical);
 
@@ -377,11 +429,9 @@ namespace mmu {
 		debug::assert(tableEntry.isPresent);
 		tableEntry.isWritable = options.isWritable;
 		tableEntry.isUserspaceAccessible = options.isUserspace;
-		tableEntry.pat_writeThroughCaching = options.caching==Caching::writeThrough||options.caching==Caching::writeCombining;
-		tableEntry.pat_disableCache = options.caching==Caching::uncached||options.caching==Caching::writeCombining;
+		set_caching(tableEntry, options.caching);
 		tableEntry.isAccessed = false;
 		tableEntry.isDirty = true;
-		tableEntry.pat = false;
 		tableEntry.isGlobal = false;
 		tableEntry.set_address(physical);
 
@@ -500,8 +550,7 @@ namespace mmu {
 
 		tableEntry.isUserspaceAccessible = options.isUserspace;
 		tableEntry.isWritable = options.isWritable;
-		tableEntry.pat_writeThroughCaching = options.caching==Caching::writeThrough||options.caching==Caching::writeCombining;
-		tableEntry.pat_disableCache = options.caching==Caching::uncached||options.caching==Caching::writeCombining;
+		set_caching(tableEntry, options.caching);
 
 		//TODO: CLFLUSH?
 
@@ -539,19 +588,7 @@ namespace mmu {
 		options.isWritable = tableEntry.isWritable;
 		options.isExecutable = true;
 
-		if(tableEntry.pat_writeThroughCaching){
-			if(tableEntry.pat_disableCache){
-				options.caching = Caching::writeCombining;
-			}else{
-				options.caching = Caching::writeThrough;
-			}
-		}else{
-			if(tableEntry.pat_disableCache){
-				options.caching = Caching::uncached;
-			}else{
-				options.caching = Caching::writeBack;
-			}
-		}
+		options.caching = get_caching(tableEntry);
 
 		return options;
 	}
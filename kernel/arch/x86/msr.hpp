@@ -7,15 +7,15 @@ namespace arch {
 
 		// Model Specific Registers - For P6 CPUs onwards (pentium pro ++)
 		namespace msr {
-			auto has_msr() -> bool {
+			inline auto has_msr() -> bool {
 				return arch::x86::cpuInfo::get_features().msr;
 			}
 
-			void get(U32 msr, U32 &lo, U32 &hi) {
+			inline void get(U32 msr, U32 &lo, U32 &hi) {
 				asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
 			}
 
-			void set(U32 msr, U32 lo, U32 hi) {
+			inline void set(U32 msr, U32 lo, U32 hi) {
 				asm volatile("wrmsr" :: "a"(lo), "d"(hi), "c"(msr));
 			}
 		}
@@ -5,6 +5,7 @@
 #include <drivers/Processor.hpp>
 #include <drivers/Serial.hpp>
 #include <drivers/StorageManager.hpp>
+#include <drivers/Timer.hpp>
 
 #include <kernel/arch/x86/PciDevice.hpp>
 #include <kernel/Driver.hpp>
@@ -520,6 +521,15 @@ namespace drivers {
 					log.print_warning(indent, "  ", "None found");
 				}
 			}
+
+		}else if(auto timer = driver.as_type<driver::Timer>()){
+			if(!driver.api.is_active()) return false;
+
+			log.print_info(indent, beforeName, "timers", afterName, ": ", timer->get_timer_count());
+			log.print_info(indent, beforeName, "wakeups", afterName, ": ", timer->get_wakeups_per_second(), "/s");
+			log.print_info(indent, beforeName, "slack", afterName, ": ", timer->scheduleSlack, " us");
+
+			return true;
 		}
 
 
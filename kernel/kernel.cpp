@@ -31,7 +31,6 @@ static Log log("kernel");
 using namespace maths;
 
 namespace memory {
-	extern LList<::memory::Page> freePages;
 	extern memory::PagedPool<sizeof(size_t)> kernelHeap;
 }
 
@@ -52,9 +51,6 @@ namespace drivers {
 	void print_summary();
 }
 
-U64 vramWrites = 0;
-U64 ramWrites = 0;
-
 static DriverReference<driver::DisplayManager> displayManager{nullptr, [](void*){}, nullptr};
 static DriverReference<driver::Scheduler> scheduler{nullptr, [](void*){}, nullptr};
 
@@ -177,12 +173,16 @@ namespace kernel {
 		// utils::logWindow::hide();
 
 		#ifdef MEMORY_CHECKS
-			debug_llist(memory::kernelHeap.availableBlocks, "availableBlocks 1");
+			for(auto &bin:memory::kernelHeap.availableBins){
+				debug_llist(bin, "availableBins 1");
+			}
 		#endif
 
 		// thread::create_kernel_thread("ram test", []() {
 		// 	#ifdef MEMORY_CHECKS
-		// 		debug_llist(memory::kernelHeap.availableBlocks, "availableBlocks 3");
+		// 		for(auto &bin:memory::kernelHeap.availableBins){
+		// 			debug_llist(bin, "availableBins 3");
+		// 		}
 		// 	#endif
 
 		// 	const auto testBufferSize = 640*480*2;
@@ -201,7 +201,9 @@ namespace kernel {
 		// });
 
 		#ifdef MEMORY_CHECKS
-			debug_llist(memory::kernelHeap.availableBlocks, "availableBlocks 2");
+			for(auto &bin:memory::kernelHeap.availableBins){
+				debug_llist(bin, "availableBins 2");
+			}
 		#endif
 
 		auto &log = scheduler->get_current_thread()->process.log;
@@ -309,7 +311,6 @@ namespace kernel {
 							for(auto y=0u+padding+abs(time)%4;y<view->buffer.height-padding;y+=2)for(auto x=0u+padding;x<view->buffer.width-padding;x++) {
 								// view->buffer.set(x, y, (time*4)<<24|((x+(time*4))%256)<<16|((x-(time*4)-y)%256)<<8|((x+(time*4)+y)%256));
 								view->buffer.set(x, y, (time*4)<<24|((x+(time*4))%256)<<16|((x-(time*4)-y)%256)<<8|((x+(time*4)+y)%256));
-								vramWrites++;
 							}
 
 							// displayManager->update_view(*view);
@@ -442,11 +443,10 @@ namespace kernel {
 			// 		auto section = log.section("Status:");
 
 			// 		log.print_debug("Active threads: ", scheduler::get_active_thread_count()-1 /* exclude self since we were sleeping throughout */, '/', scheduler::get_total_thread_count(), "\n");
-			// 		log.print_debug("VRAM: ", vramWrites, " writes/sec\n");
-			// 		log.print_debug(" RAM: ", ramWrites, " writes/sec\n");
+			// 		const auto frameStats = displayManager->get_frame_stats();
+			// 		log.print_debug("VRAM: ", frameStats.lastFrameVramBytes, " bytes/frame\n");
+			// 		log.print_debug(" RAM: ", frameStats.lastFrameRamBytes, " bytes/frame\n");
 			// 	}
-			// 	vramWrites = 0;
-			// 	ramWrites = 0;
 			// }
 		}
 
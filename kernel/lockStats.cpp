@@ -0,0 +1,59 @@
+#include "lockStats.hpp"
+
+#include <kernel/time.hpp>
+
+#include <common/stdlib.hpp>
+
+namespace lockStats {
+	namespace {
+		Entry entries[maxEntries];
+	}
+
+	// entries are only ever added, each claimed by setting its name, so this needs no lock (and can't itself use one)
+	auto find_or_add(const char *name) -> Entry* {
+		for(auto &entry:entries){
+			auto entryName = entry.name.load(std::memory_order_acquire);
+
+			// claim it if it's free. If someone beats us to it, `entryName` is set to theirs and we compare against that instead
+			if(!entryName&&entry.name.compare_exchange_strong(entryName, name, std::memory_order_acq_rel)) return &entry;
+
+			if(entryName==name||!strcmp(entryName, name)) return &entry;
+		}
+
+		return nullptr;
+	}
+
+	auto get_count() -> U32 {
+		U32 count = 0;
+		while(count<maxEntries&&entries[count].name.load(std::memory_order_acquire)) count++;
+
+		return count;
+	}
+
+	auto get_entry(U32 index) -> Entry& {
+		return entries[index];
+	}
+
+	void on_locked(Entry *&entry, const char *name, bool wasContended, U64 &lockedTime) {
+		if(!entry){
+			entry = find_or_add(name);
+			if(!entry) return;
+		}
+
+		entry->acquireCount.fetch_add(1, std::memory_order_relaxed);
+		if(wasContended){
+			entry->contendedCount.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		lockedTime = time::now_if_initialised();
+	}
+
+	void on_unlocked(Entry *entry, U64 lockedTime) {
+		if(!entry||!lockedTime) return;
+
+		const auto holdTime = time::now_if_initialised()-lockedTime;
+
+		auto maxHoldTime = entry->maxHoldTime.load(std::memory_order_relaxed);
+		while(holdTime>maxHoldTime&&!entry->maxHoldTime.compare_exchange_weak(maxHoldTime, holdTime, std::memory_order_relaxed));
+	}
+}
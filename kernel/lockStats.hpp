@@ -0,0 +1,25 @@
+#pragma once
+
+#include <common/types.hpp>
+
+#include <atomic>
+
+// per-lock contention statistics, keyed by lock name (only recorded in builds with LOCK_STATS defined)
+// locks sharing a name share an entry
+namespace lockStats {
+	struct Entry {
+		std::atomic<const char*> name{nullptr};
+		std::atomic<U64> acquireCount{0};
+		std::atomic<U64> contendedCount{0}; // acquires that had to wait for another processor
+		std::atomic<U64> maxHoldTime{0}; // in usecs
+	};
+
+	static inline const U32 maxEntries = 64;
+
+	auto find_or_add(const char *name) -> Entry*; // nullptr if all entries are in use
+	auto get_count() -> U32;
+	auto get_entry(U32 index) -> Entry&;
+
+	void on_locked(Entry *&entry, const char *name, bool wasContended, U64 &lockedTime);
+	void on_unlocked(Entry *entry, U64 lockedTime);
+}
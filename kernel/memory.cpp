@@ -4,6 +4,7 @@
 #include <common/debugUtils.hpp>
 #include <common/format.hpp>
 #include <common/MemoryPool.hpp>
+#include <common/MpscList.hpp>
 #include <common/stdlib.hpp>
 
 #include <kernel/kernel.h>
@@ -12,10 +13,14 @@
 #ifdef KERNEL_MMU
 	#include <kernel/mmu.hpp>
 #endif
+#ifndef KERNEL_MMU
+	#include <kernel/memory/BuddyAllocator.hpp>
+#endif
 #include <kernel/memory/Page.hpp>
 #include <kernel/memory/PagedPool.hpp>
 #include <kernel/panic.hpp>
 #include <kernel/PhysicalPointer.hpp>
+#include <kernel/processor.hpp>
 
 static Log log("mem");
 
@@ -70,24 +75,68 @@ namespace memory {
 		// a plain bitmask of used pages (as with an mmu we don't need physical addresses to be sequential, only the virtual we map)
 		AllocationMask pageAllocations{nullptr, 0};
 	#else
-		// list of sequential page chunks, so that we can request large sequential ranges without an mmu
-		LList<::memory::Page> freePages;
-		auto needsCompacting = false;
+		// buddy blocks of sequential pages, so that we can request large sequential ranges without an mmu
+		BuddyAllocator pageBlocks;
 	#endif
 
 	memory::PagedPool<sizeof(size_t)> kernelHeap;
 	// MemoryPool<32> *heap;
 
+	namespace {
+		typedef decltype(kernelHeap) KernelHeap;
+
+		const U32 magazineSize = 32; // free slots held per size class, per processor
+
+		// free slab slots held by a single processor, so that most allocations and frees never need the global lock
+		struct ProcessorCache {
+			struct Magazine {
+				void *slots[magazineSize];
+				U32 count = 0;
+			};
+
+			Magazine magazines[KernelHeap::slabClassCount];
+			MpscList<SlabSlot> remoteFrees; // slots owned by this processor but freed by others, waiting to be taken back
+		};
+
+		ProcessorCache processorCaches[processor::maxCount];
+	}
+
 	auto get_used_heap() -> size_t {
-		return kernelHeap.used;
+		return kernelHeap.used + kernelHeap.get_slab_used();
 	}
 
 	auto get_available_heap() -> size_t {
-		return kernelHeap.available;
+		return kernelHeap.available + kernelHeap.get_slab_available();
 	}
 
 	auto get_heap_block_count() -> U32 {
-		return kernelHeap.availableBlocks.length();
+		U32 count = 0;
+		for(auto &bin:kernelHeap.availableBins){
+			count += bin.length();
+		}
+
+		return count;
+	}
+
+	auto get_heap_size_class_count() -> U32 {
+		return kernelHeap.slabClassCount;
+	}
+
+	auto get_heap_size_class(U32 index) -> HeapSizeClass {
+		const auto &slabClass = kernelHeap.slabClasses[index];
+
+		// slots sitting in processor caches are still free, even though the heap sees them as used
+		U32 cached = 0;
+		for(auto &cache:processorCaches){
+			cached += cache.magazines[index].count;
+		}
+
+		return {
+			.size = kernelHeap.slabSlotSizes[index]-sizeof(size_t),
+			.used = slabClass.usedSlots-cached,
+			.available = slabClass.freeSlotCount+cached,
+			.pages = slabClass.pages
+		};
 	}
 
 	namespace {
@@ -99,82 +148,58 @@ namespace memory {
 		}
 	}
 
-	// for allocating and freeing pages we do the dumb/fast thing by default - allocate from the front, slap frees on the end
-	// periodically we may want to compact() to clean that up, and sort and consolidate fragmented free page entries
-
 	Page* _allocate_pages(U32 count){
 		if(count<1) return nullptr;
 
 		#ifdef KERNEL_MMU
 			auto kernelTransaction = mmu::kernel::transaction();
 
-			for(auto remainingCount = count; remainingCount>1; remainingCount--){
-				auto physical = index_to_physical(TRY_RESULT_OR_RETURN(pageAllocations.claim(), nullptr)); // TODO: unmap previous pages and addresses on fail/nullptr return
-				(Page*)kernelTransaction.map_physical_high(physical, {});
-			}
+			Page *page;
+			Physical<void> physical;
+
+			if(auto index = pageAllocations.claim_contiguous(count)){
+				// a single physical run, so it can be mapped in one go
+				physical = index_to_physical(index.result);
+				page = (Page*)kernelTransaction.map_physical_high(physical, count*pageSize, {});
+
+			}else{
+				// too fragmented, so fall back to mapping individual pages (high mappings are placed downwards, so the last mapped is the first page)
+				for(auto remainingCount = count; remainingCount>1; remainingCount--){
+					auto physical = index_to_physical(TRY_RESULT_OR_RETURN(pageAllocations.claim(), nullptr)); // TODO: unmap previous pages and addresses on fail/nullptr return
+					(Page*)kernelTransaction.map_physical_high(physical, {});
+				}
 
-			auto physical = index_to_physical(TRY_RESULT_OR_RETURN(pageAllocations.claim(), nullptr)); // TODO: unmap previous pages and addresses on fail/nullptr return
-			auto page = (Page*)kernelTransaction.map_physical_high(physical, {});
+				physical = index_to_physical(TRY_RESULT_OR_RETURN(pageAllocations.claim(), nullptr)); // TODO: unmap previous pages and addresses on fail/nullptr return
+				page = (Page*)kernelTransaction.map_physical_high(physical, {});
+			}
 
 			page->physical = physical.as_type<Page>();
 			page->count = count;
 
 			return page;
 		#else
-			{
-				#ifdef KERNEL_MMU
-					auto kernelTransaction = mmu::kernel::transaction();
-				#endif
-
-				for(auto page=freePages.head; page; page=page->next){
-					if(page->count>=count){
-						const auto remainingPages = page->count-count;
-						if(remainingPages>0){
-							auto nextPagesPhysical = page->get_offset_page_physical(count);
-							#ifdef KERNEL_MMU
-								auto &nextPages = *(Page*)kernelTransaction.map_physical_high(nextPagesPhysical, {});
-							#else
-								auto &nextPages = *(Page*)nextPagesPhysical.address;
-							#endif
-							nextPages.physical = nextPagesPhysical;
-							nextPages.count = remainingPages;
-							freePages.insert_after(*page, nextPages);
-						}
-						page->count = count;
-						freePages.pop(*page);
-
-						return page;
-					}
-				}
-			}
-
-			if(needsCompacting){
-				// if we failed, but we're compacted, clean it all up and try once again
-				_compact();
-				return _allocate_pages(count);
-			}
+			return pageBlocks.allocate(count);
 		#endif
-
-		// debug::trace("didn't get pages\n");
-		return nullptr;
 	}
 
+	#ifndef KERNEL_MMU
+		Page* _allocate_aligned_pages(U32 order){
+			return pageBlocks.allocate_block(order);
+		}
+	#endif
+
 	void _free_pages(Page &page, U32 count) {
 		asm volatile("" : "=m" (page)); //ensure any writes to page are definitely finished before we finally let it go ¯\_(ツ)_/¯
 
 		#ifdef KERNEL_MMU
-			page.physical = mmu::kernel::transaction().get_physical(&page).as_type<memory::Page>();
-			pageAllocations.release(physical_to_index(page.physical));
-		#else
-			#ifdef KERNEL_MMU
-				page.physical = mmu::kernel::transaction().get_physical(&page).as_type<memory::Page>();
-			#else
-				page.physical = Physical<Page>{(UPtr)&page};
-			#endif
-			page.count = count;
+			auto kernelTransaction = mmu::kernel::transaction();
 
-			freePages.push_back(page);
-			needsCompacting = true;
+			// pages may not be physically contiguous (if they were claimed individually), so release each by its own mapping
+			for(auto i=0u;i<count;i++){
+				pageAllocations.release(physical_to_index(kernelTransaction.get_physical((U8*)&page+i*pageSize)));
+			}
+		#else
+			pageBlocks.free(page, count);
 		#endif
 	}
 
@@ -220,51 +245,109 @@ namespace memory {
 		// heap->free(address);
 	}
 
-	void _check_dangerous_address(void *from, void *to) {
-		for(auto block=kernelHeap.availableBlocks.head; block; block=block->next) {
-			if(to>block&&from<&block->_data+block->size){
-				// panic::panic();
-				log.print_error("Error: DANGEROUS ADDRESS ", from, " -> ", (U8*)to-1, " overlaps block ", block, " -> ", &block->_data+block->size-1);
+	namespace {
+		// return a slot to a processor's own magazine, draining half of it back to the heap if it's full
+		void cache_free(ProcessorCache &cache, void *address) {
+			auto &slot = KernelHeap::get_slab_slot(address);
+			auto &magazine = cache.magazines[(slot.tag&KernelHeap::slabTagClassMask)>>KernelHeap::slabTagClassShift];
+
+			if(magazine.count>=magazineSize){
+				Transaction transaction;
+				while(magazine.count>magazineSize/2){
+					kernelHeap.slab_free(magazine.slots[--magazine.count]);
+				}
+			}
+
+			magazine.slots[magazine.count++] = address;
+		}
+
+		void reclaim_remote_frees(ProcessorCache &cache) {
+			for(auto slot = cache.remoteFrees.take_all(); slot;){
+				const auto next = slot->next;
+				cache_free(cache, &slot->next);
+				slot = next;
 			}
 		}
 	}
 
-	void _compact() {
-		#ifndef KERNEL_MAPPING
-			// while(needsCompacting){
-			// 	needsCompacting = false;
-
-			// 	{ // sort pages by address (by building a new sorted list, and then replacing with it)
-			// 		LList<::memory::Page> sortedPages;
-
-			// 		while(auto page = freePages.pop_front()){
-			// 			for(auto other=sortedPages.head; page; page=page->next){
-			// 				if(other->physical>page->physical){
-			// 					sortedPages.insert_before(*other, *page);
-			// 					goto sorted;
-			// 				}
-			// 			}
-
-			// 			sortedPages.push_back(*page);
-			// 			sorted:
-			// 			;
-			// 		}
-
-			// 		freePages = sortedPages;
-			// 	}
-
-			// 	// consolidate consecutive pages
-			// 	for(auto page=freePages.head; page&&page->next; page=page->next){
-			// 		if(page->next->physical.address==page->get_offset_page_physical(page->count).address){
-			// 			page->count += page->next->count;
-			// 			freePages.pop(*page->next);
-			// 			#ifdef KERNEL_MMU
-			// 				mmu::kernel::unmap_virtual_high(&page->next, pageSize * page->count); // NOTE: This should ONLY free memory, NEVER allocate it (we don't want an infinite compact loop)
-			// 			#endif
-			// 		}
-			// 	}
-			// }
-		#endif
+	auto cached_allocate(size_t size) -> void* {
+		const auto slabClass = KernelHeap::get_slab_class(size);
+		if(slabClass>=KernelHeap::slabClassCount){
+			Transaction transaction;
+			return transaction.allocate(size);
+		}
+
+		CriticalSection guard; // we must not be moved to another processor while using its cache
+
+		const auto processorId = processor::get_active_id();
+		if(processorId>=processor::maxCount){
+			Transaction transaction;
+			return transaction.allocate(size);
+		}
+
+		auto &cache = processorCaches[processorId];
+		reclaim_remote_frees(cache);
+
+		auto &magazine = cache.magazines[slabClass];
+		if(!magazine.count){
+			Transaction transaction;
+			while(magazine.count<magazineSize/2){
+				auto address = kernelHeap.slab_malloc(slabClass);
+				if(!address) break;
+				magazine.slots[magazine.count++] = address;
+			}
+
+			if(!magazine.count){
+				return transaction.allocate(size); // let the heap try (and report) anything it can
+			}
+		}
+
+		auto address = magazine.slots[--magazine.count];
+
+		// record the owner (offset by 1, so 0 means it came straight from the heap)
+		auto &slot = KernelHeap::get_slab_slot(address);
+		slot.tag = (slot.tag&~(~(size_t)0<<KernelHeap::slabTagOwnerShift)) | (size_t)(processorId+1)<<KernelHeap::slabTagOwnerShift;
+
+		return address;
+	}
+
+	void cached_free(void *address) {
+		if(!address) return;
+
+		if(!KernelHeap::is_slab_allocation(address)){
+			Transaction transaction;
+			return transaction.free(address);
+		}
+
+		auto &slot = KernelHeap::get_slab_slot(address);
+		const auto owner = slot.tag>>KernelHeap::slabTagOwnerShift;
+
+		if(!owner){
+			Transaction transaction;
+			return transaction.free(address);
+		}
+
+		CriticalSection guard;
+
+		const auto processorId = processor::get_active_id();
+		if(owner!=processorId+1){
+			// belongs to another processor, so hand it back without touching its cache
+			processorCaches[owner-1].remoteFrees.push(slot);
+			return;
+		}
+
+		cache_free(processorCaches[processorId], address);
+	}
+
+	void _check_dangerous_address(void *from, void *to) {
+		for(auto &bin:kernelHeap.availableBins){
+			for(auto block=bin.head; block; block=block->next) {
+				if(to>block&&from<&block->_data+block->size){
+					// panic::panic();
+					log.print_error("Error: DANGEROUS ADDRESS ", from, " -> ", (U8*)to-1, " overlaps block ", block, " -> ", &block->_data+block->size-1);
+				}
+			}
+		}
 	}
 
 	void Transaction::lock() {
@@ -286,19 +369,25 @@ namespace memory {
 				assert(allocationPagesNeeded<totalPageCount);
 				totalPageCount -= allocationPagesNeeded; //subtract space for the allocation mask
 
-				auto allocationData = mmu::kernel::transaction().map_physical_high(heap, allocationPagesNeeded, {});
+				auto allocationData = mmu::kernel::transaction().map_physical_high(heap, allocationPagesNeeded*pageSize, {});
 				heap += allocationPagesNeeded*pageSize;
 				heapSize -= allocationPagesNeeded*pageSize;
 
 				pageAllocations = AllocationMask{(Reg*)allocationData, totalPageCount};
 
 			#else
-				auto &page = *(Page*)heap.address;
-				page.physical = heap.as_type<memory::Page>();
-				page.count = heapSize/pageSize;
-				if(page.count>0){
-					freePages.push_back(page);
-				}
+				auto totalPageCount = heapSize/pageSize;
+				assert(totalPageCount>1);
+				const auto orderMapPagesNeeded = (totalPageCount+pageSize-1)/pageSize;
+
+				assert(orderMapPagesNeeded<totalPageCount);
+				totalPageCount -= orderMapPagesNeeded; //subtract space for the order map
+
+				auto orderMap = (U8*)heap.address;
+				heap += orderMapPagesNeeded*pageSize;
+				heapSize -= orderMapPagesNeeded*pageSize;
+
+				pageBlocks.init(heap, totalPageCount, orderMap);
 			#endif
 		}
 
@@ -308,9 +397,13 @@ namespace memory {
 	}
 
 	void debug() {
-		debug_llist(kernelHeap.availableBlocks);
+		for(auto &bin:kernelHeap.availableBins){
+			debug_llist(bin);
+		}
 		#ifndef KERNEL_MMU
-			debug_llist(freePages);
+			for(auto &blocks:pageBlocks.freeBlocks){
+				debug_llist(blocks);
+			}
 		#endif
 	}
 
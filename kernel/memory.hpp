@@ -57,19 +57,34 @@ namespace memory {
 	auto get_available_heap() -> size_t;
 	auto get_heap_block_count() -> U32;
 
+	struct HeapSizeClass {
+		size_t size; // the largest allocation this class will serve
+		U32 used; // slots in use
+		U32 available; // free slots
+		U32 pages; // pages claimed for this class
+	};
+
+	auto get_heap_size_class_count() -> U32;
+	auto get_heap_size_class(U32 index) -> HeapSizeClass;
+
+	// thread-safe. Small allocations are served from per-processor caches, only taking the global lock to refill or drain them
+	auto cached_allocate(size_t size) -> void*;
+	void cached_free(void *address);
+
 	// not thread-safe thread safe
 	auto _allocate(size_t size) -> void*;
 	void _free(void *address);
 
 	auto _allocate_pages(U32 count) -> Page*;
+	#ifndef KERNEL_MMU
+		auto _allocate_aligned_pages(U32 order) -> Page*; // 2^order pages, aligned to their own size (e.g. for dma)
+	#endif
 	void _free_pages(Page&, U32 count);
 	// void _free_pages(Physical<Page>, U32 count);
 	// auto _get_physical_memory_page(Physical<void>) -> Physical<Page>;
 
 	void _check_dangerous_address(void *from, void *to);
 
-	void _compact();
-
 	auto read_physical(Physical<void>, UPtr size) -> Box<U8>;
 	void write_physical(Physical<void>, U8 *data, UPtr size);
 
@@ -90,6 +105,11 @@ namespace memory {
 		auto allocate_pages(U32 count) -> Page* {
 			return _allocate_pages(count);
 		}
+		#ifndef KERNEL_MMU
+			auto allocate_aligned_pages(U32 order) -> Page* {
+				return _allocate_aligned_pages(order);
+			}
+		#endif
 		void free_page(Page &page) {
 			return _free_pages(page, 1);
 		}
@@ -121,10 +141,6 @@ namespace memory {
 		void check_dangerous_address(void *from, void *to) {
 			return _check_dangerous_address(from, to);
 		}
-
-		void compact() {
-			return _compact();
-		}
 	};
 
 	void debug();
@@ -138,13 +154,13 @@ inline void* operator new[](size_t size, size_t align) = delete;
 // void operator delete(void *p) noexcept;
 // void operator delete(void *p, size_t) noexcept;
 
-inline void* operator new(size_t size) noexcept { memory::Transaction transaction; return transaction.allocate(size); }
-inline void* operator new[](size_t size) noexcept { memory::Transaction transaction; return transaction.allocate(size); }
+inline void* operator new(size_t size) noexcept { return memory::cached_allocate(size); }
+inline void* operator new[](size_t size) noexcept { return memory::cached_allocate(size); }
 
-inline void operator delete(void *p) noexcept { if(!p) return; memory::Transaction transaction; transaction.free(p); }
-inline void operator delete(void *p, size_t) noexcept { if(!p) return; memory::Transaction transaction; transaction.free(p); }
+inline void operator delete(void *p) noexcept { if(!p) return; memory::cached_free(p); }
+inline void operator delete(void *p, size_t) noexcept { if(!p) return; memory::cached_free(p); }
 
-inline void* allocate(size_t size) noexcept { if(!size) return nullptr; memory::Transaction transaction; return transaction.allocate(size); }
-inline void  free(void *p) noexcept { if(!p) return; memory::Transaction transaction; return transaction.free(p); }
+inline void* allocate(size_t size) noexcept { if(!size) return nullptr; return memory::cached_allocate(size); }
+inline void  free(void *p) noexcept { if(!p) return; memory::cached_free(p); }
 
 #include "memory.inl"
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <kernel/memory.hpp>
+#include <kernel/memory/Page.hpp>
+
+#include <common/LList.hpp>
+#include <common/stdlib.hpp>
+
+namespace memory {
+	// a binary buddy allocator over a range of physical pages (for use without an mmu, where pages are identity mapped)
+	// blocks are always 2^order pages, naturally aligned to their physical size, and are merged with their buddy as soon as both are free
+	struct BuddyAllocator {
+		static inline const U32 orderCount = 24; // up to 2^23 pages in a single block
+
+		UPtr firstPage = 0; // page number (physical address / pageSize) of the first page managed
+		UPtr endPage = 0; // page number after the last page managed
+		U8 *orderMap = nullptr; // a byte per page - order+1 if a free block starts on it, otherwise 0
+		LList<Page> freeBlocks[orderCount];
+		UPtr freePageCount = 0;
+
+		// `orderMap` must have room for a byte per page
+		void init(Physical<void> address, UPtr pageCount, U8 *_orderMap) {
+			firstPage = address.address/pageSize;
+			endPage = firstPage+pageCount;
+			orderMap = _orderMap;
+
+			memset(orderMap, 0, pageCount);
+			free_range(firstPage, pageCount);
+		}
+
+		// the smallest order that can hold `pageCount` pages
+		static auto get_order(UPtr pageCount) -> U32 {
+			if(pageCount<=1) return 0;
+			return sizeof(unsigned long long)*8-__builtin_clzll(pageCount-1);
+		}
+
+		// allocate a naturally aligned block of 2^order pages
+		auto allocate_block(U32 order) -> Page* {
+			if(order>=orderCount) return nullptr;
+
+			auto available = order;
+			while(available<orderCount&&!freeBlocks[available].head) available++;
+			if(available>=orderCount) return nullptr;
+
+			auto &page = *freeBlocks[available].head;
+			unlink_block(page, available);
+
+			// split down to the size needed, returning the upper halves
+			const auto pageNumber = get_page_number(page);
+			while(available>order){
+				available--;
+				link_block(pageNumber+((UPtr)1<<available), available);
+			}
+
+			page.count = 1<<order;
+			return &page;
+		}
+
+		// allocate exactly `count` pages, returning the unused tail of the block to the free lists
+		auto allocate(UPtr count) -> Page* {
+			const auto order = get_order(count);
+
+			auto page = allocate_block(order);
+			if(!page) return nullptr;
+
+			free_range(get_page_number(*page)+count, ((UPtr)1<<order)-count);
+			page->count = count;
+
+			return page;
+		}
+
+		// free `count` pages (which needn't be a single block, or even the same count that was allocated)
+		void free(Page &page, UPtr count) {
+			free_range(get_page_number(page), count);
+		}
+
+	protected:
+		static auto get_page(UPtr pageNumber) -> Page& {
+			return *(Page*)(pageNumber*pageSize);
+		}
+
+		static auto get_page_number(Page &page) -> UPtr {
+			return (UPtr)&page/pageSize;
+		}
+
+		// free a range as the largest naturally aligned blocks that fit
+		void free_range(UPtr pageNumber, UPtr count) {
+			while(count>0){
+				const U32 alignedOrder = pageNumber?__builtin_ctzll(pageNumber):orderCount-1;
+				const U32 fittingOrder = sizeof(unsigned long long)*8-1-__builtin_clzll(count);
+				const auto order = min(alignedOrder, fittingOrder, orderCount-1);
+
+				free_block(pageNumber, order);
+				pageNumber += (UPtr)1<<order;
+				count -= (UPtr)1<<order;
+			}
+		}
+
+		void free_block(UPtr pageNumber, U32 order) {
+			// keep merging for as long as our buddy is a free block of the same size
+			for(;order<orderCount-1;order++){
+				const auto buddy = pageNumber^((UPtr)1<<order);
+				if(buddy<firstPage||buddy>=endPage||orderMap[buddy-firstPage]!=order+1) break;
+
+				unlink_block(get_page(buddy), order);
+				pageNumber = min(pageNumber, buddy);
+			}
+
+			link_block(pageNumber, order);
+		}
+
+		void link_block(UPtr pageNumber, U32 order) {
+			auto &page = get_page(pageNumber);
+			page.physical = Physical<Page>{pageNumber*pageSize};
+			page.count = 1<<order;
+
+			orderMap[pageNumber-firstPage] = order+1;
+			freeBlocks[order].push_back(page);
+			freePageCount += (UPtr)1<<order;
+		}
+
+		void unlink_block(Page &page, U32 order) {
+			orderMap[get_page_number(page)-firstPage] = 0;
+			freeBlocks[order].pop(page);
+			freePageCount -= (UPtr)1<<order;
+		}
+	};
+}
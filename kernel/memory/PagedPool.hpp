@@ -6,13 +6,41 @@
 #include <common/LList.hpp>
 #include <common/MemoryPool.hpp>
 
-//TODO:overload compact() and free whole pages when they're no longer in use
+//TODO:free whole pages when they're no longer in use
 
 namespace memory {
+	// a single fixed-size slot within a slab page
+	// the tag sits in the word directly before the returned data (where `MemoryPoolBlock::_tag` would be), so that free() can tell slab allocations apart from pool blocks
+	struct SlabSlot {
+		size_t tag;
+		SlabSlot *next; // only valid while the slot is free, otherwise this is the start of the allocated data
+	};
+
 	template <unsigned alignment>
 	struct PagedPool: MemoryPool<alignment> {
 		typedef MemoryPool<alignment> Super;
 
+		static_assert(alignment<=sizeof(size_t), "slab slots only guarantee size_t alignment");
+
+		// slot sizes include the tag word, so each can hold allocations of up to `slotSize-sizeof(size_t)`
+		static inline const size_t slabSlotSizes[] = { 16, 32, 64, 128, 256, 512, 1024 };
+		static inline const U32 slabClassCount = sizeof(slabSlotSizes)/sizeof(slabSlotSizes[0]);
+
+		// tag layout: bit 0 is `slabTag`, the next 7 bits the slab class, and the rest is left for callers to record ownership in (see `slabTagOwnerShift`)
+		static inline const size_t slabTag = 1; // sits in the same bit as `MemoryPoolBlock::_tag`, which is never set on pool blocks
+		static inline const size_t slabTagClassShift = 1;
+		static inline const size_t slabTagClassMask = 0x7f<<slabTagClassShift;
+		static inline const size_t slabTagOwnerShift = 8;
+
+		struct SlabClass {
+			SlabSlot *freeSlots = nullptr;
+			U32 usedSlots = 0;
+			U32 freeSlotCount = 0;
+			U32 pages = 0;
+		};
+
+		SlabClass slabClasses[slabClassCount];
+
 		/**/ PagedPool(void *heap, size_t heapSize):
 			Super(heap, heapSize)
 		{}
@@ -21,11 +49,17 @@ namespace memory {
 			Super(nullptr, 0)
 		{}
 
+		using Super::free;
+
 		void* malloc(size_t size) {
 			#ifdef MEMORY_CHECKS
 				logging::Section section("PagedPool::malloc ", size);
 			#endif
 
+			if(const auto slabClass = get_slab_class(size); slabClass<slabClassCount){
+				return slab_malloc(slabClass);
+			}
+
 			const auto blockHeaderSize = offsetof(MemoryPoolBlock, MemoryPoolBlock::_data);
 
 			unsigned requiredSize = align(size, alignment);
@@ -101,10 +135,19 @@ namespace memory {
 			#ifdef MEMORY_CHECKS
 				debug::trace("returned memory ", result, "\n");
 			#endif
-			
+
 			return result;
 		}
 
+		void free(void *address) {
+			if(is_slab_allocation(address)){
+				slab_free(address);
+				return;
+			}
+
+			Super::free(address);
+		}
+
 		bool add_page() {
 			return add_pages(1);
 		}
@@ -118,5 +161,87 @@ namespace memory {
 
 			return true;
 		}
+
+		// returns `slabClassCount` if the size is too large to be served by a slab
+		static auto get_slab_class(size_t size) -> U32 {
+			const auto slotSize = size+sizeof(size_t);
+			if(slotSize<=slabSlotSizes[0]) return 0;
+			if(slotSize>slabSlotSizes[slabClassCount-1]) return slabClassCount;
+
+			// slot sizes are consecutive powers of 2, so the class is just the bit width above the smallest
+			return sizeof(unsigned long)*8-__builtin_clzl(slotSize-1) - (sizeof(unsigned long)*8-__builtin_clzl(slabSlotSizes[0]-1));
+		}
+
+		static auto is_slab_allocation(void *address) -> bool {
+			return *((size_t*)address-1)&slabTag;
+		}
+
+		static auto get_slab_slot(void *address) -> SlabSlot& {
+			return *(SlabSlot*)((size_t*)address-1);
+		}
+
+		auto get_slab_used() -> size_t {
+			size_t total = 0;
+			for(auto i=0u;i<slabClassCount;i++){
+				total += slabClasses[i].usedSlots*slabSlotSizes[i];
+			}
+			return total;
+		}
+
+		auto get_slab_available() -> size_t {
+			size_t total = 0;
+			for(auto i=0u;i<slabClassCount;i++){
+				total += slabClasses[i].freeSlotCount*slabSlotSizes[i];
+			}
+			return total;
+		}
+
+		auto slab_malloc(U32 index) -> void* {
+			auto &slabClass = slabClasses[index];
+
+			if(!slabClass.freeSlots&&!add_slab_page(index)) return nullptr;
+
+			auto slot = slabClass.freeSlots;
+			slabClass.freeSlots = slot->next;
+			slabClass.freeSlotCount--;
+			slabClass.usedSlots++;
+
+			slot->tag &= ~(~(size_t)0<<slabTagOwnerShift); // clear any owner left from its last use
+
+			return &slot->next;
+		}
+
+		void slab_free(void *address) {
+			auto &slot = get_slab_slot(address);
+			auto &slabClass = slabClasses[(slot.tag&slabTagClassMask)>>slabTagClassShift];
+
+			slot.next = slabClass.freeSlots;
+			slabClass.freeSlots = &slot;
+			slabClass.freeSlotCount++;
+			slabClass.usedSlots--;
+		}
+
+	protected:
+		bool add_slab_page(U32 index) {
+			auto page = memory::_allocate_pages(1);
+			if(!page) return false;
+
+			auto &slabClass = slabClasses[index];
+			const auto slotSize = slabSlotSizes[index];
+			const auto slotCount = memory::pageSize/slotSize;
+
+			// push in reverse, so that the page is handed out from the front
+			for(auto i=slotCount;i-->0;){
+				auto &slot = *(SlabSlot*)((U8*)page+i*slotSize);
+				slot.tag = index<<slabTagClassShift|slabTag;
+				slot.next = slabClass.freeSlots;
+				slabClass.freeSlots = &slot;
+			}
+
+			slabClass.freeSlotCount += slotCount;
+			slabClass.pages++;
+
+			return true;
+		}
 	};
 }
@@ -17,7 +17,7 @@ namespace panic {
 		void on_displayManager_event(const driver::DisplayManager::Event &event) {
 			switch(event.type){
 				case driver::DisplayManager::Event::Type::framebuffersChanged:
-					framebuffer = displayManager->get_screen_count()>0?displayManager->get_screen_buffer(0):nullptr;
+					framebuffer = displayManager->get_screen_count()>0?displayManager->get_screen_framebuffer(0):nullptr;
 					framebufferPhysical.address = mmu::kernel::transaction().get_physical(framebuffer).address;
 				break;
 			}
@@ -33,7 +33,7 @@ namespace panic {
 			displayManager = set;
 			if(displayManager){
 				displayManager->events.subscribe(on_displayManager_event);
-				framebuffer = displayManager->get_screen_count()>0?displayManager->get_screen_buffer(0):nullptr;
+				framebuffer = displayManager->get_screen_count()>0?displayManager->get_screen_framebuffer(0):nullptr;
 			}else{
 				framebuffer = nullptr;
 			}
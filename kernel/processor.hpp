@@ -7,6 +7,8 @@ namespace driver {
 namespace processor {
 	extern driver::Processor *driver;
 
+	static inline const U32 maxCount = 16; // the most processors that per-processor state is kept for. Any with higher ids fall back to shared paths
+
 	auto get_active_id() -> U32;
 
 	void pause();
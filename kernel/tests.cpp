@@ -1,6 +1,8 @@
 #include "tests.hpp"
 
 #include "tests/fontTest.hpp"
+#include "tests/heapBenchmark.hpp"
+#include "tests/heapStress.hpp"
 #include "tests/keyboardTest.hpp"
 #include "tests/memoryTest.hpp"
 #include "tests/taskbar.hpp"
@@ -13,5 +15,11 @@ namespace tests {
 		keyboardTest::run();
 		memoryTest::run();
 		driveList::run();
+
+		// (slow enough to be opt-in)
+		#ifdef HEAVY_TESTS
+			heapStress::run();
+			heapBenchmark::run();
+		#endif
 	}
 }
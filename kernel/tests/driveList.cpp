@@ -103,7 +103,7 @@ namespace tests::driveList {
 				const auto isRemovable = TRY_RESULT_OR(storageManager->is_drive_removable(i), false);
 				strcat(buffer, isRemovable?"Yes":"No");
 
-				labelInfo->text = buffer;
+				labelInfo->set_text(buffer);
 
 				labelInfo->container->_on_children_changed();
 				labelInfo->redraw();
@@ -0,0 +1,91 @@
+#include "heapBenchmark.hpp"
+
+#include <drivers/Scheduler.hpp>
+
+#include <kernel/drivers.hpp>
+#include <kernel/Log.hpp>
+#include <kernel/memory.hpp>
+#include <kernel/Process.hpp>
+#include <kernel/Thread.hpp>
+#include <kernel/time.hpp>
+
+#include <common/maths.hpp>
+
+#include <atomic>
+
+static Log log("heap benchmark");
+
+namespace tests::heapBenchmark {
+	namespace {
+		const U32 threadCount = 4;
+		const U32 operationCount = 50000; // per thread
+		const U32 batchSize = 32;
+		const U32 exchangeSize = 256;
+
+		driver::Scheduler *scheduler;
+
+		// allocations are swapped through here, so that whichever thread displaces one frees it - forcing frees on processors other than the one that allocated
+		std::atomic<void*> exchange[exchangeSize];
+
+		std::atomic<U32> startedThreads{0};
+		std::atomic<U32> finishedThreads{0};
+		std::atomic<U32> crossFrees{0};
+		U64 startTime;
+
+		void run_thread() {
+			if(startedThreads.fetch_add(1)==0){
+				startTime = time::now();
+			}
+
+			void *batch[batchSize];
+			U32 exchanged = 0;
+
+			for(auto i=0u;i<operationCount;i+=batchSize){
+				for(auto &allocation:batch){
+					allocation = ::allocate(8+maths::rand()%(1000-8));
+				}
+
+				// free half locally, and pass the other half on for another thread to free
+				for(auto j=0u;j<batchSize;j++){
+					if(j%2){
+						::free(batch[j]);
+					}else if(auto displaced = exchange[maths::rand()%exchangeSize].exchange(batch[j])){
+						::free(displaced);
+						exchanged++;
+					}
+				}
+			}
+
+			crossFrees += exchanged;
+
+			if(finishedThreads.fetch_add(1)==threadCount-1){
+				const auto duration = time::now()-startTime;
+
+				for(auto &allocation:exchange){
+					::free(allocation.exchange(nullptr));
+				}
+
+				const auto totalOperations = (U64)threadCount*operationCount*2;
+				log.print_info(threadCount, " threads performed ", totalOperations, " operations in ", duration, "us (", duration?totalOperations*1000000/duration:0, " operations/s, ", crossFrees.load(), " exchanged frees)");
+			}
+
+			// (kernel threads have nothing to return to)
+			scheduler->get_current_thread()->terminate();
+			scheduler->yield();
+		}
+	}
+
+	void run() {
+		scheduler = drivers::find_and_activate<driver::Scheduler>();
+		if(!scheduler) return;
+
+		auto &process = process::create_kernel("heap benchmark");
+
+		log.print_info("starting ", threadCount, " threads...");
+
+		for(auto i=0u;i<threadCount;i++){
+			auto &thread = process.create_kernel_thread(run_thread);
+			scheduler->add_thread(thread);
+		}
+	}
+}
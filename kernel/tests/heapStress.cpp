@@ -0,0 +1,149 @@
+#include "heapStress.hpp"
+
+#include <drivers/DesktopManager.hpp>
+
+#include <kernel/drivers.hpp>
+#include <kernel/Log.hpp>
+#include <kernel/memory.hpp>
+#include <kernel/time.hpp>
+
+#include <common/graphics2d/font.hpp>
+#include <common/maths.hpp>
+
+static Log log("heap stress");
+
+namespace tests::heapStress {
+	namespace {
+		const U32 slotCount = 512;
+		const U32 operationCount = 20000;
+		const U32 histogramSize = 1024; // 1us buckets, with the last catching everything above
+
+		driver::DesktopManager *desktopManager;
+		driver::DesktopManager::StandardWindow *window;
+
+		struct Latencies {
+			U32 histogram[histogramSize] = {};
+			U32 count = 0;
+			U64 total = 0;
+			U32 max = 0;
+
+			void add(U32 usecs) {
+				histogram[maths::min(usecs, histogramSize-1)]++;
+				count++;
+				total += usecs;
+				this->max = maths::max(this->max, usecs);
+			}
+
+			auto get_percentile(U32 percent) -> U32 {
+				const auto target = ((U64)count*percent+99)/100;
+				U64 seen = 0;
+				for(auto i=0u;i<histogramSize;i++){
+					seen += histogram[i];
+					if(seen>=target) return i;
+				}
+				return histogramSize-1;
+			}
+		};
+
+		Latencies allocateLatencies;
+		Latencies freeLatencies;
+		U32 failedAllocations = 0;
+
+		auto random_size() -> size_t {
+			const auto type = maths::rand()%100;
+			if(type<70) return 8+maths::rand()%(256-8); // small
+			if(type<95) return 256+maths::rand()%(4096-256); // medium
+			return 4096+maths::rand()%(64*1024-4096); // large
+		}
+
+		void churn() {
+			void *slots[slotCount] = {};
+
+			for(auto i=0u;i<operationCount;i++){
+				auto &slot = slots[maths::rand()%slotCount];
+
+				if(slot){
+					const auto start = time::now();
+					::free(slot);
+					freeLatencies.add(time::now()-start);
+					slot = nullptr;
+
+				}else{
+					const auto size = random_size();
+					const auto start = time::now();
+					slot = ::allocate(size);
+					allocateLatencies.add(time::now()-start);
+					if(!slot) failedAllocations++;
+				}
+			}
+
+			for(auto &slot:slots){
+				::free(slot);
+			}
+		}
+
+		void redraw() {
+			auto &clientArea = window->get_client_buffer();
+
+			clientArea.draw_rect(0, 0, window->get_width(), window->get_height(), window->get_background_colour());
+
+			auto fontSettings = graphics2d::Buffer::FontSettings{
+				.font = *graphics2d::font::default_sans,
+				.size = 14
+			};
+
+			const auto margin = 10;
+			const auto width = clientArea.width-margin;
+			const auto x = margin;
+
+			auto pos = clientArea.draw_text(fontSettings, "Operations: ", x, (I32)(fontSettings.font.lineHeight*(fontSettings.size+0.5)), width, 0x222222);
+			pos = clientArea.draw_text(fontSettings, to_string(operationCount), x, pos.y, width, 0x222222, pos.x);
+			pos = clientArea.draw_text(fontSettings, " (", x, pos.y, width, 0x222222, pos.x);
+			pos = clientArea.draw_text(fontSettings, to_string(failedAllocations), x, pos.y, width, 0x222222, pos.x);
+			pos = clientArea.draw_text(fontSettings, " failed allocations)\n", x, pos.y, width, 0x222222, pos.x);
+
+			for(auto i=0;i<2;i++){
+				auto &latencies = i==0?allocateLatencies:freeLatencies;
+
+				pos = clientArea.draw_text(fontSettings, i==0?"Allocate x":"Free x", x, pos.y, width, 0x222222, pos.x);
+				pos = clientArea.draw_text(fontSettings, to_string(latencies.count), x, pos.y, width, 0x222222, pos.x);
+				pos = clientArea.draw_text(fontSettings, " - p50: ", x, pos.y, width, 0x222222, pos.x);
+				pos = clientArea.draw_text(fontSettings, to_string(latencies.get_percentile(50)), x, pos.y, width, 0x222222, pos.x);
+				pos = clientArea.draw_text(fontSettings, "us p99: ", x, pos.y, width, 0x222222, pos.x);
+				pos = clientArea.draw_text(fontSettings, to_string(latencies.get_percentile(99)), x, pos.y, width, 0x222222, pos.x);
+				pos = clientArea.draw_text(fontSettings, "us max: ", x, pos.y, width, 0x222222, pos.x);
+				pos = clientArea.draw_text(fontSettings, to_string(latencies.max), x, pos.y, width, 0x222222, pos.x);
+				pos = clientArea.draw_text(fontSettings, "us\n", x, pos.y, width, 0x222222, pos.x);
+			}
+
+			window->redraw();
+		}
+	}
+
+	void run() {
+		desktopManager = drivers::find_and_activate<driver::DesktopManager>();
+		if(!desktopManager) return;
+
+		{ auto section = log.section("churning ", operationCount, " operations...");
+			churn();
+
+			log.print_info("allocate p50: ", allocateLatencies.get_percentile(50), "us p99: ", allocateLatencies.get_percentile(99), "us max: ", allocateLatencies.max, "us");
+			log.print_info("free p50: ", freeLatencies.get_percentile(50), "us p99: ", freeLatencies.get_percentile(99), "us max: ", freeLatencies.max, "us");
+			if(failedAllocations){
+				log.print_warning("Warning: ", failedAllocations, " allocations failed");
+			}
+		}
+
+		window = &desktopManager->create_standard_window("Heap Stress", 500, 120);
+
+		redraw();
+		window->show();
+
+		window->events.subscribe([](const driver::DesktopManager::Window::Event &event, void*){
+			if(event.type==driver::DesktopManager::Window::Event::Type::clientAreaChanged){
+				redraw();
+			}
+
+		}, nullptr);
+	}
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+namespace tests::heapStress {
+	void run();
+}
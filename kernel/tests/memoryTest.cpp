@@ -1,6 +1,7 @@
 #include "memoryTest.hpp"
 
 #include <drivers/DesktopManager.hpp>
+#include <drivers/DisplayManager.hpp>
 
 #include <kernel/drivers.hpp>
 #include <kernel/PhysicalPointer.hpp>
@@ -48,6 +49,20 @@ namespace tests::memoryTest {
 				leftPos = clientArea.draw_text(fontSettings, to_string(memory::get_heap_block_count()), x, leftPos.y, width, 0x222222, leftPos.x);
 				leftPos = clientArea.draw_text(fontSettings, " blocks free)\n", x, leftPos.y, width, 0x222222, leftPos.x);
 
+				for(auto i=0u;i<memory::get_heap_size_class_count();i++){
+					const auto sizeClass = memory::get_heap_size_class(i);
+
+					leftPos = clientArea.draw_text(fontSettings, "  <=", x, leftPos.y, width, 0x666666, leftPos.x);
+					leftPos = clientArea.draw_text(fontSettings, to_string((UPtr)sizeClass.size), x, leftPos.y, width, 0x666666, leftPos.x);
+					leftPos = clientArea.draw_text(fontSettings, "B: ", x, leftPos.y, width, 0x666666, leftPos.x);
+					leftPos = clientArea.draw_text(fontSettings, to_string(sizeClass.used), x, leftPos.y, width, 0x666666, leftPos.x);
+					leftPos = clientArea.draw_text(fontSettings, " used, ", x, leftPos.y, width, 0x666666, leftPos.x);
+					leftPos = clientArea.draw_text(fontSettings, to_string(sizeClass.available), x, leftPos.y, width, 0x666666, leftPos.x);
+					leftPos = clientArea.draw_text(fontSettings, " free (", x, leftPos.y, width, 0x666666, leftPos.x);
+					leftPos = clientArea.draw_text(fontSettings, to_string(sizeClass.pages), x, leftPos.y, width, 0x666666, leftPos.x);
+					leftPos = clientArea.draw_text(fontSettings, " pages)\n", x, leftPos.y, width, 0x666666, leftPos.x);
+				}
+
 				auto rightPos = leftPos;
 
 				if(window->get_width()>=510){
@@ -67,6 +82,26 @@ namespace tests::memoryTest {
 				rightPos = clientArea.draw_text(fontSettings, to_string((UPtr)(memory::constantsSize+memory::initialisedDataSize+memory::uninitialisedDataSize)/1024), x, rightPos.y, width, 0x222222, rightPos.x);
 				rightPos = clientArea.draw_text(fontSettings, "KiB\n", x, rightPos.y, width, 0x222222, rightPos.x);
 
+				if(auto displayManager = drivers::find_active<driver::DisplayManager>()){
+					const auto stats = displayManager->get_frame_stats();
+
+					rightPos = clientArea.draw_text(fontSettings, "Last frame: ", x, rightPos.y, width, 0x222222, rightPos.x);
+					rightPos = clientArea.draw_text(fontSettings, to_string(stats.lastFrameRamBytes/1024), x, rightPos.y, width, 0x222222, rightPos.x);
+					rightPos = clientArea.draw_text(fontSettings, "KiB RAM, ", x, rightPos.y, width, 0x222222, rightPos.x);
+					rightPos = clientArea.draw_text(fontSettings, to_string(stats.lastFrameVramBytes/1024), x, rightPos.y, width, 0x222222, rightPos.x);
+					rightPos = clientArea.draw_text(fontSettings, "KiB VRAM\n", x, rightPos.y, width, 0x222222, rightPos.x);
+
+					if(stats.frameCount){
+						rightPos = clientArea.draw_text(fontSettings, "  average: ", x, rightPos.y, width, 0x666666, rightPos.x);
+						rightPos = clientArea.draw_text(fontSettings, to_string(stats.ramBytes/stats.frameCount/1024), x, rightPos.y, width, 0x666666, rightPos.x);
+						rightPos = clientArea.draw_text(fontSettings, "KiB RAM, ", x, rightPos.y, width, 0x666666, rightPos.x);
+						rightPos = clientArea.draw_text(fontSettings, to_string(stats.vramBytes/stats.frameCount/1024), x, rightPos.y, width, 0x666666, rightPos.x);
+						rightPos = clientArea.draw_text(fontSettings, "KiB VRAM (", x, rightPos.y, width, 0x666666, rightPos.x);
+						rightPos = clientArea.draw_text(fontSettings, to_string(stats.frameCount), x, rightPos.y, width, 0x666666, rightPos.x);
+						rightPos = clientArea.draw_text(fontSettings, " frames)\n", x, rightPos.y, width, 0x666666, rightPos.x);
+					}
+				}
+
 				y = max(leftPos.y, rightPos.y) - fontSettings.font.lineHeight*(fontSettings.size+0.5) - fontSettings.font.descender*(fontSettings.size+0.5) + margin;
 			}
 
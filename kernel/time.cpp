@@ -7,8 +7,13 @@
 namespace time {
 	constinit AutomaticDriverReference<driver::Timer> timer;
 
+	namespace {
+		bool isInitialised = false;
+	}
+
 	void init() {
 		timer.get();
+		isInitialised = true;
 	}
 
 	auto now() -> U64 {
@@ -16,4 +21,10 @@ namespace time {
 
 		return timer->now64();
 	}
+
+	auto now_if_initialised() -> U64 {
+		if(!isInitialised) return 0;
+
+		return now();
+	}
 }
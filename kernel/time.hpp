@@ -5,4 +5,5 @@
 namespace time {
 	void init();
 	auto now() -> U64;
+	auto now_if_initialised() -> U64; // like now(), but returns 0 rather than looking for a timer before init(), for use where starting drivers isn't safe (such as within locks)
 }
@@ -9,6 +9,7 @@
 #include <kernel/memory.hpp>
 
 #include <common/graphics2d/Rect.hpp>
+#include <common/graphics2d/TextLayout.hpp>
 #include <common/graphics2d/font.hpp>
 #include <common/stdlib.hpp>
 
@@ -35,6 +36,7 @@ namespace utils {
 			auto textColour = textColourInfo;
 
 			graphics2d::Rect dirtyArea;
+			graphics2d::TextLayout textLayout;
 
 			DriverReference<driver::DesktopManager> desktopManager{nullptr, [](void*){
 				if(window){
@@ -72,7 +74,13 @@ namespace utils {
 					.size = fontSize
 				};
 
-				auto textResult = clientArea.draw_text(fontSettings, text, leftMargin + cursorColumn * columnWidth, cursorY, columnWidth, textColour, cursorX);
+				textLayout.set_font_settings(fontSettings);
+				textLayout.set_width(columnWidth);
+				textLayout.set_cursor(cursorX - (leftMargin + cursorColumn * columnWidth));
+				textLayout.set_text(text);
+				textLayout.invalidate(); // text is often passed in the same buffer each time
+
+				auto textResult = textLayout.draw(clientArea, leftMargin + cursorColumn * columnWidth, cursorY, textColour);
 				if(max(cursorY, textResult.updatedArea.y2)>=(I32)clientArea.height){
 					if(columns==1){
 						// if a single column, scroll
@@ -84,7 +92,7 @@ namespace utils {
 
 						//redraw as it was clipped off last time
 						clientArea.draw_rect(0, clientArea.height-scroll, clientArea.width, scroll, window->get_background_colour()); //clear the bottom section..
-						textResult = clientArea.draw_text(fontSettings, text, leftMargin + cursorColumn * columnWidth, cursorY, columnWidth, textColour, cursorX); //...then redraw the text
+						textResult = textLayout.draw(clientArea, leftMargin + cursorColumn * columnWidth, cursorY, textColour); //...then redraw the text (still laid out the same)
 						dirtyArea.include({0, 0, (I32)clientArea.width, (I32)clientArea.height});
 
 					}else{
@@ -101,7 +109,8 @@ namespace utils {
 						clientArea.draw_rect(cursorColumn * columnWidth, 0, columnWidth, clientArea.height, window->get_background_colour());
 						dirtyArea = dirtyArea.include({cursorColumn * columnWidth, 0, cursorColumn * columnWidth + columnWidth, (I32)clientArea.height});
 
-						textResult = clientArea.draw_text(fontSettings, text, leftMargin + cursorColumn * columnWidth, cursorY, columnWidth, textColour, cursorX);
+						textLayout.set_cursor(0);
+						textResult = textLayout.draw(clientArea, leftMargin + cursorColumn * columnWidth, cursorY, textColour);
 					}
 
 				}else{
@@ -0,0 +1,97 @@
+// hosted linux microbenchmark for the graphics2d blend span kernels
+// build from the repo root with:
+//   g++ -O3 -std=c++17 -I . -include common/common.hpp tools/benchmarks/blendSpan.cpp -o blendSpan
+// (add -march=native to compare against what the compiler vectorises on its own)
+
+#include <common/graphics2d/blendSpan.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+	typedef void (*Kernel)(U8 *dest, const U8 *source, U32 count, U8 opacity);
+
+	const U32 spanLength = 1920;
+	const U32 spanCount = 256;
+
+	// random premultiplied pixels, with a spread of transparencies
+	auto create_pixels(U32 count, U32 alphaByte) -> std::vector<U8> {
+		std::vector<U8> pixels(count*4);
+		for(auto i=0u;i<count;i++){
+			const U8 trans = rand()%4==0?0:rand()%4==0?255:rand();
+			for(auto channel=0u;channel<4;channel++){
+				pixels[i*4+channel] = channel==alphaByte?trans:rand()%(256-trans);
+			}
+		}
+		return pixels;
+	}
+
+	auto check(const char *name, Kernel kernel, Kernel reference, U32 alphaByte) -> bool {
+		// odd lengths, so the scalar tails are covered too
+		for(auto count: {0u, 1u, 3u, 7u, 15u, 33u, 1023u}){
+			for(auto opacity: {0u, 1u, 128u, 254u, 255u}){
+				const auto source = create_pixels(count, alphaByte);
+				auto dest = create_pixels(count, alphaByte);
+				auto expected = dest;
+
+				kernel(dest.data(), source.data(), count, opacity);
+				reference(expected.data(), source.data(), count, opacity);
+
+				if(dest!=expected){
+					printf("%s: mismatch with %u pixels at opacity %u\n", name, count, opacity);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	void measure(const char *name, Kernel kernel, U32 alphaByte) {
+		const auto source = create_pixels(spanLength*spanCount, alphaByte);
+		auto dest = create_pixels(spanLength*spanCount, alphaByte);
+
+		auto best = 0.0;
+		for(auto run=0u;run<10;run++){
+			const auto start = std::chrono::steady_clock::now();
+			for(auto span=0u;span<spanCount;span++){
+				kernel(&dest[span*spanLength*4], &source[span*spanLength*4], spanLength, 200);
+			}
+			const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+			best = std::max(best, spanLength*spanCount/seconds);
+		}
+
+		printf("  %-8s %8.1f Mpixels/s\n", name, best/1000000);
+	}
+
+	template <U32 alphaByte>
+	auto run(const char *orderName) -> bool {
+		printf("%s:\n", orderName);
+
+		auto isOkay = true;
+
+		measure("scalar", graphics2d::blendSpan::blend_scalar<alphaByte>, alphaByte);
+
+		#if defined(__SSE2__)
+			isOkay = check("sse2", graphics2d::blendSpan::blend_sse2<alphaByte>, graphics2d::blendSpan::blend_scalar<alphaByte>, alphaByte)&&isOkay;
+			measure("sse2", graphics2d::blendSpan::blend_sse2<alphaByte>, alphaByte);
+		#endif
+
+		#if defined(__ARM_NEON)
+			isOkay = check("neon", graphics2d::blendSpan::blend_neon<alphaByte>, graphics2d::blendSpan::blend_scalar<alphaByte>, alphaByte)&&isOkay;
+			measure("neon", graphics2d::blendSpan::blend_neon<alphaByte>, alphaByte);
+		#endif
+
+		return isOkay;
+	}
+}
+
+int main() {
+	auto isOkay = true;
+	isOkay = run<0>("argb")&&isOkay;
+	isOkay = run<3>("bgra")&&isOkay;
+
+	return isOkay?0:1;
+}
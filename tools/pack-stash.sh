@@ -0,0 +1,2 @@
+#!/bin/sh
+deno run --allow-read="$1" --allow-write="$2" $(dirname "$(realpath "$0")")/pack-stash.ts "$@"
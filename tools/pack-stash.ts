@@ -0,0 +1,108 @@
+// packs a directory tree into a fileStash image
+//
+// a directory is a 'DIR' tag, then entries of (u8 name length, name, u64 target offset) ending with a zero length
+// each directory's first entry is named "\0" and targets an 'IDX' record of (u32 count, u32 entry offsets relative to the directory), sorted by name, for binary searching
+// a file is a 'FILE' tag, then a u64 size and its contents (padded to start on a 16 byte boundary, so they can be used in place)
+
+const sourceDir = Deno.args[0];
+const stashPath = Deno.args[1];
+
+const dirTag = 'D'.charCodeAt(0)<<16|'I'.charCodeAt(0)<<8|'R'.charCodeAt(0);
+const indexTag = 'I'.charCodeAt(0)<<16|'D'.charCodeAt(0)<<8|'X'.charCodeAt(0);
+const fileTag = ('F'.charCodeAt(0)<<24|'I'.charCodeAt(0)<<16|'L'.charCodeAt(0)<<8|'E'.charCodeAt(0))>>>0;
+
+const fileAlignment = 16;
+
+const encoder = new TextEncoder();
+
+let data = new Uint8Array(64*1024);
+let size = 0;
+
+function reserve(bytes:number):number {
+	while(size+bytes>data.length){
+		const grown = new Uint8Array(data.length*2);
+		grown.set(data.subarray(0, size));
+		data = grown;
+	}
+
+	const offset = size;
+	size += bytes;
+	return offset;
+}
+
+function write_u8(value:number) { data[reserve(1)] = value; }
+function write_u32(value:number) { new DataView(data.buffer).setUint32(reserve(4), value, true); }
+function write_u64(value:number) { new DataView(data.buffer).setBigUint64(reserve(8), BigInt(value), true); }
+function write_bytes(bytes:Uint8Array) { data.set(bytes, reserve(bytes.length)); }
+
+function set_u64(offset:number, value:number) { new DataView(data.buffer).setBigUint64(offset, BigInt(value), true); }
+
+// matches the ordering used by fileStash::Directory lookups
+function compare_name(a:Uint8Array, b:Uint8Array):number {
+	const length = Math.min(a.length, b.length);
+	for(let i=0;i<length;i++){
+		if(a[i]!=b[i]) return a[i]-b[i];
+	}
+	return a.length-b.length;
+}
+
+function pack_file(path:string):number {
+	const contents = Deno.readFileSync(path);
+
+	reserve((fileAlignment-(size+12)%fileAlignment)%fileAlignment);
+
+	const offset = size;
+	write_u32(fileTag);
+	write_u64(contents.length);
+	write_bytes(contents);
+
+	return offset;
+}
+
+function pack_directory(path:string):number {
+	const entries:{name:Uint8Array, path:string, isDirectory:boolean, entryOffset:number, targetOffset:number}[] = [];
+
+	for(const entry of Deno.readDirSync(path)){
+		if(!entry.isFile&&!entry.isDirectory) continue;
+
+		const name = encoder.encode(entry.name);
+		if(name.length>255) throw new Error(`name too long: ${path}/${entry.name}`);
+
+		entries.push({name, path: `${path}/${entry.name}`, isDirectory: entry.isDirectory, entryOffset: 0, targetOffset: 0});
+	}
+
+	entries.sort((a, b) => compare_name(a.name, b.name));
+
+	const directoryOffset = size;
+	write_u32(dirTag);
+
+	write_u8(1);
+	write_u8(0);
+	const indexTargetOffset = reserve(8);
+
+	for(const entry of entries){
+		entry.entryOffset = size;
+		write_u8(entry.name.length);
+		write_bytes(entry.name);
+		entry.targetOffset = reserve(8);
+	}
+
+	write_u8(0);
+
+	set_u64(indexTargetOffset, size);
+	write_u32(indexTag);
+	write_u32(entries.length);
+	for(const entry of entries){
+		write_u32(entry.entryOffset-directoryOffset);
+	}
+
+	for(const entry of entries){
+		set_u64(entry.targetOffset, entry.isDirectory?pack_directory(entry.path):pack_file(entry.path));
+	}
+
+	return directoryOffset;
+}
+
+pack_directory(sourceDir.replace(/\/$/, ''));
+
+Deno.writeFileSync(stashPath, data.subarray(0, size));